@@ -10,193 +10,416 @@ template <typename T> inline size_t binarynode_t<T>::index() const
 	return tree_index(this->_ring, this->_branch, 2);
 }
 
-template <typename T> inline binaryiterator_t<T> binaryiterator_t<T>::left() const
+template <typename T> inline void binarynode_t<T>::link(const treereference_t<binarynode_t<T> >& up, const uint32_t child, const treereference_t<binarynode_t<T> >& self)
 {
-	return this->_node != 0 && this->_node->_left != 0 ? binaryiterator_t<T>(this->_node->_left) : binaryiterator_t<T>();
+	this->_up = up;
+	if (child == 1) { up->_left = self; }
+	else { up->_right = self; }
 }
-template <typename T> inline binaryiterator_t<T> binaryiterator_t<T>::left(const T& item)
+template <typename T> inline void binarynode_t<T>::unlink(const treereference_t<binarynode_t<T> >& up, const treereference_t<binarynode_t<T> >& self)
 {
-	if (this->_node != 0 && this->_node->_tree != 0)
+	if (up->_left == self) { up->_left = -1; }
+	else if (up->_right == self) { up->_right = -1; }
+}
+
+template <typename T, typename Node> inline binaryiterator_t<T, Node> binaryiterator_t<T, Node>::left() const
+{
+	if (this->_node != 0)
 	{
-		int32_t ring = this->_node->_ring + 1;
-		int32_t branch = (this->_node->_branch * 2) + 1;
-		int32_t index = tree_index(ring, branch, 2);
-		binarynode_t<T>& node = (this->_node->_tree->_registry[index] = binarynode_t<T>(*(this->_node->_tree), ring, branch, item));
-		node._up = this->_node;
-		this->_node->_left = treereference_t<binarynode_t<T> >(this->_node->_tree->_registry, index);
-		return binaryiterator_t<T>(this->_node->_left);
+		treereference_t<Node, 2> next = this->_node;
+		next = (int64_t)tree_child_index(this->_node.index(), 1, 2);
+		if (next.occupied())
+		{
+			return binaryiterator_t<T, Node>(next);
+		}
 	}
 	
-	return binaryiterator_t<T>();
+	return binaryiterator_t<T, Node>();
 }
-template <typename T> inline binaryiterator_t<T> binaryiterator_t<T>::right() const
+template <typename T, typename Node> inline binaryiterator_t<T, Node> binaryiterator_t<T, Node>::left(const T& item)
 {
-	return this->_node != 0 && this->_node->_right != 0 ? binaryiterator_t<T>(this->_node->_right) : binaryiterator_t<T>();
+	if (this->_node.occupied())
+	{
+		treereference_t<Node, 2> next = this->_node;
+		next = (int64_t)tree_child_index(this->_node.index(), 1, 2);
+		if (!next.registry()->occupy(next.index()))
+		{
+			return binaryiterator_t<T, Node>();
+		}
+		
+		Node& node = (*next = this->_node->spawn(next.ring(), next.branch(), item));
+		node.link(this->_node, 1, next);
+		return binaryiterator_t<T, Node>(next);
+	}
+	
+	return binaryiterator_t<T, Node>();
 }
-template <typename T> inline binaryiterator_t<T> binaryiterator_t<T>::right(const T& item)
+template <typename T, typename Node> inline binaryiterator_t<T, Node> binaryiterator_t<T, Node>::right() const
 {
 	if (this->_node != 0)
 	{
-		int32_t ring = this->_node->_ring + 1;
-		int32_t branch = this->_node->_branch * 2;
-		int32_t index = tree_index(ring, branch, 2);
-		binarynode_t<T>& node = (this->_node->_tree->_registry[index] = binarynode_t<T>(*(this->_node->_tree), ring, branch, item));
-		node._up = this->_node;
-		this->_node->_right = treereference_t<binarynode_t<T> >(this->_node->_tree->_registry, index);
-		return binaryiterator_t<T>(this->_node->_right);
+		treereference_t<Node, 2> next = this->_node;
+		next = (int64_t)tree_child_index(this->_node.index(), 0, 2);
+		if (next.occupied())
+		{
+			return binaryiterator_t<T, Node>(next);
+		}
+	}
+	
+	return binaryiterator_t<T, Node>();
+}
+template <typename T, typename Node> inline binaryiterator_t<T, Node> binaryiterator_t<T, Node>::right(const T& item)
+{
+	if (this->_node.occupied())
+	{
+		treereference_t<Node, 2> next = this->_node;
+		next = (int64_t)tree_child_index(this->_node.index(), 0, 2);
+		if (!next.registry()->occupy(next.index()))
+		{
+			return binaryiterator_t<T, Node>();
+		}
+		
+		Node& node = (*next = this->_node->spawn(next.ring(), next.branch(), item));
+		node.link(this->_node, 0, next);
+		return binaryiterator_t<T, Node>(next);
 	}
 	
-	return binaryiterator_t<T>();
+	return binaryiterator_t<T, Node>();
 }
-template <typename T> inline binaryiterator_t<T> binaryiterator_t<T>::parent()
+template <typename T, typename Node> inline binaryiterator_t<T, Node> binaryiterator_t<T, Node>::claim_left(const T& item)
 {
-    return this->_up != 0 ? binaryiterator_t<T>(this->_up) : binaryiterator_t<T>();
+	if (this->_node.occupied())
+	{
+		treereference_t<Node, 2> next = this->_node;
+		next = (int64_t)tree_child_index(this->_node.index(), 1, 2);
+		Node* node = next.registry()->claim(next.index());
+		if (node != 0)
+		{
+			*node = this->_node->spawn(next.ring(), next.branch(), item);
+			node->link(this->_node, 1, next);
+			return binaryiterator_t<T, Node>(next);
+		}
+	}
+	
+	return binaryiterator_t<T, Node>();
+}
+template <typename T, typename Node> inline binaryiterator_t<T, Node> binaryiterator_t<T, Node>::claim_right(const T& item)
+{
+	if (this->_node.occupied())
+	{
+		treereference_t<Node, 2> next = this->_node;
+		next = (int64_t)tree_child_index(this->_node.index(), 0, 2);
+		Node* node = next.registry()->claim(next.index());
+		if (node != 0)
+		{
+			*node = this->_node->spawn(next.ring(), next.branch(), item);
+			node->link(this->_node, 0, next);
+			return binaryiterator_t<T, Node>(next);
+		}
+	}
+	
+	return binaryiterator_t<T, Node>();
+}
+template <typename T, typename Node> inline binaryiterator_t<T, Node> binaryiterator_t<T, Node>::parent()
+{
+	if (this->_node != 0 && this->_node.index() > 0)
+	{
+		treereference_t<Node, 2> up = this->_node;
+		up = (int64_t)tree_parent_index(this->_node.index(), 2);
+		return binaryiterator_t<T, Node>(up);
+	}
+	
+	return binaryiterator_t<T, Node>();
 }
 
-template <typename T> inline binaryiterator_t<T> binaryiterator_t<T>::remove()
+template <typename T, typename Node> inline binaryiterator_t<T, Node> binaryiterator_t<T, Node>::remove()
 {
 	if (this->_node != 0)
 	{
-		treereference_t<binarynode_t<T> > prev = this->_node;
-		if (prev->_up != 0)
+		treereference_t<Node, 2> prev = this->_node;
+		binaryiterator_t<T, Node> up = this->parent();
+		if (!up.empty())
 		{
-			if (prev->_up->_left == prev) { prev->_up->_left = -1; }
-			else if (prev->_up->_right == prev) { prev->_up->_right = -1; }
+			prev->unlink(up._node, prev);
 		}
 		
-		this->_node = prev->_up;
-		prev->_tree->_registry.remove(prev->index());
-		if (this->_node != 0)
-		{
-			return binaryiterator_t<T>(this->_node);
-		}
+		this->_node = up._node;
+		prev.registry()->remove(prev.index());
+		return up;
 	}
 	
-	return binaryiterator_t<T>();
+	return binaryiterator_t<T, Node>();
 }
 
-template <typename T> inline bool binaryiterator_t<T>::has_left() const
+template <typename T, typename Node> inline bool binaryiterator_t<T, Node>::has_left() const
 {
-	return this->_node != 0 && this->_node->_left != 0;
+	return !this->left().empty();
 }
-template <typename T> inline bool binaryiterator_t<T>::has_right() const
+template <typename T, typename Node> inline bool binaryiterator_t<T, Node>::has_right() const
 {
-	return this->_node != 0 && this->_node->_right != 0;
+	return !this->right().empty();
 }
-template <typename T> inline bool binaryiterator_t<T>::root() const
+template <typename T, typename Node> inline bool binaryiterator_t<T, Node>::root() const
 {
-	return this->_node != 0 && this->_node->_parent == 0;
+	return this->_node != 0 && this->_node.index() == 0;
 }
-template <typename T> inline bool binaryiterator_t<T>::leaf() const
+template <typename T, typename Node> inline bool binaryiterator_t<T, Node>::leaf() const
 {
-	return this->_node != 0 && this->_node->_left == 0 && this->_node->_right == 0;
+	return this->_node != 0 && !this->has_left() && !this->has_right();
 }
 
-template <typename T> inline bool binaryiterator_t<T>::empty() const
+template <typename T, typename Node> inline bool binaryiterator_t<T, Node>::empty() const
 {
 	return this->_node == 0;
 }
 
-template <typename T> inline binaryiterator_t<T>& binaryiterator_t<T>::operator++()
+template <typename T, typename Node> inline binaryiterator_t<T, Node>& binaryiterator_t<T, Node>::operator++()
 {
 	if (this->_node != 0)
 	{
-		this->_node = this->_node->_left;
+		this->_node = this->left()._node;
 	}
 	
 	return *this;
 }
-template <typename T> inline binaryiterator_t<T>& binaryiterator_t<T>::operator--()
+template <typename T, typename Node> inline binaryiterator_t<T, Node>& binaryiterator_t<T, Node>::operator--()
 {
 	if (this->_node != 0)
 	{
-		this->_node = this->_node->_right;
+		this->_node = this->right()._node;
 	}
 	
 	return *this;
 }
-template <typename T> inline T& binaryiterator_t<T>::operator*() const
+template <typename T, typename Node> inline T& binaryiterator_t<T, Node>::operator*() const
 {
-	return *(this->_node->_data);
+	return this->_node->_data;
 }
-template <typename T> inline bool binaryiterator_t<T>::operator==(const binaryiterator_t<T>& other) const
+template <typename T, typename Node> inline bool binaryiterator_t<T, Node>::operator==(const binaryiterator_t<T, Node>& other) const
 {
 	return this->_node == other._node;
 }
-template <typename T> inline bool binaryiterator_t<T>::operator!=(const binaryiterator_t<T>& other) const
+template <typename T, typename Node> inline bool binaryiterator_t<T, Node>::operator!=(const binaryiterator_t<T, Node>& other) const
 {
 	return this->_node != other._node;
 }
 
-template <typename T> inline binaryiterator_t<T> binarytree_t<T>::set_root(const T& item)
+template <typename T, typename Node> inline binaryiterator_t<T, Node> binarytree_t<T, Node>::set_root(const T& item)
 {
 	this->_registry.zero();
-	this->_registry[0] = binarynode_t<T>(*this, 0, 0, item);
-	return iterator(treereference_t<binarynode_t<T> >(this->_registry, 0));
+	if (!this->_registry.occupy(0))
+	{
+		return iterator();
+	}
+	
+	this->_registry[0] = Node(*this, 0, 0, item);
+	return iterator(treereference_t<Node, 2>(this->_registry, 0));
 }
 
-template <typename T> inline binaryiterator_t<T> binarytree_t<T>::search(const T& item)
+template <typename T, typename Node> inline binaryiterator_t<T, Node> binarytree_t<T, Node>::search(const T& item)
 {
-	for (size_t i = 0; i < this->_registry.capacity(); i++)
+	size_t index = tree_search(this->_registry, item, 0);
+	if (index < this->_registry.capacity())
 	{
-		treereference_t<binarynode_t<T> > node(this->_registry, i);
-		if (!node.empty() && !node->empty() && memcmp(&(node->_data), &item, sizeof(T)) == 0)
+		return binaryiterator_t<T, Node>(treereference_t<Node, 2>(this->_registry, index));
+	}
+	
+	return binaryiterator_t<T, Node>();
+}
+
+template <typename T, typename Node> inline size_t binarytree_t<T, Node>::search_all(const T& item, iterator* results, const size_t limit)
+{
+	size_t count = 0;
+	for (size_t i = tree_search(this->_registry, item, 0); i < this->_registry.capacity(); i = tree_search(this->_registry, item, i + 1))
+	{
+		if (results != 0 && count < limit)
 		{
-			return binaryiterator_t<T>(node);
+			results[count] = iterator(treereference_t<Node, 2>(this->_registry, i));
 		}
+		
+		count++;
 	}
 	
-	return binaryiterator_t<T>();
+	return count;
 }
 
-template <typename T> inline void binarytree_t<T>::each(iterationfunc callback)
+template <typename T, typename Node> inline binaryiterator_t<T, Node> binarytree_t<T, Node>::parallel_search(const T& item, treepool_t* pool)
 {
-	execute_each(treereference_t<binarynode_t<T> >(this->_registry, 0), callback);
+	size_t index = tree_parallel_search(this->_registry, item, pool != 0 ? *pool : treepool_t::shared());
+	if (index < this->_registry.capacity())
+	{
+		return binaryiterator_t<T, Node>(treereference_t<Node, 2>(this->_registry, index));
+	}
+	
+	return binaryiterator_t<T, Node>();
 }
-template <typename T> inline void binarytree_t<T>::path(iterationfunc callback)
+template <typename T, typename Node> inline size_t binarytree_t<T, Node>::parallel_search_all(const T& item, iterator* results, const size_t limit, treepool_t* pool)
 {
-	execute_path(treereference_t<binarynode_t<T> >(this->_registry, 0), callback);
+	size_t* indices = results != 0 && limit > 0 ? (size_t*)calloc(limit, sizeof(size_t)) : 0;
+	size_t count = tree_parallel_search_all(this->_registry, item, pool != 0 ? *pool : treepool_t::shared(), indices, indices != 0 ? limit : 0);
+	for (size_t i = 0; indices != 0 && i < count && i < limit; i++)
+	{
+		results[i] = iterator(treereference_t<Node, 2>(this->_registry, indices[i]));
+	}
+	
+	free(indices);
+	return count;
 }
 
-template <typename T> inline void binarytree_t<T>::clear()
+template <typename T, typename Node> inline T* binarytree_t<T, Node>::payloads(const uint32_t ring) const
+{
+	static_assert(sizeof(Node) == sizeof(T), "payloads() needs a Node that only holds the payload, such as compactnode_t");
+	return ring < this->_registry.rings() ? (T*)this->_registry.ring(ring) : 0;
+}
+
+template <typename T, typename Node> template <typename F> inline void binarytree_t<T, Node>::for_each_level_order(const uint32_t first, const uint32_t last, F function)
+{
+	this->_registry.sweep(first, last, [&](Node& node) { function(node, node._data); });
+}
+
+template <typename T, typename Node> inline void binarytree_t<T, Node>::each(iterationfunc callback)
+{
+	execute_each(treereference_t<Node, 2>(this->_registry, 0), callback);
+}
+template <typename T, typename Node> inline void binarytree_t<T, Node>::path(iterationfunc callback)
+{
+	execute_path(treereference_t<Node, 2>(this->_registry, 0), callback);
+}
+
+template <typename T, typename Node> template <typename F, typename> inline void binarytree_t<T, Node>::each(F callback)
+{
+	this->_registry.descend([&](Node& node) { return callback(node, node._data); });
+}
+template <typename T, typename Node> template <typename F, typename> inline void binarytree_t<T, Node>::path(F callback)
+{
+	size_t index = 0;
+	while (this->_registry.occupied(index))
+	{
+		Node& node = this->_registry[index];
+		int32_t result = callback(node, node._data);
+		if (result == 0)
+		{
+			return;
+		}
+		
+		index = tree_child_index(index, result > 0 ? 1 : 0, 2);
+	}
+}
+
+template <typename T, typename Node> template <typename F> inline void binarytree_t<T, Node>::paths(const size_t count, F callback)
+{
+	this->_registry.paths(count, [&](const size_t query, Node& node) -> int32_t
+	{
+		int32_t result = callback(query, node, node._data);
+		return result == 0 ? -1 : (result > 0 ? 1 : 0);
+	});
+}
+
+template <typename T, typename Node> template <typename F> inline void binarytree_t<T, Node>::parallel_each(F function, const uint32_t ring, treepool_t* pool)
+{
+	tree_parallel_each(this->_registry, 0, [&](int& state, Node& node, T& item) { function(node, item); }, [](int& state, const int& other) {}, ring, pool != 0 ? *pool : treepool_t::shared());
+}
+template <typename T, typename Node> template <typename S, typename F, typename C> inline S binarytree_t<T, Node>::parallel_each(const S& initial, F function, C combine, const uint32_t ring, treepool_t* pool)
+{
+	return tree_parallel_each(this->_registry, initial, function, combine, ring, pool != 0 ? *pool : treepool_t::shared());
+}
+
+template <typename T, typename Node> inline bool binarytree_t<T, Node>::copy(const binarytree_t<T, Node>& other)
+{
+	static_assert(sizeof(Node) == sizeof(T) && std::is_trivially_copyable<T>::value, "copy() needs a Node that only holds a trivially copyable payload, such as compactnode_t of a plain type");
+	return this->_registry.copy(other._registry);
+}
+template <typename T, typename Node> inline bool binarytree_t<T, Node>::assign(const T* items, const size_t count, const uint64_t* mask)
+{
+	if (sizeof(Node) == sizeof(T) && std::is_trivially_copyable<T>::value)
+	{
+		// Payload only nodes are laid out like the items, so the array is copied as it is. Payloads that own memory, such
+		// as strings, would share it with the array that way, so they are copied one node at a time like any other node.
+		return this->_registry.assign((const Node*)items, count, mask);
+	}
+	
+	if (!this->_registry.assign(0, count, mask))
+	{
+		return false;
+	}
+	
+	treereference_t<Node, 2> up(this->_registry, 0);
+	treereference_t<Node, 2> self(this->_registry, 0);
+	for (size_t index = 0; index < count; index++)
+	{
+		if (mask != 0 && (mask[index >> 6] & ((uint64_t)1 << (index & 63))) == 0)
+		{
+			continue;
+		}
+		
+		self = (int64_t)index;
+		Node& node = (*self = Node(*this, self.ring(), self.branch(), items[index]));
+		if (index > 0)
+		{
+			up = (int64_t)tree_parent_index(index, 2);
+			node.link(up, (uint32_t)((index - 1) % 2), self);
+		}
+	}
+	
+	return true;
+}
+template <typename T, typename Node> inline bool binarytree_t<T, Node>::save(const char* path) const
+{
+	static_assert(sizeof(Node) == sizeof(T) && std::is_trivially_copyable<T>::value, "save() needs a Node that only holds a payload without pointers, such as compactnode_t of a plain type");
+	return this->_registry.save(path);
+}
+template <typename T, typename Node> inline bool binarytree_t<T, Node>::open(const char* path)
+{
+	static_assert(sizeof(Node) == sizeof(T) && std::is_trivially_copyable<T>::value, "open() needs a Node that only holds a payload without pointers, such as compactnode_t of a plain type");
+	return this->_registry.map(path);
+}
+template <typename T, typename Node> template <typename W> inline bool binarytree_t<T, Node>::write(W sink) const
+{
+	static_assert(sizeof(Node) == sizeof(T) && std::is_trivially_copyable<T>::value, "write() needs a Node that only holds a payload without pointers, such as compactnode_t of a plain type");
+	return this->_registry.write(sink);
+}
+template <typename T, typename Node> template <typename R> inline bool binarytree_t<T, Node>::read(R source)
+{
+	static_assert(sizeof(Node) == sizeof(T) && std::is_trivially_copyable<T>::value, "read() needs a Node that only holds a payload without pointers, such as compactnode_t of a plain type");
+	return this->_registry.read(source);
+}
+template <typename T, typename Node> inline void binarytree_t<T, Node>::clear()
 {
 	this->_registry.clear();
 }
 
-template <typename T> int32_t binarytree_t<T>::execute_each(const treereference_t<binarynode_t<T> >& node, iterationfunc callback)
+template <typename T, typename Node> int32_t binarytree_t<T, Node>::execute_each(const treereference_t<Node, 2>& node, iterationfunc callback)
 {
 	int32_t result = 1;
-	if (node != 0 && !node.empty() && !node->empty() && callback != 0)
+	if (node.occupied() && callback != 0)
 	{
 		result = callback(node, node->_data);
 		if (result != 0)
 		{
-			result = execute_each(node->_left, callback);
+			treereference_t<Node, 2> next = node;
+			next = (int64_t)tree_child_index(node.index(), 1, 2);
+			result = execute_each(next, callback);
 			if (result != 0)
 			{
-				result = execute_each(node->_right, callback);
+				next = (int64_t)tree_child_index(node.index(), 0, 2);
+				result = execute_each(next, callback);
 			}
 		}
 	}
 	
 	return result;
 }
-template <typename T> int32_t binarytree_t<T>::execute_path(const treereference_t<binarynode_t<T> >& node, iterationfunc callback)
+template <typename T, typename Node> int32_t binarytree_t<T, Node>::execute_path(const treereference_t<Node, 2>& node, iterationfunc callback)
 {
 	int32_t result = 0;
-	if (node != 0 && !node.empty() && !node->empty() && callback != 0)
+	if (node.occupied() && callback != 0)
 	{
 		result = callback(node, node->_data);
 		if (result != 0)
 		{
-			if (result > 0)
-			{
-				return execute_path(node->_left, callback);
-			}
-			else
-			{
-				return execute_path(node->_right, callback);
-			}
+			treereference_t<Node, 2> next = node;
+			next = (int64_t)tree_child_index(node.index(), result > 0 ? 1 : 0, 2);
+			return execute_path(next, callback);
 		}
 	}
 	
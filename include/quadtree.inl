@@ -10,168 +10,456 @@ template <typename T> inline size_t quadnode_t<T>::index() const
 	return tree_index(this->_ring, this->_branch, 4);
 }
 
-template <typename T> inline quaditerator_t<T> quaditerator_t<T>::child(const int32_t quadrant)
+template <typename T> inline void quadnode_t<T>::link(const treereference_t<quadnode_t<T> >& up, const uint32_t child, const treereference_t<quadnode_t<T> >& self)
 {
-	if (this->_node != 0)
+	this->_up = up;
+	switch (child)
+	{
+	case 0:
+		up->_q0 = self;
+		break;
+	case 1:
+		up->_q1 = self;
+		break;
+	case 2:
+		up->_q2 = self;
+		break;
+	default:
+		up->_q3 = self;
+		break;
+	}
+}
+template <typename T> inline void quadnode_t<T>::unlink(const treereference_t<quadnode_t<T> >& up, const treereference_t<quadnode_t<T> >& self)
+{
+	if (up->_q0 == self) { up->_q0 = -1; }
+	else if (up->_q1 == self) { up->_q1 = -1; }
+	else if (up->_q2 == self) { up->_q2 = -1; }
+	else if (up->_q3 == self) { up->_q3 = -1; }
+}
+
+template <typename T, typename Node> inline quaditerator_t<T, Node> quaditerator_t<T, Node>::child(const int32_t quadrant) const
+{
+	if (this->_node != 0 && (uint32_t)quadrant < 4)
 	{
-		switch (quadrant)
+		treereference_t<Node, 4> next = this->_node;
+		next = (int64_t)tree_child_index(this->_node.index(), quadrant, 4);
+		if (next.occupied())
 		{
-		case 0:
-			return quaditerator_t<T>(this->_node->_q0);
-		case 1:
-			return quaditerator_t<T>(this->_node->_q1);
-		case 2:
-			return quaditerator_t<T>(this->_node->_q2);
-		case 3:
-			return quaditerator_t<T>(this->_node->_q3);
-		default:
-			break;
+			return quaditerator_t<T, Node>(next);
 		}
 	}
 	
-    return quaditerator_t<T>();
+    return quaditerator_t<T, Node>();
 }
-template <typename T> inline quaditerator_t<T> quaditerator_t<T>::parent()
+template <typename T, typename Node> inline quaditerator_t<T, Node> quaditerator_t<T, Node>::child(const int32_t quadrant, const T& item)
 {
-    return this->_node != 0 && this->_node->_up != 0 ? quaditerator_t<T>(this->_node->_up) : quaditerator_t<T>();
+	if (this->_node.occupied() && (uint32_t)quadrant < 4)
+	{
+		treereference_t<Node, 4> next = this->_node;
+		next = (int64_t)tree_child_index(this->_node.index(), quadrant, 4);
+		if (!next.registry()->occupy(next.index()))
+		{
+			return quaditerator_t<T, Node>();
+		}
+		
+		Node& node = (*next = this->_node->spawn(next.ring(), next.branch(), item));
+		node.link(this->_node, quadrant, next);
+		return quaditerator_t<T, Node>(next);
+	}
+	
+	return quaditerator_t<T, Node>();
 }
-
-template <typename T> inline quaditerator_t<T> quaditerator_t<T>::remove()
+template <typename T, typename Node> inline quaditerator_t<T, Node> quaditerator_t<T, Node>::claim(const int32_t quadrant, const T& item)
+{
+	if (this->_node.occupied() && (uint32_t)quadrant < 4)
+	{
+		treereference_t<Node, 4> next = this->_node;
+		next = (int64_t)tree_child_index(this->_node.index(), quadrant, 4);
+		Node* node = next.registry()->claim(next.index());
+		if (node != 0)
+		{
+			*node = this->_node->spawn(next.ring(), next.branch(), item);
+			node->link(this->_node, quadrant, next);
+			return quaditerator_t<T, Node>(next);
+		}
+	}
+	
+	return quaditerator_t<T, Node>();
+}
+template <typename T, typename Node> inline quaditerator_t<T, Node> quaditerator_t<T, Node>::parent()
+{
+	if (this->_node != 0 && this->_node.index() > 0)
+	{
+		treereference_t<Node, 4> up = this->_node;
+		up = (int64_t)tree_parent_index(this->_node.index(), 4);
+		return quaditerator_t<T, Node>(up);
+	}
+	
+    return quaditerator_t<T, Node>();
+}
+template <typename T, typename Node> inline quaditerator_t<T, Node> quaditerator_t<T, Node>::neighbor(const int32_t dx, const int32_t dy) const
 {
 	if (this->_node != 0)
 	{
-		treereference_t<quadnode_t<T> > prev = this->_node;
-		if (prev->_up != 0)
+		// The cell's coordinates are taken out of its branch, moved, and put back together as the branch of the other cell.
+		const uint32_t ring = this->_node.ring();
+		uint32_t x = 0;
+		uint32_t y = 0;
+		tree_morton_decode(this->_node.branch(), &x, &y);
+		const int64_t side = (int64_t)1 << ring;
+		const int64_t column = (int64_t)x + dx;
+		const int64_t row = (int64_t)y + dy;
+		if (column >= 0 && column < side && row >= 0 && row < side)
 		{
-			if (prev->_up->_q0 == prev) { prev->_up->_q0 = -1; }
-			else if (prev->_up->_q1 == prev) { prev->_up->_q1 = -1; }
-			else if (prev->_up->_q2 == prev) { prev->_up->_q2 = -1; }
-			else if (prev->_up->_q3 == prev) { prev->_up->_q3 = -1; }
+			const uint64_t branch = tree_morton_encode((uint32_t)column, (uint32_t)row);
+			if (this->_node.registry()->occupied(ring, branch))
+			{
+				treereference_t<Node, 4> next = this->_node;
+				next = (int64_t)tree_index(ring, branch, 4);
+				return quaditerator_t<T, Node>(next);
+			}
 		}
-		
-		this->_node = prev->_up;
-		prev->_tree->_registry.remove(prev->index());
-		if (this->_node != 0)
+	}
+	
+	return quaditerator_t<T, Node>();
+}
+
+template <typename T, typename Node> inline quaditerator_t<T, Node> quaditerator_t<T, Node>::remove()
+{
+	if (this->_node != 0)
+	{
+		treereference_t<Node, 4> prev = this->_node;
+		quaditerator_t<T, Node> up = this->parent();
+		if (!up.empty())
 		{
-			return quaditerator_t<T>(this->_node);
+			prev->unlink(up._node, prev);
 		}
+		
+		this->_node = up._node;
+		prev.registry()->remove(prev.index());
+		return up;
 	}
 	
-	return quaditerator_t<T>();
+	return quaditerator_t<T, Node>();
 }
 
-template <typename T> inline bool quaditerator_t<T>::root() const
+template <typename T, typename Node> inline bool quaditerator_t<T, Node>::root() const
 {
-	return this->_node != 0 && this->_node->_parent == 0;
+	return this->_node != 0 && this->_node.index() == 0;
 }
-template <typename T> inline bool quaditerator_t<T>::leaf() const
+template <typename T, typename Node> inline bool quaditerator_t<T, Node>::leaf() const
 {
-	return this->_node != 0 && this->_node->_left == 0 && this->_node->_right == 0;
+	return this->_node != 0 && this->child(0).empty() && this->child(1).empty() && this->child(2).empty() && this->child(3).empty();
 }
 
-template <typename T> inline bool quaditerator_t<T>::empty() const
+template <typename T, typename Node> inline uint32_t quaditerator_t<T, Node>::x() const
+{
+	uint32_t x = 0;
+	uint32_t y = 0;
+	if (this->_node != 0)
+	{
+		tree_morton_decode(this->_node.branch(), &x, &y);
+	}
+	
+	return x;
+}
+template <typename T, typename Node> inline uint32_t quaditerator_t<T, Node>::y() const
+{
+	uint32_t x = 0;
+	uint32_t y = 0;
+	if (this->_node != 0)
+	{
+		tree_morton_decode(this->_node.branch(), &x, &y);
+	}
+	
+	return y;
+}
+
+template <typename T, typename Node> inline bool quaditerator_t<T, Node>::empty() const
 {
 	return this->_node == 0;
 }
 
-template <typename T> inline T& quaditerator_t<T>::operator*() const
+template <typename T, typename Node> inline T& quaditerator_t<T, Node>::operator*() const
 {
-	return *(this->_node->_data);
+	return this->_node->_data;
 }
-template <typename T> inline quaditerator_t<T> quaditerator_t<T>::operator[](const int32_t quadrant)
+template <typename T, typename Node> inline quaditerator_t<T, Node> quaditerator_t<T, Node>::operator[](const int32_t quadrant)
 {
     return this->child(quadrant);
 }
-template <typename T> inline bool quaditerator_t<T>::operator==(const quaditerator_t<T>& other) const
+template <typename T, typename Node> inline bool quaditerator_t<T, Node>::operator==(const quaditerator_t<T, Node>& other) const
 {
 	return this->_node == other._node;
 }
-template <typename T> inline bool quaditerator_t<T>::operator!=(const quaditerator_t<T>& other) const
+template <typename T, typename Node> inline bool quaditerator_t<T, Node>::operator!=(const quaditerator_t<T, Node>& other) const
 {
 	return this->_node != other._node;
 }
 
 #include <stdio.h>
 
-template <typename T> inline quaditerator_t<T> quadtree_t<T>::set_root(const T& item)
+template <typename T, typename Node> inline quaditerator_t<T, Node> quadtree_t<T, Node>::set_root(const T& item)
 {
 	this->_registry.zero();
-	this->_registry[0] = quadnode_t<T>(*this, 0, 0, item);
-	return quaditerator_t<T>(treereference_t<quadnode_t<T> >(this->_registry, 0));
+	if (!this->_registry.occupy(0))
+	{
+		return quaditerator_t<T, Node>();
+	}
+	
+	this->_registry[0] = Node(*this, 0, 0, item);
+	return quaditerator_t<T, Node>(treereference_t<Node, 4>(this->_registry, 0));
+}
+
+template <typename T, typename Node> inline quaditerator_t<T, Node> quadtree_t<T, Node>::search(const T& item)
+{
+	size_t index = tree_search(this->_registry, item, 0);
+	if (index < this->_registry.capacity())
+	{
+		return quaditerator_t<T, Node>(treereference_t<Node, 4>(this->_registry, index));
+	}
+	
+	return quaditerator_t<T, Node>();
 }
 
-template <typename T> inline quaditerator_t<T> quadtree_t<T>::search(const T& item)
+template <typename T, typename Node> inline size_t quadtree_t<T, Node>::search_all(const T& item, iterator* results, const size_t limit)
 {
-	for (size_t i = 0; i < this->_registry.capacity(); i++)
+	size_t count = 0;
+	for (size_t i = tree_search(this->_registry, item, 0); i < this->_registry.capacity(); i = tree_search(this->_registry, item, i + 1))
 	{
-		treereference_t<quadnode_t<T> > node(this->_registry, i);
-		if (!node.empty() && !node->empty() && memcmp(&(node->_data), &item, sizeof(T)) == 0)
+		if (results != 0 && count < limit)
 		{
-			return quaditerator_t<T>(node);
+			results[count] = iterator(treereference_t<Node, 4>(this->_registry, i));
 		}
+		
+		count++;
 	}
 	
-	return quaditerator_t<T>();
+	return count;
 }
 
-template <typename T> inline quaditerator_t<T> quadtree_t<T>::root()
+template <typename T, typename Node> inline quaditerator_t<T, Node> quadtree_t<T, Node>::root()
 {
-	return quaditerator_t<T>(treereference_t<quadnode_t<T> >(this->_registry, 0));
+	return quaditerator_t<T, Node>(treereference_t<Node, 4>(this->_registry, 0));
 }
-template <typename T> inline quaditerator_t<T> quadtree_t<T>::end() const
+template <typename T, typename Node> inline quaditerator_t<T, Node> quadtree_t<T, Node>::end() const
 {
-	return quaditerator_t<T>();
+	return quaditerator_t<T, Node>();
 }
 
-template <typename T> inline void quadtree_t<T>::each(iterationfunc callback)
+template <typename T, typename Node> inline quaditerator_t<T, Node> quadtree_t<T, Node>::cell(const uint32_t ring, const uint32_t x, const uint32_t y)
 {
-	execute_each(treereference_t<quadnode_t<T> >(this->_registry, 0), callback);
+	if (ring < 32 && ((uint64_t)x >> ring) == 0 && ((uint64_t)y >> ring) == 0)
+	{
+		const uint64_t branch = tree_morton_encode(x, y);
+		if (this->_registry.occupied(ring, branch))
+		{
+			return quaditerator_t<T, Node>(treereference_t<Node, 4>(this->_registry, tree_index(ring, branch, 4)));
+		}
+	}
+	
+	return quaditerator_t<T, Node>();
 }
-template <typename T> inline void quadtree_t<T>::path(iterationfunc callback)
+template <typename T, typename Node> inline quaditerator_t<T, Node> quadtree_t<T, Node>::locate(const uint32_t x, const uint32_t y, const uint32_t ring)
 {
-	execute_path(treereference_t<quadnode_t<T> >(this->_registry, 0), callback);
+	if (ring >= 32 || ((uint64_t)x >> ring) != 0 || ((uint64_t)y >> ring) != 0 || !this->_registry.occupied(0))
+	{
+		return quaditerator_t<T, Node>();
+	}
+	
+	// The used ancestors of the cell are the rings down to some depth, which is found by halving the range of rings it could be.
+	const uint64_t code = tree_morton_encode(x, y);
+	uint32_t low = 0;
+	uint32_t high = min(ring, this->_registry.rings() - 1);
+	while (low < high)
+	{
+		const uint32_t middle = (low + high + 1) / 2;
+		if (this->_registry.occupied(middle, code >> (2 * (ring - middle))))
+		{
+			low = middle;
+		}
+		else
+		{
+			high = middle - 1;
+		}
+	}
+	
+	return quaditerator_t<T, Node>(treereference_t<Node, 4>(this->_registry, tree_index(low, code >> (2 * (ring - low)), 4)));
+}
+
+template <typename T, typename Node> inline quaditerator_t<T, Node> quadtree_t<T, Node>::parallel_search(const T& item, treepool_t* pool)
+{
+	size_t index = tree_parallel_search(this->_registry, item, pool != 0 ? *pool : treepool_t::shared());
+	if (index < this->_registry.capacity())
+	{
+		return quaditerator_t<T, Node>(treereference_t<Node, 4>(this->_registry, index));
+	}
+	
+	return quaditerator_t<T, Node>();
+}
+template <typename T, typename Node> inline size_t quadtree_t<T, Node>::parallel_search_all(const T& item, iterator* results, const size_t limit, treepool_t* pool)
+{
+	size_t* indices = results != 0 && limit > 0 ? (size_t*)calloc(limit, sizeof(size_t)) : 0;
+	size_t count = tree_parallel_search_all(this->_registry, item, pool != 0 ? *pool : treepool_t::shared(), indices, indices != 0 ? limit : 0);
+	for (size_t i = 0; indices != 0 && i < count && i < limit; i++)
+	{
+		results[i] = iterator(treereference_t<Node, 4>(this->_registry, indices[i]));
+	}
+	
+	free(indices);
+	return count;
+}
+
+template <typename T, typename Node> inline T* quadtree_t<T, Node>::payloads(const uint32_t ring) const
+{
+	static_assert(sizeof(Node) == sizeof(T), "payloads() needs a Node that only holds the payload, such as compactnode_t");
+	return ring < this->_registry.rings() ? (T*)this->_registry.ring(ring) : 0;
+}
+
+template <typename T, typename Node> template <typename F> inline void quadtree_t<T, Node>::for_each_level_order(const uint32_t first, const uint32_t last, F function)
+{
+	this->_registry.sweep(first, last, [&](Node& node) { function(node, node._data); });
+}
+
+template <typename T, typename Node> inline void quadtree_t<T, Node>::each(iterationfunc callback)
+{
+	execute_each(treereference_t<Node, 4>(this->_registry, 0), callback);
+}
+template <typename T, typename Node> inline void quadtree_t<T, Node>::path(iterationfunc callback)
+{
+	execute_path(treereference_t<Node, 4>(this->_registry, 0), callback);
+}
+
+template <typename T, typename Node> template <typename F, typename> inline void quadtree_t<T, Node>::each(F callback)
+{
+	this->_registry.descend([&](Node& node) { return callback(node, node._data); });
+}
+template <typename T, typename Node> template <typename F, typename> inline void quadtree_t<T, Node>::path(F callback)
+{
+	size_t index = 0;
+	while (this->_registry.occupied(index))
+	{
+		Node& node = this->_registry[index];
+		int32_t result = callback(node, node._data);
+		if (result < 1 || result > 4)
+		{
+			return;
+		}
+		
+		index = tree_child_index(index, result - 1, 4);
+	}
+}
+
+template <typename T, typename Node> template <typename F> inline void quadtree_t<T, Node>::paths(const size_t count, F callback)
+{
+	this->_registry.paths(count, [&](const size_t query, Node& node) -> int32_t
+	{
+		int32_t result = callback(query, node, node._data);
+		return result >= 1 && result <= 4 ? result - 1 : -1;
+	});
 }
 
-template <typename T> inline void quadtree_t<T>::clear()
+template <typename T, typename Node> template <typename F> inline void quadtree_t<T, Node>::parallel_each(F function, const uint32_t ring, treepool_t* pool)
+{
+	tree_parallel_each(this->_registry, 0, [&](int& state, Node& node, T& item) { function(node, item); }, [](int& state, const int& other) {}, ring, pool != 0 ? *pool : treepool_t::shared());
+}
+template <typename T, typename Node> template <typename S, typename F, typename C> inline S quadtree_t<T, Node>::parallel_each(const S& initial, F function, C combine, const uint32_t ring, treepool_t* pool)
+{
+	return tree_parallel_each(this->_registry, initial, function, combine, ring, pool != 0 ? *pool : treepool_t::shared());
+}
+
+template <typename T, typename Node> inline bool quadtree_t<T, Node>::copy(const quadtree_t<T, Node>& other)
+{
+	static_assert(sizeof(Node) == sizeof(T) && std::is_trivially_copyable<T>::value, "copy() needs a Node that only holds a trivially copyable payload, such as compactnode_t of a plain type");
+	return this->_registry.copy(other._registry);
+}
+template <typename T, typename Node> inline bool quadtree_t<T, Node>::assign(const T* items, const size_t count, const uint64_t* mask)
+{
+	if (sizeof(Node) == sizeof(T) && std::is_trivially_copyable<T>::value)
+	{
+		// Payload only nodes are laid out like the items, so the array is copied as it is. Payloads that own memory, such
+		// as strings, would share it with the array that way, so they are copied one node at a time like any other node.
+		return this->_registry.assign((const Node*)items, count, mask);
+	}
+	
+	if (!this->_registry.assign(0, count, mask))
+	{
+		return false;
+	}
+	
+	treereference_t<Node, 4> up(this->_registry, 0);
+	treereference_t<Node, 4> self(this->_registry, 0);
+	for (size_t index = 0; index < count; index++)
+	{
+		if (mask != 0 && (mask[index >> 6] & ((uint64_t)1 << (index & 63))) == 0)
+		{
+			continue;
+		}
+		
+		self = (int64_t)index;
+		Node& node = (*self = Node(*this, self.ring(), self.branch(), items[index]));
+		if (index > 0)
+		{
+			up = (int64_t)tree_parent_index(index, 4);
+			node.link(up, (uint32_t)((index - 1) % 4), self);
+		}
+	}
+	
+	return true;
+}
+template <typename T, typename Node> inline bool quadtree_t<T, Node>::save(const char* path) const
+{
+	static_assert(sizeof(Node) == sizeof(T) && std::is_trivially_copyable<T>::value, "save() needs a Node that only holds a payload without pointers, such as compactnode_t of a plain type");
+	return this->_registry.save(path);
+}
+template <typename T, typename Node> inline bool quadtree_t<T, Node>::open(const char* path)
+{
+	static_assert(sizeof(Node) == sizeof(T) && std::is_trivially_copyable<T>::value, "open() needs a Node that only holds a payload without pointers, such as compactnode_t of a plain type");
+	return this->_registry.map(path);
+}
+template <typename T, typename Node> template <typename W> inline bool quadtree_t<T, Node>::write(W sink) const
+{
+	static_assert(sizeof(Node) == sizeof(T) && std::is_trivially_copyable<T>::value, "write() needs a Node that only holds a payload without pointers, such as compactnode_t of a plain type");
+	return this->_registry.write(sink);
+}
+template <typename T, typename Node> template <typename R> inline bool quadtree_t<T, Node>::read(R source)
+{
+	static_assert(sizeof(Node) == sizeof(T) && std::is_trivially_copyable<T>::value, "read() needs a Node that only holds a payload without pointers, such as compactnode_t of a plain type");
+	return this->_registry.read(source);
+}
+template <typename T, typename Node> inline void quadtree_t<T, Node>::clear()
 {
 	this->_registry.clear();
 }
 
-template <typename T> int32_t quadtree_t<T>::execute_each(const treereference_t<quadnode_t<T> >& node, iterationfunc callback)
+template <typename T, typename Node> int32_t quadtree_t<T, Node>::execute_each(const treereference_t<Node, 4>& node, iterationfunc callback)
 {
 	int32_t result = 1;
-	if (node != 0 && !node.empty() && !node->empty() && callback != 0)
+	if (node.occupied() && callback != 0)
 	{
 		result = callback(node, node->_data);
-		// if (result != 0)
-		// {
-		// 	result = execute_each(node->_left, callback);
-		// 	if (result != 0)
-		// 	{
-		// 		result = execute_each(node->_right, callback);
-		// 	}
-		// }
+		for (uint32_t quadrant = 0; quadrant < 4 && result != 0; quadrant++)
+		{
+			treereference_t<Node, 4> next = node;
+			next = (int64_t)tree_child_index(node.index(), quadrant, 4);
+			result = execute_each(next, callback);
+		}
 	}
 	
 	return result;
 }
-template <typename T> int32_t quadtree_t<T>::execute_path(const treereference_t<quadnode_t<T> >& node, iterationfunc callback)
+template <typename T, typename Node> int32_t quadtree_t<T, Node>::execute_path(const treereference_t<Node, 4>& node, iterationfunc callback)
 {
 	int32_t result = 0;
-	if (node != 0 && !node.empty() && !node->empty() && callback != 0)
+	if (node.occupied() && callback != 0)
 	{
 		result = callback(node, node->_data);
-		// if (result != 0)
-		// {
-		// 	if (result > 0)
-		// 	{
-		// 		return execute_path(node->_left, callback);
-		// 	}
-		// 	else
-		// 	{
-		// 		return execute_path(node->_right, callback);
-		// 	}
-		// }
+		if (result >= 1 && result <= 4)
+		{
+			treereference_t<Node, 4> next = node;
+			next = (int64_t)tree_child_index(node.index(), result - 1, 4);
+			return execute_path(next, callback);
+		}
 	}
 	
 	return result;
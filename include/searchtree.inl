@@ -0,0 +1,205 @@
+#pragma once
+
+template <typename T, typename Compare> inline binaryiterator_t<T, compactnode_t<T> > searchtree_t<T, Compare>::insert(const T& item)
+{
+	size_t index = 0;
+	uint32_t ring = 0;
+	while (this->_registry.occupied(index))
+	{
+		const T& data = this->_registry[index]._data;
+		if (this->_compare(item, data))
+		{
+			index = tree_child_index(index, 1, 2);
+		}
+		else if (this->_compare(data, item))
+		{
+			index = tree_child_index(index, 0, 2);
+		}
+		else
+		{
+			return iterator(reference(this->_registry, index));
+		}
+		
+		ring++;
+	}
+	
+	if (!this->_registry.occupy(index))
+	{
+		return iterator();
+	}
+	
+	this->_registry[index] = compactnode_t<T>(*this, ring, 0, item);
+	this->_peak = max(this->_peak, this->_registry.count());
+	const uint32_t limit = tree_log2(this->_registry.count()) + 2;
+	if (ring > limit)
+	{
+		// Like a packed memory array, the lowest ancestor whose subtree is sparse enough is rebuilt. The allowed density
+		// of the rings down to the limit rises from a half at the root to full at the limit, so a rebuilt subtree leaves
+		// its descendants room to grow and the cost stays amortized. The root is never more than a quarter full.
+		size_t up = index;
+		do
+		{
+			up = tree_parent_index(up, 2);
+			ring--;
+		}
+		while (ring > limit || 2 * limit * this->_registry.count(up) > (limit + ring) * (((size_t)2 << (limit - ring)) - 1));
+		
+		this->rebuild(up);
+		return this->find(item);
+	}
+	
+	return iterator(reference(this->_registry, index));
+}
+template <typename T, typename Compare> inline bool searchtree_t<T, Compare>::erase(const T& item)
+{
+	size_t index = this->locate(item);
+	if (index >= this->_registry.capacity())
+	{
+		return false;
+	}
+	
+	// The closest item from a subtree is moved up into the hole, which leaves a hole further down to fill the same way,
+	// until the hole is a leaf. Only items are moved, so no subtree has to be shifted to another ring.
+	while (true)
+	{
+		uint32_t toward = 1;
+		size_t next = tree_child_index(index, 0, 2);
+		if (!this->_registry.occupied(next))
+		{
+			toward = 0;
+			next = tree_child_index(index, 1, 2);
+			if (!this->_registry.occupied(next))
+			{
+				break;
+			}
+		}
+		
+		for (size_t deeper = tree_child_index(next, toward, 2); this->_registry.occupied(deeper); deeper = tree_child_index(deeper, toward, 2))
+		{
+			next = deeper;
+		}
+		
+		this->_registry[index] = this->_registry[next];
+		index = next;
+	}
+	
+	this->_registry.remove(index);
+	if (this->_registry.count() < this->_peak / 2)
+	{
+		this->rebuild(0);
+	}
+	
+	return true;
+}
+
+template <typename T, typename Compare> inline binaryiterator_t<T, compactnode_t<T> > searchtree_t<T, Compare>::find(const T& item)
+{
+	size_t index = this->locate(item);
+	return index < this->_registry.capacity() ? iterator(reference(this->_registry, index)) : iterator();
+}
+template <typename T, typename Compare> inline binaryiterator_t<T, compactnode_t<T> > searchtree_t<T, Compare>::lower_bound(const T& item)
+{
+	size_t index = this->bound(item, false);
+	return index < this->_registry.capacity() ? iterator(reference(this->_registry, index)) : iterator();
+}
+template <typename T, typename Compare> inline binaryiterator_t<T, compactnode_t<T> > searchtree_t<T, Compare>::upper_bound(const T& item)
+{
+	size_t index = this->bound(item, true);
+	return index < this->_registry.capacity() ? iterator(reference(this->_registry, index)) : iterator();
+}
+
+template <typename T, typename Compare> inline void searchtree_t<T, Compare>::clear()
+{
+	this->_registry.clear();
+	this->_peak = 0;
+}
+
+template <typename T, typename Compare> inline size_t searchtree_t<T, Compare>::locate(const T& item)
+{
+	size_t index = 0;
+	while (this->_registry.occupied(index))
+	{
+		const T& data = this->_registry[index]._data;
+		if (this->_compare(item, data))
+		{
+			index = tree_child_index(index, 1, 2);
+		}
+		else if (this->_compare(data, item))
+		{
+			index = tree_child_index(index, 0, 2);
+		}
+		else
+		{
+			return index;
+		}
+	}
+	
+	return this->_registry.capacity();
+}
+template <typename T, typename Compare> inline size_t searchtree_t<T, Compare>::bound(const T& item, const bool after)
+{
+	size_t result = this->_registry.capacity();
+	size_t index = 0;
+	while (this->_registry.occupied(index))
+	{
+		const T& data = this->_registry[index]._data;
+		if (after ? this->_compare(item, data) : !this->_compare(data, item))
+		{
+			result = index;
+			index = tree_child_index(index, 1, 2);
+		}
+		else
+		{
+			index = tree_child_index(index, 0, 2);
+		}
+	}
+	
+	return result;
+}
+template <typename T, typename Compare> inline void searchtree_t<T, Compare>::rebuild(const size_t index)
+{
+	// A subtree is grown before any item is taken out of it, so that the items stay where they are when it can't grow.
+	// Giving rings back can also fail, which leaves the whole tree with more rings than it needs.
+	size_t count = this->_registry.count(index);
+	compactnode_t<T>* nodes = (compactnode_t<T>*)calloc(max(count, (size_t)1), sizeof(compactnode_t<T>));
+	if (nodes == 0 || (index > 0 && !this->_registry.ensure(tree_ring_by_index(index, 2) + tree_log2(count) + 1, 2)))
+	{
+		free(nodes);
+		return;
+	}
+	
+	this->collect(index, nodes, 0);
+	this->_registry.remove(index);
+	if (index == 0)
+	{
+		// Rebuilding the whole tree also gives back the rings that are no longer needed.
+		this->_peak = count;
+		this->_registry.alloc(tree_log2(max(count, (size_t)1)) + 1, 2);
+	}
+	
+	this->place(index, nodes, 0, count);
+	free(nodes);
+}
+
+template <typename T, typename Compare> size_t searchtree_t<T, Compare>::collect(const size_t index, compactnode_t<T>* nodes, size_t count)
+{
+	if (this->_registry.occupied(index))
+	{
+		count = this->collect(tree_child_index(index, 1, 2), nodes, count);
+		nodes[count++] = this->_registry[index];
+		count = this->collect(tree_child_index(index, 0, 2), nodes, count);
+	}
+	
+	return count;
+}
+template <typename T, typename Compare> void searchtree_t<T, Compare>::place(const size_t index, const compactnode_t<T>* nodes, const size_t first, const size_t last)
+{
+	if (first < last)
+	{
+		size_t middle = first + (last - first) / 2;
+		this->_registry[index] = nodes[middle];
+		this->_registry.occupy(index);
+		this->place(tree_child_index(index, 1, 2), nodes, first, middle);
+		this->place(tree_child_index(index, 0, 2), nodes, middle + 1, last);
+	}
+}
\ No newline at end of file
@@ -0,0 +1,348 @@
+#pragma once
+
+template <typename T> inline bool spatialtree_t<T>::insert(const double x, const double y, const T& item)
+{
+	if (!(x >= this->_minx && x <= this->_maxx && y >= this->_miny && y <= this->_maxy))
+	{
+		return false;
+	}
+	
+	if (!this->_registry.occupied(0))
+	{
+		if (!this->_registry.occupy(0))
+		{
+			return false;
+		}
+		
+		this->_registry[0] = spatialnode_t<T>();
+	}
+	
+	cell_t cell = { 0, this->_minx, this->_miny, this->_maxx, this->_maxy, false };
+	uint32_t ring = 0;
+	while (true)
+	{
+		spatialnode_t<T>& node = this->_registry[cell._index];
+		if (divided(node))
+		{
+			node._count++;
+			cell = this->quadrant(cell, this->choose(cell, x, y));
+			ring++;
+			continue;
+		}
+		
+		// A cell that can't be split because the tree buffer could not grow keeps the point in its bucket.
+		if (node._count >= this->_bucket && ring + 1 < this->_depth && this->split(cell, ring))
+		{
+			continue;
+		}
+		
+		spatialpoint_t<T> point = { x, y, item };
+		append(this->_registry[cell._index], point);
+		break;
+	}
+	
+	this->_count++;
+	return true;
+}
+
+template <typename T> template <typename F> inline size_t spatialtree_t<T>::query_rect(const double minx, const double miny, const double maxx, const double maxy, F function)
+{
+	if (!this->_registry.occupied(0))
+	{
+		return 0;
+	}
+	
+	// The cells are visited depth first. A cell that lies wholly inside of the rectangle hands over its points without testing them,
+	// and so do all of its descendants.
+	size_t result = 0;
+	cell_t stack[4 * TREE_MAX_RINGS];
+	uint32_t top = 0;
+	stack[top++] = { 0, this->_minx, this->_miny, this->_maxx, this->_maxy, false };
+	while (top > 0)
+	{
+		cell_t cell = stack[--top];
+		if (!cell._inside)
+		{
+			if (cell._minx > maxx || cell._maxx < minx || cell._miny > maxy || cell._maxy < miny)
+			{
+				continue;
+			}
+			
+			cell._inside = cell._minx >= minx && cell._maxx <= maxx && cell._miny >= miny && cell._maxy <= maxy;
+		}
+		
+		spatialnode_t<T>& node = this->_registry[cell._index];
+		if (divided(node))
+		{
+			for (uint32_t quadrant = 0; quadrant < 4; quadrant++)
+			{
+				stack[top++] = this->quadrant(cell, quadrant);
+			}
+			
+			continue;
+		}
+		
+		for (uint32_t i = 0; i < node._count; i++)
+		{
+			const spatialpoint_t<T>& point = node._points[i];
+			if (cell._inside || (point._x >= minx && point._x <= maxx && point._y >= miny && point._y <= maxy))
+			{
+				function(point);
+				result++;
+			}
+		}
+	}
+	
+	return result;
+}
+template <typename T> template <typename F> inline size_t spatialtree_t<T>::query_radius(const double x, const double y, const double radius, F function)
+{
+	if (!this->_registry.occupied(0) || radius < 0.0)
+	{
+		return 0;
+	}
+	
+	// A cell is skipped when its nearest corner or edge is out of reach, and taken whole when its farthest corner is in reach.
+	const double reach = radius * radius;
+	size_t result = 0;
+	cell_t stack[4 * TREE_MAX_RINGS];
+	uint32_t top = 0;
+	stack[top++] = { 0, this->_minx, this->_miny, this->_maxx, this->_maxy, false };
+	while (top > 0)
+	{
+		cell_t cell = stack[--top];
+		if (!cell._inside)
+		{
+			const double nearx = x < cell._minx ? cell._minx - x : (x > cell._maxx ? x - cell._maxx : 0.0);
+			const double neary = y < cell._miny ? cell._miny - y : (y > cell._maxy ? y - cell._maxy : 0.0);
+			if (nearx * nearx + neary * neary > reach)
+			{
+				continue;
+			}
+			
+			const double farx = max(x - cell._minx, cell._maxx - x);
+			const double fary = max(y - cell._miny, cell._maxy - y);
+			cell._inside = farx * farx + fary * fary <= reach;
+		}
+		
+		spatialnode_t<T>& node = this->_registry[cell._index];
+		if (divided(node))
+		{
+			for (uint32_t quadrant = 0; quadrant < 4; quadrant++)
+			{
+				stack[top++] = this->quadrant(cell, quadrant);
+			}
+			
+			continue;
+		}
+		
+		for (uint32_t i = 0; i < node._count; i++)
+		{
+			const spatialpoint_t<T>& point = node._points[i];
+			const double dx = point._x - x;
+			const double dy = point._y - y;
+			if (cell._inside || dx * dx + dy * dy <= reach)
+			{
+				function(point);
+				result++;
+			}
+		}
+	}
+	
+	return result;
+}
+template <typename T> inline size_t spatialtree_t<T>::nearest_k(const double x, const double y, const size_t k, spatialpoint_t<T>* results)
+{
+	if (!this->_registry.occupied(0) || k == 0 || results == 0)
+	{
+		return 0;
+	}
+	
+	// The cells are visited depth first with the nearest quadrant first, so the results fill up with close points early,
+	// and from then on every cell that is no nearer than the farthest result is skipped. The results are kept sorted.
+	size_t found = 0;
+	double worst = 0.0;
+	cell_t stack[4 * TREE_MAX_RINGS];
+	double distances[4 * TREE_MAX_RINGS];
+	uint32_t top = 0;
+	stack[top] = { 0, this->_minx, this->_miny, this->_maxx, this->_maxy, false };
+	distances[top++] = 0.0;
+	while (top > 0)
+	{
+		top--;
+		const cell_t cell = stack[top];
+		if (found == k && distances[top] >= worst)
+		{
+			continue;
+		}
+		
+		const spatialnode_t<T>& node = this->_registry[cell._index];
+		if (divided(node))
+		{
+			// The quadrants are pushed farthest first, so that the nearest one is taken next.
+			cell_t quadrants[4];
+			double near[4];
+			for (uint32_t quadrant = 0; quadrant < 4; quadrant++)
+			{
+				quadrants[quadrant] = this->quadrant(cell, quadrant);
+				const double nearx = x < quadrants[quadrant]._minx ? quadrants[quadrant]._minx - x : (x > quadrants[quadrant]._maxx ? x - quadrants[quadrant]._maxx : 0.0);
+				const double neary = y < quadrants[quadrant]._miny ? quadrants[quadrant]._miny - y : (y > quadrants[quadrant]._maxy ? y - quadrants[quadrant]._maxy : 0.0);
+				near[quadrant] = nearx * nearx + neary * neary;
+			}
+			
+			for (uint32_t i = 0; i < 4; i++)
+			{
+				uint32_t farthest = i;
+				for (uint32_t j = i + 1; j < 4; j++)
+				{
+					farthest = near[j] > near[farthest] ? j : farthest;
+				}
+				
+				const cell_t swapped = quadrants[i];
+				const double distance = near[farthest];
+				quadrants[i] = quadrants[farthest];
+				near[farthest] = near[i];
+				quadrants[farthest] = swapped;
+				near[i] = distance;
+				stack[top] = quadrants[i];
+				distances[top++] = distance;
+			}
+			
+			continue;
+		}
+		
+		for (uint32_t i = 0; i < node._count; i++)
+		{
+			const spatialpoint_t<T>& point = node._points[i];
+			const double distance = (point._x - x) * (point._x - x) + (point._y - y) * (point._y - y);
+			if (found == k && distance >= worst)
+			{
+				continue;
+			}
+			
+			size_t slot = found < k ? found++ : k - 1;
+			for (; slot > 0; slot--)
+			{
+				const spatialpoint_t<T>& before = results[slot - 1];
+				if ((before._x - x) * (before._x - x) + (before._y - y) * (before._y - y) <= distance)
+				{
+					break;
+				}
+				
+				results[slot] = before;
+			}
+			
+			results[slot] = point;
+			if (found == k)
+			{
+				worst = (results[k - 1]._x - x) * (results[k - 1]._x - x) + (results[k - 1]._y - y) * (results[k - 1]._y - y);
+			}
+		}
+	}
+	
+	return found;
+}
+
+template <typename T> inline void spatialtree_t<T>::clear()
+{
+	for (size_t index = this->_registry.next(0); index < this->_registry.capacity(); index = this->_registry.next(index + 1))
+	{
+		delete[] this->_registry[index]._points;
+	}
+	
+	this->_registry.clear();
+	this->_count = 0;
+}
+
+template <typename T> inline typename spatialtree_t<T>::cell_t spatialtree_t<T>::quadrant(const cell_t& cell, const uint32_t quadrant) const
+{
+	const double midx = cell._minx + (cell._maxx - cell._minx) * 0.5;
+	const double midy = cell._miny + (cell._maxy - cell._miny) * 0.5;
+	cell_t result = { tree_child_index(cell._index, quadrant, 4), cell._minx, cell._miny, cell._maxx, cell._maxy, cell._inside };
+	if ((quadrant & 1) != 0)
+	{
+		result._minx = midx;
+	}
+	else
+	{
+		result._maxx = midx;
+	}
+	
+	if ((quadrant & 2) != 0)
+	{
+		result._miny = midy;
+	}
+	else
+	{
+		result._maxy = midy;
+	}
+	
+	return result;
+}
+template <typename T> inline uint32_t spatialtree_t<T>::choose(const cell_t& cell, const double x, const double y) const
+{
+	const double midx = cell._minx + (cell._maxx - cell._minx) * 0.5;
+	const double midy = cell._miny + (cell._maxy - cell._miny) * 0.5;
+	return (x >= midx ? 1 : 0) | (y >= midy ? 2 : 0);
+}
+template <typename T> inline bool spatialtree_t<T>::split(const cell_t& cell, const uint32_t ring)
+{
+	// The tree buffer is grown before any node is referenced, as growing a contiguous buffer moves the nodes.
+	if (!this->_registry.ensure(ring + 2, 4))
+	{
+		return false;
+	}
+	
+	for (uint32_t quadrant = 0; quadrant < 4; quadrant++)
+	{
+		const size_t index = tree_child_index(cell._index, quadrant, 4);
+		if (!this->_registry.occupy(index))
+		{
+			// A sparse page could not be allocated, so the children that were already marked are given back.
+			for (uint32_t i = 0; i < quadrant; i++)
+			{
+				this->_registry.remove(tree_child_index(cell._index, i, 4));
+			}
+			
+			return false;
+		}
+		
+		this->_registry[index] = spatialnode_t<T>();
+	}
+	
+	spatialnode_t<T> node = this->_registry[cell._index];
+	for (uint32_t i = 0; i < node._count; i++)
+	{
+		append(this->_registry[tree_child_index(cell._index, this->choose(cell, node._points[i]._x, node._points[i]._y), 4)], node._points[i]);
+	}
+	
+	delete[] node._points;
+	node._points = 0;
+	node._capacity = 0;
+	this->_registry[cell._index] = node;
+	return true;
+}
+
+template <typename T> inline bool spatialtree_t<T>::divided(const spatialnode_t<T>& node)
+{
+	// Only a split cell has points without a bucket, as a leaf allocates its bucket with its first point.
+	return node._points == 0 && node._count > 0;
+}
+template <typename T> void spatialtree_t<T>::append(spatialnode_t<T>& node, const spatialpoint_t<T>& point)
+{
+	if (node._count == node._capacity)
+	{
+		const uint32_t capacity = max(node._capacity * 2, 4u);
+		spatialpoint_t<T>* points = new spatialpoint_t<T>[capacity];
+		for (uint32_t i = 0; i < node._count; i++)
+		{
+			points[i] = node._points[i];
+		}
+		
+		delete[] node._points;
+		node._points = points;
+		node._capacity = capacity;
+	}
+	
+	node._points[node._count++] = point;
+}
\ No newline at end of file
@@ -0,0 +1,78 @@
+#pragma once
+
+template <typename T, typename Compare> inline bool statictree_t<T, Compare>::assign(const T* items, const size_t count)
+{
+	this->_registry.clear();
+	if (count == 0)
+	{
+		return true;
+	}
+	
+	if (!this->_registry.alloc(tree_log2(count) + 1, 2))
+	{
+		this->_registry.clear();
+		return false;
+	}
+	
+	this->place(0, items, count, 0);
+	for (size_t index = 0; index < count; index++)
+	{
+		this->_registry.occupy(index);
+	}
+	
+	return true;
+}
+
+template <typename T, typename Compare> inline binaryiterator_t<T, compactnode_t<T> > statictree_t<T, Compare>::find(const T& item)
+{
+	size_t index = this->bound(item, false);
+	return index < this->_registry.capacity() && !this->_compare(item, this->_registry[index]._data) ? iterator(reference(this->_registry, index)) : iterator();
+}
+template <typename T, typename Compare> inline binaryiterator_t<T, compactnode_t<T> > statictree_t<T, Compare>::lower_bound(const T& item)
+{
+	size_t index = this->bound(item, false);
+	return index < this->_registry.capacity() ? iterator(reference(this->_registry, index)) : iterator();
+}
+template <typename T, typename Compare> inline binaryiterator_t<T, compactnode_t<T> > statictree_t<T, Compare>::upper_bound(const T& item)
+{
+	size_t index = this->bound(item, true);
+	return index < this->_registry.capacity() ? iterator(reference(this->_registry, index)) : iterator();
+}
+
+template <typename T, typename Compare> inline size_t statictree_t<T, Compare>::bound(const T& item, const bool after) const
+{
+	// Counting from one, the children of position p are 2p for the right child and 2p + 1 for the left child, so the
+	// walk appends a one bit for every step to the left. The answer is the last node the walk went left from, which is
+	// found by dropping the trailing steps to the right and then that step to the left.
+	const compactnode_t<T>* nodes = this->_registry.ring(0);
+	const size_t count = this->_registry.count();
+	const size_t capacity = this->_registry.capacity();
+	size_t position = 1;
+	while (position <= count)
+	{
+		// Four levels down sits past the end of the nodes near the bottom of the tree, so only prefetch within them.
+		if ((position << 4) <= capacity)
+		{
+			tree_prefetch(nodes + ((position << 4) - 1));
+		}
+		
+		const T& data = nodes[position - 1]._data;
+		position = (position << 1) + (size_t)(after ? this->_compare(item, data) : !this->_compare(data, item));
+	}
+	
+	position >>= tree_ctz64(position) + 1;
+	return position > 0 ? position - 1 : this->_registry.capacity();
+}
+
+template <typename T, typename Compare> size_t statictree_t<T, Compare>::place(const size_t index, const T* items, const size_t count, size_t next)
+{
+	// An in-order walk of the complete tree hands out the sorted items, so each node is written once.
+	if (index < count)
+	{
+		next = this->place(tree_child_index(index, 1, 2), items, count, next);
+		this->_registry.ring(0)[index]._data = items[next++];
+		next = this->place(tree_child_index(index, 0, 2), items, count, next);
+	}
+	
+	return next;
+}
\ No newline at end of file
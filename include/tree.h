@@ -1,10 +1,43 @@
 #pragma once
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <inttypes.h>
 #include <math.h>
 #include <string.h>
 
+#include <iterator>
+#include <type_traits>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define TREE_SIMD_AVX2 1
+#include <immintrin.h>
+#endif
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#if defined(_WIN32)
+#include <windows.h>
+#include <malloc.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#if defined(__BMI2__) || (defined(_MSC_VER) && defined(__AVX2__) && defined(_M_X64))
+#define TREE_BMI2 1
+#include <immintrin.h>
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TREE_SIMD_SSE2 1
+#include <emmintrin.h>
+#endif
+
 #if !defined(min)
 #define min(x, y) (x < y ? x : y)
 #endif
@@ -12,13 +45,79 @@
 #define max(x, y) (x > y ? x : y)
 #endif
 
+/// <summary>
+/// Calculates the base 2 logarithm of the given value, rounded down.
+/// </summary>
+/// <param name="value">A non-zero value.</param>
+/// <returns>The index of the highest set bit.</returns>
+inline constexpr uint32_t tree_log2(const uint64_t value);
+
+/// <summary>
+/// Counts the trailing zero bits of the given value.
+/// </summary>
+/// <param name="value">A non-zero value.</param>
+/// <returns>The index of the lowest set bit.</returns>
+inline constexpr uint32_t tree_ctz64(const uint64_t value);
+
+/// <summary>
+/// Counts the set bits of the given value.
+/// </summary>
+/// <param name="value">Any value.</param>
+/// <returns>The number of bits that are set.</returns>
+inline constexpr uint32_t tree_popcount64(const uint64_t value);
+
+/// <summary>
+/// Atomically sets bits in a word that other threads may be setting bits in at the same time.
+/// </summary>
+/// <param name="word">The word to change.</param>
+/// <param name="bits">The bits to set.</param>
+/// <returns>The value of the word before the bits were set.</returns>
+inline uint64_t tree_atomic_or64(uint64_t* word, const uint64_t bits);
+/// <summary>
+/// Atomically reads a word that other threads may be setting bits in.
+/// </summary>
+/// <param name="word">The word to read.</param>
+inline uint64_t tree_atomic_load64(const uint64_t* word);
+/// <summary>
+/// Atomically adds to a counter that other threads may be adding to at the same time.
+/// </summary>
+/// <param name="value">The counter to change.</param>
+/// <param name="amount">The amount to add.</param>
+inline void tree_atomic_add(size_t* value, const size_t amount);
+/// <summary>
+/// Atomically reads a pointer that other threads may be installing.
+/// </summary>
+/// <param name="slot">The pointer to read.</param>
+inline void* tree_atomic_load_pointer(void* const* slot);
+/// <summary>
+/// Atomically installs a pointer if the slot still holds the expected pointer.
+/// </summary>
+/// <param name="slot">The pointer to change.</param>
+/// <param name="expected">The pointer that the slot has to hold.</param>
+/// <param name="desired">The pointer to install.</param>
+/// <returns>The pointer that the slot holds afterwards.</returns>
+inline void* tree_atomic_install_pointer(void** slot, void* expected, void* desired);
+/// <summary>
+/// Asks the processor to start loading the cache line of an address that will be read soon, which never faults.
+/// </summary>
+/// <param name="address">Any address, it does not have to be valid.</param>
+inline void tree_prefetch(const void* address);
+
+/// <summary>
+/// Calculates the stride raised to the given power using integer math.
+/// </summary>
+/// <param name="exponent">The power to raise the stride to.</param>
+/// <param name="stride">The number of child nodes for each parent.</param>
+/// <returns>The stride to the power of the exponent, or SIZE_MAX when it does not fit in a size_t.</returns>
+inline constexpr size_t tree_pow(const uint32_t exponent, const uint32_t stride);
+
 /// <summary>
 /// Calculates the tree ring for the given index and stride.
 /// </summary>
 /// <param name="index">The index inside of the tree.</param>
 /// <param name="stride">The number of child nodes for each parent.</param>
 /// <returns>The ring's index.</returns>
-inline uint32_t tree_ring_by_index(const size_t index, const uint32_t stride);
+inline constexpr uint32_t tree_ring_by_index(const size_t index, const uint32_t stride);
 
 /// <summary>
 /// Calculates the tree ring branch for the given index and stride.
@@ -26,15 +125,22 @@ inline uint32_t tree_ring_by_index(const size_t index, const uint32_t stride);
 /// <param name="index">The index inside of the tree.</param>
 /// <param name="stride">The number of child nodes for each parent.</param>
 /// <returns>The branch's index.</returns>
-inline uint32_t tree_branch_by_index(const size_t index, const uint32_t stride);
+inline constexpr size_t tree_branch_by_index(const size_t index, const uint32_t stride);
 
 /// <summary>
 /// Calculates the size needed for the given number of rings and specified stride.
 /// </summary>
 /// <param name="rings">The number of rings that make up the tree.</param>
 /// <param name="stride">The number of child nodes for each parent.</param>
-/// <returns>The number of elements that the tree can potentially hold.</returns>
-inline size_t tree_size(const uint32_t rings, const uint32_t stride);
+/// <returns>The number of elements that the tree can potentially hold, or SIZE_MAX when there are more rings than tree_max_rings().</returns>
+inline constexpr size_t tree_size(const uint32_t rings, const uint32_t stride);
+
+/// <summary>
+/// Calculates the largest number of rings whose size still fits in a size_t, which is about 64 / log2(stride).
+/// </summary>
+/// <param name="stride">The number of child nodes for each parent.</param>
+/// <returns>The number of rings that a tree with the stride can address, never more than TREE_MAX_RINGS.</returns>
+inline constexpr uint32_t tree_max_rings(const uint32_t stride);
 
 /// <summary>
 /// Calculates the size of a ring with the specified stride.
@@ -42,7 +148,7 @@ inline size_t tree_size(const uint32_t rings, const uint32_t stride);
 /// <param name="ring">The index of a tree ring.</param>
 /// <param name="stride">The number of child nodes for each parent.</param>
 /// <returns>The number of elements that a tree ring can potentially hold.</returns>
-inline size_t tree_ring_length(const uint32_t ring, const uint32_t stride);
+inline constexpr size_t tree_ring_length(const uint32_t ring, const uint32_t stride);
 
 /// <summary>
 /// Calculates a tree index.
@@ -51,80 +157,586 @@ inline size_t tree_ring_length(const uint32_t ring, const uint32_t stride);
 /// <param name="branch">The index inside of the ring for the node.</param>
 /// <param name="stride">The number of child nodes for each parent.</param>
 /// <returns>An index that could exists in the tree.</returns>
-inline size_t tree_index(const uint32_t ring, const uint32_t branch, const uint32_t stride);
+inline constexpr size_t tree_index(const uint32_t ring, const size_t branch, const uint32_t stride);
+
+/// <summary>
+/// Calculates the index of a node's parent.
+/// </summary>
+/// <param name="index">The index of a node that is not the root.</param>
+/// <param name="stride">The number of child nodes for each parent.</param>
+/// <returns>The index of the parent node.</returns>
+inline constexpr size_t tree_parent_index(const size_t index, const uint32_t stride);
+
+/// <summary>
+/// Calculates the index of one of a node's children.
+/// </summary>
+/// <param name="index">The index of the parent node.</param>
+/// <param name="child">The number of the child, less than the stride.</param>
+/// <param name="stride">The number of child nodes for each parent.</param>
+/// <returns>The index of the child node.</returns>
+inline constexpr size_t tree_child_index(const size_t index, const uint32_t child, const uint32_t stride);
+
+/// <summary>
+/// Interleaves the bits of a cell's coordinates into its Morton code, with x in the even bits and y in the odd bits.
+/// Uses pdep when the build targets BMI2, and shifts and masks otherwise.
+/// </summary>
+/// <param name="x">The column of the cell.</param>
+/// <param name="y">The row of the cell.</param>
+/// <returns>The cell's place along the Z-order curve.</returns>
+inline uint64_t tree_morton_encode(const uint32_t x, const uint32_t y);
+/// <summary>
+/// Splits a Morton code back into the coordinates of its cell.
+/// Uses pext when the build targets BMI2, and shifts and masks otherwise.
+/// </summary>
+/// <param name="code">The cell's place along the Z-order curve.</param>
+/// <param name="x">Receives the column of the cell.</param>
+/// <param name="y">Receives the row of the cell.</param>
+inline void tree_morton_decode(const uint64_t code, uint32_t* x, uint32_t* y);
+
+/// <summary>
+/// The largest number of rings that a segmented tree buffer can hold.
+/// </summary>
+#define TREE_MAX_RINGS 64
+
+/// <summary>
+/// The size of a huge page in bytes, which treehugepages_t aligns its blocks to.
+/// </summary>
+#define TREE_HUGE_PAGE ((size_t)2 << 20)
+
+/// <summary>
+/// Describes how a treealloc_t instance lays out its rings in memory.
+/// </summary>
+enum treestorage_t
+{
+	/// <summary>
+	/// Every ring lives in one buffer, which is re-allocated and copied when the tree grows.
+	/// </summary>
+	TREE_STORAGE_CONTIGUOUS = 0,
+	/// <summary>
+	/// Every ring lives in its own block, so growing only allocates the new rings and existing elements never move.
+	/// </summary>
+	TREE_STORAGE_SEGMENTED = 1,
+	/// <summary>
+	/// Every ring is split into pages of 64 elements that are reached through a radix table, and a page is only allocated
+	/// once an element in it is written, so deep and thin trees only pay for the pages along their paths.
+	/// </summary>
+	TREE_STORAGE_SPARSE = 2,
+	/// <summary>
+	/// Every node lives in one buffer in van Emde Boas order, where the tree is cut at half its height and the top half is followed by each bottom subtree,
+	/// recursively, so a path from the root to a leaf stays within few cache lines and pages. The buffer is laid out again whenever the tree grows.
+	/// </summary>
+	TREE_STORAGE_VEB = 3,
+};
+
+/// <summary>
+/// Contains the steps that place the nodes of each ring in a van Emde Boas layout of one height.
+/// Which half of each cut a node falls in only depends on its ring, so the cuts are worked out once and a node's offset is a few shifts and multiplies.
+/// </summary>
+struct treeveb_t
+{
+	
+	struct step_t
+	{
+		uint32_t _shift;
+		size_t _width;
+		size_t _base;
+		size_t _scale;
+	};
+	
+	/// <summary>
+	/// Works out the steps for every ring of a tree.
+	/// </summary>
+	/// <param name="rings">The number of rings in the tree.</param>
+	/// <param name="stride">The number of child nodes for each parent.</param>
+	inline void build(const uint32_t rings, const uint32_t stride);
+	/// <summary>
+	/// Calculates where a node is placed in the tree buffer.
+	/// </summary>
+	/// <param name="ring">The ring of the node.</param>
+	/// <param name="branch">The index of the node inside of its ring.</param>
+	/// <returns>The offset of the node in the tree buffer.</returns>
+	inline size_t offset(const uint32_t ring, const size_t branch) const;
+	
+	bool _power;
+	uint32_t _count[TREE_MAX_RINGS];
+	step_t _steps[TREE_MAX_RINGS][8];
+	
+};
+
+/// <summary>
+/// Contains the header of a tree image file, which holds a tree buffer in a form that can be mapped back into memory as it is.
+/// The elements of every ring follow in level order from a 64 byte boundary, and then the occupancy words of every ring.
+/// Offsets are counted in bytes from the start of the file, so the image holds no pointers.
+/// </summary>
+struct treeimage_t
+{
+	char _magic[4];
+	uint32_t _version;
+	uint32_t _stride;
+	uint32_t _rings;
+	uint64_t _size;
+	uint64_t _count;
+	uint64_t _elements;
+	uint64_t _occupancy;
+	uint64_t _length;
+};
+
+/// <summary>
+/// Contains the header of a tree stream, which is followed by the used elements of each ring in order.
+/// Each ring is a list of records for its blocks of 64 elements that have used elements: the distance from the previous
+/// record's block plus one as a variable length number, the block's occupancy word, and then only the used elements,
+/// packed in order. A zero ends the ring. Numbers are written in the byte order of the machine.
+/// </summary>
+struct treestream_t
+{
+	char _magic[4];
+	uint32_t _version;
+	uint32_t _stride;
+	uint32_t _rings;
+	uint64_t _size;
+	uint64_t _count;
+};
+
+/// <summary>
+/// Contains one page of a sparse tree buffer, which holds 64 consecutive elements of a ring and their occupancy.
+/// </summary>
+template <typename T> struct treepage_t
+{
+	uint64_t _bits;
+	T _elements[64];
+};
+
+/// <summary>
+/// Gets the compile-time stride used for a tree element type, or zero when the stride is only known at runtime.
+/// </summary>
+template <typename T> struct tree_stride_t
+{
+	static const uint32_t value = 0;
+};
+
+/// <summary>
+/// Contains the policy that a tree buffer gets its memory from, in place of calloc and free.
+/// A policy is shared by reference and has to outlive every tree buffer that uses it.
+/// </summary>
+class treeallocator_t
+{
+public:
+	
+	inline virtual ~treeallocator_t() {}
+	
+	/// <summary>
+	/// Allocates a block of memory that is zeroed and aligned to atleast 64 bytes.
+	/// </summary>
+	/// <param name="size">The number of bytes, which is never zero.</param>
+	/// <returns>The block of memory, or null when it could not be allocated.</returns>
+	virtual void* allocate(const size_t size) = 0;
+	/// <summary>
+	/// Gives back a block of memory that was allocated by this policy.
+	/// </summary>
+	/// <param name="memory">The block of memory.</param>
+	/// <param name="size">The number of bytes that the block was allocated with.</param>
+	virtual void release(void* memory, const size_t size) = 0;
+	
+};
+
+/// <summary>
+/// Allocates memory from the heap aligned to a power of two, such as a cache line, or a page so that no two blocks share a page.
+/// </summary>
+class treealigned_t : public treeallocator_t
+{
+public:
+	
+	/// <param name="alignment">The alignment of every block in bytes, which is a power of two of atleast 64.</param>
+	inline treealigned_t(const size_t alignment = 64) :
+		_alignment(max(alignment, (size_t)64)) {}
+		
+	inline void* allocate(const size_t size);
+	inline void release(void* memory, const size_t size);
+	
+	/// <summary>
+	/// Gets the alignment of every block in bytes.
+	/// </summary>
+	inline size_t alignment() const { return this->_alignment; }
+	
+protected:
+	
+	size_t _alignment;
+	
+};
+
+/// <summary>
+/// Allocates blocks of atleast 2 MiB on huge page boundaries and asks for them to be backed by huge pages, which cuts the TLB misses of walking a large tree buffer.
+/// Smaller blocks are only aligned to a cache line. The request is only a hint given with madvise on Linux, elsewhere the blocks are just aligned.
+/// </summary>
+class treehugepages_t : public treealigned_t
+{
+public:
+	
+	inline treehugepages_t() :
+		treealigned_t(TREE_HUGE_PAGE) {}
+		
+	inline void* allocate(const size_t size);
+	
+};
+
+/// <summary>
+/// Hands out memory from large chunks by moving a pointer forward, so that the buffers of many trees sit next to each other and are freed at once.
+/// Blocks are never given back one at a time, so a tree that grows leaves its old buffers in the arena until it is reset.
+/// Allocating is safe from several threads at once.
+/// </summary>
+class treearena_t : public treeallocator_t
+{
+public:
+	
+	/// <param name="chunk">The size of the chunks that the arena allocates from the heap in bytes.</param>
+	inline treearena_t(const size_t chunk = TREE_HUGE_PAGE * 8) :
+		_chunks(0),
+		_next(0),
+		_end(0),
+		_chunk(chunk),
+		_used(0) {}
+	inline ~treearena_t() { this->reset(); }
+	
+	inline void* allocate(const size_t size);
+	inline void release(void* memory, const size_t size) {}
+	
+	/// <summary>
+	/// Frees every chunk, which takes the memory from every tree buffer that still uses the arena.
+	/// </summary>
+	inline void reset();
+	
+	/// <summary>
+	/// Gets the number of bytes that were handed out since the arena was created or reset.
+	/// </summary>
+	inline size_t used() const { return this->_used; }
+	
+protected:
+	
+	struct chunk_t
+	{
+		chunk_t* _next;
+	};
+	
+	std::mutex _lock;
+	chunk_t* _chunks;
+	unsigned char* _next;
+	unsigned char* _end;
+	size_t _chunk;
+	size_t _used;
+	
+};
+
+#include "treememory.inl"
+
+template <typename T, uint32_t Stride> class treereference_t;
 
 /// <summary>
 /// Contains methods and properties for allocating and indexing a tree buffer.
+/// A non-zero Stride fixes the number of child nodes for each parent at compile-time.
 /// </summary>
-template <typename T> class treealloc_t
+template <typename T, uint32_t Stride = tree_stride_t<T>::value> class treealloc_t
 {
 public:
 	
+	friend class treereference_t<T, Stride>;
+	
 	inline treealloc_t() :
 		_buffer(0),
-		_bytes(0),
+		_layout(0),
+		_veb(0),
+		_image(0),
+		_length(0),
+		_allocator(0),
+		_capacity(0),
 		_rings(0),
-		_stride(1) {}
+		_stride(Stride > 0 ? Stride : 1),
+		_storage(TREE_STORAGE_CONTIGUOUS),
+		_count(0) { memset(this->_segments, 0, sizeof(this->_segments)); memset(this->_occupancy, 0, sizeof(this->_occupancy)); memset(this->_pages, 0, sizeof(this->_pages)); }
 	/// <param name="rings">The number of rings that make up the tree.</param>
 	/// <param name="stride">The number of child nodes for each parent.</param>
-	inline treealloc_t(const uint32_t rings, const uint32_t stride) :
+	/// <param name="storage">How the rings are laid out in memory.</param>
+	/// <param name="allocator">The policy that the tree buffer gets its memory from, or null for calloc and free.</param>
+	inline treealloc_t(const uint32_t rings, const uint32_t stride, const treestorage_t storage = TREE_STORAGE_CONTIGUOUS, treeallocator_t* allocator = 0) :
 		_buffer(0),
-		_bytes(0),
+		_layout(0),
+		_veb(0),
+		_image(0),
+		_length(0),
+		_allocator(allocator),
+		_capacity(0),
 		_rings(rings),
-		_stride(max(stride, 1)) {}
+		_stride(Stride > 0 ? Stride : max(stride, 1)),
+		_storage(storage),
+		_count(0) { memset(this->_segments, 0, sizeof(this->_segments)); memset(this->_occupancy, 0, sizeof(this->_occupancy)); memset(this->_pages, 0, sizeof(this->_pages)); }
 	inline ~treealloc_t() {}
 	
 	/// <summary>
 	/// Allocates creates or re-allocates a the tree buffer.
 	/// </summary>
-	/// <param name="rings">The number of rings that make up the tree.</param>
+	/// <param name="rings">The number of rings that make up the tree, which is clamped to tree_max_rings().</param>
 	/// <param name="stride">The number of child nodes for each parent.</param>
-	inline void alloc(const uint32_t rings, const uint32_t stride);
+	/// <returns>A value indicating whether or not the tree buffer was allocated, the tree is left as it was when it was not.</returns>
+	inline bool alloc(const uint32_t rings, const uint32_t stride);
 	/// <summary>
 	/// Ensures that the tree buffer has atleast the specified number of rings and stride.
 	/// </summary>
-	/// <param name="rings">The number of rings that make up the tree.</param>
+	/// <param name="rings">The number of rings that make up the tree, which is clamped to tree_max_rings().</param>
 	/// <param name="stride">The number of child nodes for each parent.</param>
-	inline void ensure(const uint32_t rings, const uint32_t stride);
+	/// <returns>A value indicating whether or not the tree buffer has the rings, the tree is left as it was when it could not grow.</returns>
+	inline bool ensure(const uint32_t rings, const uint32_t stride);
 	
 	/// <summary>
 	/// Frees the tree buffer.
 	/// </summary>
 	inline void clear();
 	/// <summary>
-	/// Sets the entire tree buffer to null.
+	/// Sets the entire tree buffer to null, and marks every element as unused.
 	/// </summary>
 	inline void zero();
+	/// <summary>
+	/// Replaces this tree buffer with a copy of another one, with the same storage, rings and used elements.
+	/// Elements are copied bit for bit, as they are when a contiguous buffer grows.
+	/// </summary>
+	/// <param name="other">The tree buffer to copy.</param>
+	/// <returns>A value indicating whether or not the copy was allocated, the tree buffer is left empty when it was not.</returns>
+	inline bool copy(const treealloc_t<T, Stride>& other);
+	/// <summary>
+	/// Replaces this tree buffer with a level-order array of elements, allocating every ring in one go and copying the elements in bit for bit,
+	/// so the elements must be trivially copyable when the array is given.
+	/// </summary>
+	/// <param name="elements">The elements in level order, element n goes to index n, or null to only mark the elements as used.</param>
+	/// <param name="count">The number of elements in the array.</param>
+	/// <param name="mask">A bitmap where bit n of word n / 64 is set when element n is used, or null when every element is used. The parent of a used element has to be used.</param>
+	/// <returns>A value indicating whether or not the elements were allocated, the tree buffer is left empty when they were not.</returns>
+	inline bool assign(const T* elements, const size_t count, const uint64_t* mask);
+	/// <summary>
+	/// Writes the tree buffer to an image file, with the rings laid out contiguously whatever the storage.
+	/// Elements are written bit for bit, so they must not hold pointers.
+	/// </summary>
+	/// <param name="path">The path of the file to write.</param>
+	/// <returns>A value indicating whether or not the whole image was written.</returns>
+	inline bool save(const char* path) const;
+	/// <summary>
+	/// Replaces this tree buffer with an image file written by save(), mapped into memory so that pages of elements are only read when they are touched.
+	/// The occupancy bitmaps are read once to check them against the count in the header, and an image whose offsets, rings or count don't fit is rejected.
+	/// The tree buffer uses contiguous storage afterwards. Changes are private to this tree buffer and are never written back to the file,
+	/// and the image is copied into heap memory the first time the tree buffer grows.
+	/// </summary>
+	/// <param name="path">The path of the file to map.</param>
+	/// <returns>A value indicating whether or not the image was mapped, the tree buffer is left empty when it was not.</returns>
+	inline bool map(const char* path);
+	/// <summary>
+	/// Gets a value indicating whether or not the tree buffer is mapped from an image file.
+	/// </summary>
+	inline bool mapped() const { return this->_image != 0; }
+	/// <summary>
+	/// Writes the used elements of the tree buffer to a stream, a block at a time, so the stream grows with the number of used elements rather than the capacity.
+	/// Elements are written bit for bit, so they must not hold pointers.
+	/// </summary>
+	/// <param name="sink">A callable that takes a pointer to bytes and a number of bytes, and returns false when it could not write them.</param>
+	/// <returns>A value indicating whether or not the whole stream was written.</returns>
+	template <typename W> inline bool write(W sink) const;
+	/// <summary>
+	/// Replaces this tree buffer with the elements of a stream written by write(), keeping this tree buffer's storage.
+	/// Each ring is allocated when its first record arrives, and blocks whose elements are all used are read straight into the tree buffer.
+	/// </summary>
+	/// <param name="source">A callable that takes a pointer to bytes and a number of bytes to read into it, and returns false when it could not read them.</param>
+	/// <returns>A value indicating whether or not the stream was read, the tree buffer is left empty when it was not.</returns>
+	template <typename R> inline bool read(R source);
 	
 	/// <summary>
-	/// Remove the entire node chain starting at the given root.
+	/// Remove the entire node chain starting at the given root, and marks every element in it as unused.
 	/// </summary>
 	/// <param name="index">The index of the root node to delete.</param>
 	inline void remove(const size_t index);
 	
+	/// <summary>
+	/// Marks an element as used, growing the tree buffer if needed.
+	/// </summary>
+	/// <param name="index">The index of the element.</param>
+	/// <returns>A value indicating whether or not the element is used, which it is not when the tree buffer could not grow to it.</returns>
+	inline bool occupy(const size_t index);
+	/// <summary>
+	/// Marks an element as used if no other thread has, which is safe to call from several threads at once.
+	/// The buffer is never grown, so the rings have to be allocated up front, while sparse pages are still allocated as they are touched.
+	/// </summary>
+	/// <param name="index">The index of the element.</param>
+	/// <returns>The element for the caller to fill in, or null when it was already used, is past the capacity or its page could not be allocated.</returns>
+	inline T* claim(const size_t index);
+	/// <summary>
+	/// Gets a value indicating whether or not an element is marked as used.
+	/// </summary>
+	/// <param name="index">The index of the element.</param>
+	inline bool occupied(const size_t index) const;
+	/// <summary>
+	/// Gets a value indicating whether or not an element is marked as used, without working out its ring from an index.
+	/// </summary>
+	/// <param name="ring">The ring of the element.</param>
+	/// <param name="branch">The index inside of the ring for the element.</param>
+	inline bool occupied(const uint32_t ring, const size_t branch) const;
+	/// <summary>
+	/// Finds the first used element at or after the given index.
+	/// </summary>
+	/// <param name="index">The index to start looking at.</param>
+	/// <returns>The index of the used element, or the capacity when there are none left.</returns>
+	inline size_t next(const size_t index) const;
+	/// <summary>
+	/// Gets the number of elements that are marked as used.
+	/// </summary>
+	inline size_t count() const { return this->_count; }
+	/// <summary>
+	/// Gets the number of elements that are marked as used in the node chain starting at the given root.
+	/// </summary>
+	/// <param name="index">The index of the root node to count from.</param>
+	inline size_t count(const size_t index) const;
+	/// <summary>
+	/// Gets the occupancy bitmap of a ring, bit n of word n / 64 is set when the ring's element n is used.
+	/// Sparse tree buffers have no bitmap for a whole ring, use block() instead.
+	/// </summary>
+	/// <param name="ring">The index of an allocated tree ring.</param>
+	inline const uint64_t* occupancy(const uint32_t ring) const { return ring < TREE_MAX_RINGS ? this->_occupancy[ring] : 0; }
+	
+	/// <summary>
+	/// Gets a block of 64 consecutive elements of a ring, along with the occupancy word that covers them.
+	/// </summary>
+	/// <param name="ring">The index of an allocated tree ring.</param>
+	/// <param name="block">The number of the block inside of the ring, element n of the ring is in block n / 64.</param>
+	/// <param name="elements">Receives the first element of the block, or null when the ring is not contiguous in the van Emde Boas layout.</param>
+	/// <returns>The occupancy word of the block, or null when the block of a sparse tree buffer was never written.</returns>
+	inline uint64_t* block(const uint32_t ring, const size_t block, T** elements) const;
+	/// <summary>
+	/// Gets an element by its ring and branch, in any layout.
+	/// </summary>
+	/// <param name="ring">The index of an allocated tree ring.</param>
+	/// <param name="branch">The index of the element inside of the ring.</param>
+	/// <returns>The element, or null when its block of a sparse tree buffer was never written.</returns>
+	inline T* locate(const uint32_t ring, const size_t branch) const;
+	/// <summary>
+	/// Copies the used elements of a block into a contiguous array, for blocks that block() does not give elements for.
+	/// </summary>
+	/// <param name="ring">The index of an allocated tree ring.</param>
+	/// <param name="block">The number of the block inside of the ring.</param>
+	/// <param name="elements">An array of 64 elements that receives the used elements at their place in the block.</param>
+	inline void gather(const uint32_t ring, const size_t block, T* elements) const;
+	/// <summary>
+	/// Finds the first block at or after the given one that has storage, which is every block unless the tree buffer is sparse.
+	/// </summary>
+	/// <param name="ring">The index of an allocated tree ring.</param>
+	/// <param name="block">The number of the block to start looking at.</param>
+	/// <returns>The number of the block, or the number of blocks in the ring when there are none left.</returns>
+	inline size_t next_block(const uint32_t ring, const size_t block) const;
+	/// <summary>
+	/// Calls a function for every used element of a range of rings, in the order of the tree buffer.
+	/// The rings are streamed a block at a time and unused elements are skipped with the occupancy words.
+	/// </summary>
+	/// <param name="first">The first ring to visit.</param>
+	/// <param name="last">The ring after the last ring to visit.</param>
+	/// <param name="function">A callable that takes a reference to an element.</param>
+	template <typename F> inline void sweep(const uint32_t first, const uint32_t last, F function);
+	/// <summary>
+	/// Calls a function for every used element reachable from the root, parents before children.
+	/// Children are visited from the last to the first for a stride of two, so that left comes before right, and from the first to the last otherwise.
+	/// </summary>
+	/// <param name="function">A callable that takes a reference to an element, a zero return value will exit.</param>
+	template <typename F> inline void descend(F function) { this->descend(0, 0, TREE_MAX_RINGS, function); }
+	/// <summary>
+	/// Calls a function for every used element of a subtree, parents before children, stopping above the given ring.
+	/// </summary>
+	/// <param name="ring">The ring of the subtree's root.</param>
+	/// <param name="branch">The branch of the subtree's root.</param>
+	/// <param name="last">The ring after the last ring to visit.</param>
+	/// <param name="function">A callable that takes a reference to an element, a zero return value will exit.</param>
+	template <typename F> inline void descend(const uint32_t ring, const size_t branch, const uint32_t last, F function);
+	/// <summary>
+	/// Follows a batch of independent paths down from the root, keeping a group of them in flight at once.
+	/// Each path prefetches its next element as soon as it knows where it goes, so the cache misses of the group overlap.
+	/// </summary>
+	/// <param name="count">The number of paths, which are numbered from zero.</param>
+	/// <param name="function">A callable that takes the number of a path and a reference to its current element, and returns the child to go to next, or a negative value to end the path.</param>
+	template <typename F> inline void paths(const size_t count, F function);
+	
 	/// <summary>
 	/// Gets the total capacity of the tree buffer.
 	/// </summary>
-	inline size_t capacity() const { return this->_bytes / sizeof(T); }
+	inline size_t capacity() const { return this->_capacity; }
+	/// <summary>
+	/// Gets the number of rings that the tree buffer holds.
+	/// </summary>
+	inline uint32_t rings() const { return this->_rings; }
+	/// <summary>
+	/// Gets the number of child nodes for each parent.
+	/// </summary>
+	inline uint32_t stride() const { return Stride > 0 ? Stride : this->_stride; }
+	/// <summary>
+	/// Gets how the rings are laid out in memory.
+	/// </summary>
+	inline treestorage_t storage() const { return this->_storage; }
+	/// <summary>
+	/// Gets the policy that the tree buffer gets its memory from, or null when it uses calloc and free.
+	/// </summary>
+	inline treeallocator_t* allocator() const { return this->_allocator; }
+	
+	/// <summary>
+	/// Gets the first element of a ring, the ring's elements are contiguous in memory.
+	/// Sparse and van Emde Boas tree buffers do not keep a ring together and give null, use block() instead.
+	/// </summary>
+	/// <param name="ring">The index of an allocated tree ring.</param>
+	inline T* ring(const uint32_t ring) const;
+	
+	/// <summary>
+	/// Calculates the index of a node's parent.
+	/// </summary>
+	/// <param name="index">The index of a node that is not the root.</param>
+	inline size_t parent(const size_t index) const { return tree_parent_index(index, this->stride()); }
+	/// <summary>
+	/// Calculates the index of one of a node's children.
+	/// </summary>
+	/// <param name="index">The index of the parent node.</param>
+	/// <param name="child">The number of the child, less than the stride.</param>
+	inline size_t child(const size_t index, const uint32_t child) const { return tree_child_index(index, child, this->stride()); }
 	
 	/// <summary>
-	/// Indexes into the tree buffer for an element.
+	/// Indexes into the tree buffer for an element, which does not grow the tree buffer, so the index has to be less than the capacity.
 	/// </summary>
 	inline T& operator[](const size_t index);
 	
 protected:
 	
+	inline T* element(const size_t index);
+	inline size_t range(const uint32_t ring, const size_t first, const size_t last, const bool clear) const;
+	inline treepage_t<T>* page(const uint32_t ring, const size_t block) const;
+	inline treepage_t<T>* touch(const uint32_t ring, const size_t block);
+	inline void prefetch(const uint32_t ring, const size_t branch) const;
+	inline bool detach();
+	inline void* allocate(const size_t count, const size_t size);
+	inline void deallocate(void* memory, const size_t count, const size_t size);
+	inline size_t release(void* node, const uint32_t level);
+	
+	static uint32_t levels(const size_t length);
+	static size_t seek(const void* node, const uint32_t level, const size_t block);
+	static void unmap(void* image, const size_t length);
+	
 	T* _buffer;
-	size_t _bytes;
+	T* _segments[TREE_MAX_RINGS];
+	uint64_t* _occupancy[TREE_MAX_RINGS];
+	void* _pages[TREE_MAX_RINGS];
+	uint64_t* _layout;
+	treeveb_t* _veb;
+	void* _image;
+	size_t _length;
+	treeallocator_t* _allocator;
+	size_t _capacity;
 	uint32_t _rings;
 	uint32_t _stride;
+	treestorage_t _storage;
+	size_t _count;
 	
 };
 
 /// <summary>
 /// Contains methods and properties for refrencing an element in a treealloc_t instance.
 /// </summary>
-template <typename T> class treereference_t
+template <typename T, uint32_t Stride = tree_stride_t<T>::value> class treereference_t
 {
 public:
 	
@@ -132,74 +744,422 @@ public:
 		_index(-1),
 		_registry(0) {}
 	/// <param name="registry">An instance of treealloc_t to reference.</param>
-	inline treereference_t(const treealloc_t<T>& registry) :
+	inline treereference_t(const treealloc_t<T, Stride>& registry) :
 		_index(-1),
-		_registry((treealloc_t<T>*)&registry) {}
+		_registry((treealloc_t<T, Stride>*)&registry) {}
 	/// <param name="registry">An instance of treealloc_t to reference.</param>
 	/// <param name="index">The index to reference.</param>
-	inline treereference_t(const treealloc_t<T>& registry, const uint32_t index) :
+	inline treereference_t(const treealloc_t<T, Stride>& registry, const size_t index) :
 		_index(index),
-		_registry((treealloc_t<T>*)&registry) {}
+		_registry((treealloc_t<T, Stride>*)&registry) {}
 	inline ~treereference_t() {}
 	
 	/// <summary>
-	/// Gets a value indicating whether or not the reference is empty.
+	/// Gets a value indicating whether or not the reference is empty, or points past the allocated tree buffer.
 	/// </summary>
 	inline bool empty() const;
+	/// <summary>
+	/// Gets the referenced index.
+	/// </summary>
+	inline size_t index() const { return (size_t)this->_index; }
+	/// <summary>
+	/// Gets a value indicating whether or not the referenced element is marked as used.
+	/// </summary>
+	inline bool occupied() const { return !this->empty() && this->_registry->occupied(this->index()); }
+	/// <summary>
+	/// Gets the referenced treealloc_t instance.
+	/// </summary>
+	inline treealloc_t<T, Stride>* registry() const { return this->_registry; }
+	/// <summary>
+	/// Gets the ring that the referenced index exists in.
+	/// </summary>
+	inline uint32_t ring() const { return tree_ring_by_index(this->index(), Stride > 0 ? Stride : this->_registry->stride()); }
+	/// <summary>
+	/// Gets the index inside of the ring for the referenced index.
+	/// </summary>
+	inline size_t branch() const { return tree_branch_by_index(this->index(), Stride > 0 ? Stride : this->_registry->stride()); }
 	
 	/// <summary>
 	/// Sets the reference to the specified index.
 	/// </summary>
 	/// <param name="index">An index to reference.</param>
-	inline treereference_t<T>& operator=(const int32_t index);
+	inline treereference_t<T, Stride>& operator=(const int64_t index);
 	/// <summary>
 	/// Sets this instance to be equal to that instance.
 	/// </summary>
 	/// <param name="other">An instance of treereference_t.</param>
-	inline treereference_t<T>& operator=(const treereference_t<T>& other);
+	inline treereference_t<T, Stride>& operator=(const treereference_t<T, Stride>& other);
 	/// <summary>
-	/// Accesses the referenced element.
+	/// Accesses the referenced element, which has to be within the tree buffer.
 	/// </summary>
 	inline T& operator*() const;
 	/// <summary>
-	/// Accesses a member from the referenced element.
+	/// Accesses a member from the referenced element, or gets null when the reference is empty or its sparse page could not be allocated.
 	/// </summary>
 	inline T* operator->() const;
 	/// <summary>
-	/// Converts this instance into a point to the referenced element.
+	/// Converts this instance into a point to the referenced element, or null when the reference is empty or its sparse page could not be allocated.
 	/// </summary>
 	inline operator T*() const;
 	
 protected:
 	
-	int32_t _index;
-	treealloc_t<T>* _registry;
+	int64_t _index;
+	treealloc_t<T, Stride>* _registry;
 	
 };
 
 #include "treealloc.inl"
 
-template <typename T> struct binarynode_t;
-template <typename T> struct binaryiterator_t;
-template <typename T> class binarytree_t;
-
 /// <summary>
-/// Contains methods and properties for a node in a binary tree.
+/// Contains the payload of a node in a tree that derives its links, ring and branch from the node's index.
+/// Use it as the Node parameter of binarytree_t or quadtree_t to store the payloads as a plain array of T,
+/// with the occupancy kept apart in the registry's bitmaps.
 /// </summary>
-template <typename T> struct binarynode_t
+template <typename T> struct compactnode_t
 {
 	
-	inline binarynode_t() :
-		_tree(0),
-		_ring(-1),
-		_branch(-1) {}
-	/// <param name="tree">Pointer to the node's tree.</param>
-	/// <param name="ring">The ring that the node exists in.</param>
-	/// <param name="branch">The index inside of the ring for the node.</param>
+	inline compactnode_t() {}
+	/// <param name="tree">The node's tree, which is not stored.</param>
+	/// <param name="ring">The ring that the node exists in, which is not stored.</param>
+	/// <param name="branch">The index inside of the ring for the node, which is not stored.</param>
 	/// <param name="data">The data that the node holds.</param>
-	inline binarynode_t(const binarytree_t<T>& tree, const int32_t ring, const int32_t branch, const T& data) :
-		_left(tree._registry),
-		_right(tree._registry),
+	template <typename Tree> inline compactnode_t(const Tree& tree, const int32_t ring, const int32_t branch, const T& data) :
+		_data(data) {}
+	inline ~compactnode_t() {}
+	
+	/// <summary>
+	/// Creates a node for the same tree as this node.
+	/// </summary>
+	/// <param name="ring">The ring that the new node exists in.</param>
+	/// <param name="branch">The index inside of the ring for the new node.</param>
+	/// <param name="data">The data that the new node holds.</param>
+	inline compactnode_t<T> spawn(const int32_t ring, const int32_t branch, const T& data) const { return compactnode_t<T>(*this, ring, branch, data); }
+	/// <summary>
+	/// Links this node to its parent, compact nodes have no links to keep.
+	/// </summary>
+	template <typename R> inline void link(const R& up, const uint32_t child, const R& self) {}
+	/// <summary>
+	/// Unlinks this node from its parent, compact nodes have no links to keep.
+	/// </summary>
+	template <typename R> inline void unlink(const R& up, const R& self) {}
+	
+	T _data;
+	
+};
+
+/// <summary>
+/// Compares 64 consecutive 32 bit values against an item, using AVX2 or SSE2 when the processor has them.
+/// </summary>
+/// <param name="values">The 64 values to compare, which do not need to be aligned.</param>
+/// <param name="item">The item to compare with.</param>
+/// <returns>A mask where bit n is set when value n is equal to the item.</returns>
+inline uint64_t tree_match64_32(const void* values, const uint32_t item);
+
+/// <summary>
+/// Compares 64 consecutive 64 bit values against an item, using AVX2 or SSE2 when the processor has them.
+/// </summary>
+/// <param name="values">The 64 values to compare, which do not need to be aligned.</param>
+/// <param name="item">The item to compare with.</param>
+/// <returns>A mask where bit n is set when value n is equal to the item.</returns>
+inline uint64_t tree_match64_64(const void* values, const uint64_t item);
+
+/// <summary>
+/// Compares the payloads of up to 64 consecutive nodes against an item, byte for byte.
+/// Nodes that only hold a 4 or 8 byte payload, such as compactnode_t of an arithmetic type, are compared 64 at a time.
+/// </summary>
+template <typename T, typename Node, size_t Bytes = (sizeof(Node) == sizeof(T) ? sizeof(T) : 0)> struct tree_match_t
+{
+	
+	/// <param name="nodes">The first of the nodes to compare.</param>
+	/// <param name="item">The item to compare with.</param>
+	/// <param name="mask">The nodes to compare, bit n stands for node n.</param>
+	/// <param name="count">The number of nodes that can be read, at most 64.</param>
+	/// <returns>The bits of the mask whose node holds the item.</returns>
+	static inline uint64_t match(const Node* nodes, const T& item, const uint64_t mask, const size_t count);
+	
+};
+
+/// <summary>
+/// Searches a registry of nodes for the first used node at or after an index that holds the given item.
+/// </summary>
+/// <param name="registry">The registry to search.</param>
+/// <param name="item">An item to search for.</param>
+/// <param name="index">The index to start searching at.</param>
+/// <returns>The index of the node that was found, or the registry's capacity when there is none.</returns>
+template <typename T, typename Node, uint32_t Stride> inline size_t tree_search(const treealloc_t<Node, Stride>& registry, const T& item, const size_t index);
+
+#include "treesearch.inl"
+
+/// <summary>
+/// Describes the order that a treewalker_t instance visits the nodes of a tree in.
+/// Children are visited left before right in a binary tree, and by the number of their quadrant in a quadratic tree.
+/// </summary>
+enum treeorder_t
+{
+	/// <summary>
+	/// Every node is visited before its children.
+	/// </summary>
+	TREE_ORDER_PRE = 0,
+	/// <summary>
+	/// Every node is visited after its left subtree and before its right subtree, only for binary trees.
+	/// </summary>
+	TREE_ORDER_IN = 1,
+	/// <summary>
+	/// Every node is visited after its children.
+	/// </summary>
+	TREE_ORDER_POST = 2,
+	/// <summary>
+	/// Every node is visited ring by ring, which is the order of the tree buffer.
+	/// </summary>
+	TREE_ORDER_LEVEL = 3,
+};
+
+/// <summary>
+/// Contains methods and properties for a forward iterator that walks every node of a tree in the given order.
+/// The walk needs no stack or recursion, the next node is found with the index arithmetic and the occupancy of the tree buffer.
+/// </summary>
+template <typename T, typename Node, uint32_t Stride, treeorder_t Order> struct treewalker_t
+{
+	
+	typedef std::forward_iterator_tag iterator_category;
+	typedef T value_type;
+	typedef ptrdiff_t difference_type;
+	typedef T* pointer;
+	typedef T& reference;
+	
+	inline treewalker_t() :
+		_registry(0),
+		_index(SIZE_MAX) {}
+	/// <param name="registry">The tree buffer to walk.</param>
+	/// <param name="index">The index of the current node, or SIZE_MAX when the walk is done.</param>
+	inline treewalker_t(treealloc_t<Node, Stride>& registry, const size_t index) :
+		_registry(&registry),
+		_index(index) {}
+	inline ~treewalker_t() {}
+	
+	/// <summary>
+	/// Creates a walker at the first node of a tree buffer in the walker's order.
+	/// </summary>
+	/// <param name="registry">The tree buffer to walk.</param>
+	static inline treewalker_t<T, Node, Stride, Order> first(treealloc_t<Node, Stride>& registry);
+	
+	/// <summary>
+	/// Gets a reference to the current node.
+	/// </summary>
+	inline treereference_t<Node, Stride> node() const { return treereference_t<Node, Stride>(*(this->_registry), this->_index); }
+	/// <summary>
+	/// Gets the index of the current node.
+	/// </summary>
+	inline size_t index() const { return this->_index; }
+	
+	/// <summary>
+	/// Gets the held item for the current node.
+	/// </summary>
+	inline T& operator*() const { return (*(this->_registry))[this->_index]._data; }
+	/// <summary>
+	/// Gets a pointer to the held item for the current node.
+	/// </summary>
+	inline T* operator->() const { return &((*(this->_registry))[this->_index]._data); }
+	/// <summary>
+	/// Walks to the next node.
+	/// </summary>
+	inline treewalker_t<T, Node, Stride, Order>& operator++() { this->_index = this->advance(this->_index); return *this; }
+	/// <summary>
+	/// Walks to the next node, and gives back a walker at the node before it.
+	/// </summary>
+	inline treewalker_t<T, Node, Stride, Order> operator++(int) { treewalker_t<T, Node, Stride, Order> previous = *this; ++(*this); return previous; }
+	/// <summary>
+	/// Determines whether this walker is at the same node as the other walker.
+	/// </summary>
+	/// <param name="other">An instance of treewalker_t.</param>
+	inline bool operator==(const treewalker_t<T, Node, Stride, Order>& other) const { return this->_index == other._index; }
+	/// <summary>
+	/// Determines whether this walker is not at the same node as the other walker.
+	/// </summary>
+	/// <param name="other">An instance of treewalker_t.</param>
+	inline bool operator!=(const treewalker_t<T, Node, Stride, Order>& other) const { return this->_index != other._index; }
+	
+protected:
+	
+	inline size_t advance(const size_t index) const;
+	inline size_t descend(const size_t index) const;
+	inline size_t sibling(const size_t index) const;
+	inline uint32_t visit(const uint32_t order) const { return this->_registry->stride() == 2 ? 1 - order : order; }
+	
+	treealloc_t<Node, Stride>* _registry;
+	size_t _index;
+	
+};
+
+/// <summary>
+/// Contains the nodes of a tree in a given order, so they can be walked with a range based for loop.
+/// </summary>
+template <typename T, typename Node, uint32_t Stride, treeorder_t Order> struct treerange_t
+{
+	
+	typedef treewalker_t<T, Node, Stride, Order> iterator;
+	
+	/// <param name="registry">The tree buffer to walk.</param>
+	inline treerange_t(treealloc_t<Node, Stride>& registry) :
+		_registry(&registry) {}
+	inline ~treerange_t() {}
+	
+	/// <summary>
+	/// Gets a walker at the first node.
+	/// </summary>
+	inline iterator begin() const { return iterator::first(*(this->_registry)); }
+	/// <summary>
+	/// Gets a walker past the last node.
+	/// </summary>
+	inline iterator end() const { return iterator(*(this->_registry), SIZE_MAX); }
+	
+	treealloc_t<Node, Stride>* _registry;
+	
+};
+
+#include "treewalk.inl"
+
+/// <summary>
+/// Contains a fixed set of worker threads that share the tasks of a run by work-stealing.
+/// The tasks of a run start out split evenly between the workers, and a worker that runs out steals half of what is left in another worker's queue.
+/// </summary>
+class treepool_t
+{
+public:
+	
+	/// <param name="workers">The number of workers including the calling thread, or zero for one per hardware thread.</param>
+	inline treepool_t(const uint32_t workers = 0);
+	inline ~treepool_t();
+	
+	/// <summary>
+	/// Calls a function once for every task in a run, and returns once all of them are done.
+	/// The calling thread works as worker zero, and runs on the same pool are serialized, so a task must not start another run on its pool.
+	/// </summary>
+	/// <param name="count">The number of tasks, which are numbered from zero.</param>
+	/// <param name="function">A callable that takes the number of the worker and the number of the task.</param>
+	template <typename F> inline void run(const size_t count, F function) { this->dispatch(count, &treepool_t::invoke<F>, &function); }
+	
+	/// <summary>
+	/// Gets the number of workers including the calling thread.
+	/// </summary>
+	inline uint32_t workers() const { return this->_workers; }
+	
+	/// <summary>
+	/// Gets a pool with one worker per hardware thread that is shared by the whole process.
+	/// </summary>
+	static inline treepool_t& shared();
+	
+protected:
+	
+	typedef void (*taskfunc)(void* context, const uint32_t worker, const size_t task);
+	
+	struct alignas(64) queue_t
+	{
+		std::mutex _lock;
+		size_t _head;
+		size_t _tail;
+	};
+	
+	template <typename F> static inline void invoke(void* context, const uint32_t worker, const size_t task) { (*(F*)context)(worker, task); }
+	
+	inline void dispatch(const size_t count, taskfunc task, void* context);
+	inline void loop(const uint32_t worker);
+	inline void work(const uint32_t worker, taskfunc task, void* context);
+	inline bool take(const uint32_t worker, size_t* task);
+	
+	uint32_t _workers;
+	std::thread* _threads;
+	queue_t* _queues;
+	std::mutex _run;
+	std::mutex _lock;
+	std::condition_variable _wake;
+	std::condition_variable _done;
+	uint64_t _generation;
+	uint32_t _active;
+	bool _stop;
+	taskfunc _task;
+	void* _context;
+	
+};
+
+/// <summary>
+/// Holds the state of one worker in a parallel traversal, on a cache line of its own.
+/// </summary>
+template <typename S> struct alignas(64) treeslot_t
+{
+	S _value;
+};
+
+/// <summary>
+/// Calls a function for every used node of a tree buffer on a pool, with the subtrees rooted at one ring as the tasks.
+/// </summary>
+/// <param name="registry">The tree buffer to visit.</param>
+/// <param name="initial">The value that every worker's state starts from.</param>
+/// <param name="function">A callable that takes a reference to the worker's state, a reference to a node and a reference to its item.</param>
+/// <param name="combine">A callable that takes a reference to a state and folds a second state into it.</param>
+/// <param name="ring">The ring that the tree is split at, or zero to pick one with several subtrees per worker.</param>
+/// <param name="pool">The pool to run on.</param>
+/// <returns>The state of every worker combined.</returns>
+template <typename Node, uint32_t Stride, typename S, typename F, typename C> inline S tree_parallel_each(treealloc_t<Node, Stride>& registry, const S& initial, F function, C combine, const uint32_t ring, treepool_t& pool);
+
+/// <summary>
+/// Calls a function for every block of 64 nodes that has used nodes, with the tree buffer split into chunks of blocks that are tasks on a pool.
+/// The chunks start on block boundaries, so two workers never share a block of payloads or an occupancy word.
+/// </summary>
+/// <param name="registry">The tree buffer to scan.</param>
+/// <param name="pool">The pool to run on.</param>
+/// <param name="function">A callable that takes the number of the worker, the base index of the block, the block's nodes, its occupancy mask and the number of nodes in it,
+/// and returns false to skip the rest of its chunk.</param>
+template <typename Node, uint32_t Stride, typename F> inline void tree_parallel_blocks(const treealloc_t<Node, Stride>& registry, treepool_t& pool, F function);
+/// <summary>
+/// Searches a tree buffer for an item on a pool, and gives the same node as tree_search from the root.
+/// Chunks past a match that was already found are cancelled.
+/// </summary>
+/// <param name="registry">The tree buffer to search.</param>
+/// <param name="item">An item to search for.</param>
+/// <param name="pool">The pool to run on.</param>
+/// <returns>The lowest index of a node that holds the item, or the capacity of the tree buffer when no node does.</returns>
+template <typename T, typename Node, uint32_t Stride> inline size_t tree_parallel_search(const treealloc_t<Node, Stride>& registry, const T& item, treepool_t& pool);
+/// <summary>
+/// Searches a tree buffer for every node that holds an item on a pool.
+/// </summary>
+/// <param name="registry">The tree buffer to search.</param>
+/// <param name="item">An item to search for.</param>
+/// <param name="pool">The pool to run on.</param>
+/// <param name="results">An array that receives the lowest indices of the nodes that were found in level order, or null to only count them.</param>
+/// <param name="limit">The number of indices that fit in the results.</param>
+/// <returns>The number of nodes that hold the item, which can be more than the limit.</returns>
+template <typename T, typename Node, uint32_t Stride> inline size_t tree_parallel_search_all(const treealloc_t<Node, Stride>& registry, const T& item, treepool_t& pool, size_t* results, const size_t limit);
+
+#include "treepool.inl"
+
+template <typename T> struct binarynode_t;
+template <typename T, typename Node = binarynode_t<T> > struct binaryiterator_t;
+template <typename T, typename Node = binarynode_t<T> > class binarytree_t;
+
+template <typename T> struct tree_stride_t<binarynode_t<T> >
+{
+	static const uint32_t value = 2;
+};
+
+/// <summary>
+/// Contains methods and properties for a node in a binary tree.
+/// </summary>
+template <typename T> struct binarynode_t
+{
+	
+	inline binarynode_t() :
+		_tree(0),
+		_ring(-1),
+		_branch(-1) {}
+	/// <param name="tree">Pointer to the node's tree.</param>
+	/// <param name="ring">The ring that the node exists in.</param>
+	/// <param name="branch">The index inside of the ring for the node.</param>
+	/// <param name="data">The data that the node holds.</param>
+	inline binarynode_t(const binarytree_t<T>& tree, const int32_t ring, const int32_t branch, const T& data) :
+		_left(tree._registry),
+		_right(tree._registry),
 		_up(tree._registry),
 		_tree((binarytree_t<T>*)&tree),
 		_ring(ring),
@@ -217,6 +1177,27 @@ template <typename T> struct binarynode_t
 	/// </summary>
 	inline size_t index() const;
 	
+	/// <summary>
+	/// Creates a node for the same tree as this node.
+	/// </summary>
+	/// <param name="ring">The ring that the new node exists in.</param>
+	/// <param name="branch">The index inside of the ring for the new node.</param>
+	/// <param name="data">The data that the new node holds.</param>
+	inline binarynode_t<T> spawn(const int32_t ring, const int32_t branch, const T& data) const { return binarynode_t<T>(*(this->_tree), ring, branch, data); }
+	/// <summary>
+	/// Links this node to its parent.
+	/// </summary>
+	/// <param name="up">The parent node.</param>
+	/// <param name="child">The number of the child that this node is, one for left and zero for right.</param>
+	/// <param name="self">This node.</param>
+	inline void link(const treereference_t<binarynode_t<T> >& up, const uint32_t child, const treereference_t<binarynode_t<T> >& self);
+	/// <summary>
+	/// Unlinks this node from its parent.
+	/// </summary>
+	/// <param name="up">The parent node.</param>
+	/// <param name="self">This node.</param>
+	inline void unlink(const treereference_t<binarynode_t<T> >& up, const treereference_t<binarynode_t<T> >& self);
+	
 	treereference_t<binarynode_t<T> > _left;
 	treereference_t<binarynode_t<T> > _right;
 	treereference_t<binarynode_t<T> > _up;
@@ -230,12 +1211,12 @@ template <typename T> struct binarynode_t
 /// <summary>
 /// Contains methods and properties for iterating through a binary tree.
 /// </summary>
-template <typename T> struct binaryiterator_t
+template <typename T, typename Node> struct binaryiterator_t
 {
 	
 	inline binaryiterator_t() {}
 	/// <param name="node">The current node for the iterator.</param>
-	inline binaryiterator_t(const treereference_t<binarynode_t<T> >& node) :
+	inline binaryiterator_t(const treereference_t<Node, 2>& node) :
 		_node(node) {}
 	inline ~binaryiterator_t() {}
 	
@@ -243,161 +1224,557 @@ template <typename T> struct binaryiterator_t
 	/// Iterate to the left child node.
 	/// </summary>
 	/// <returns>A new iterator at the next position.</returns>
-	inline binaryiterator_t<T> left() const;
+	inline binaryiterator_t<T, Node> left() const;
 	/// <summary>
 	/// Set the left child node with the given item, and then iterate to that node.
 	/// </summary>
 	/// <param name="item">The item to put in the new node.</param>
-	/// <returns>A new iterator at the next position.</returns>
-	inline binaryiterator_t<T> left(const T& item);
+	/// <returns>A new iterator at the next position, or an empty iterator when the tree buffer could not grow.</returns>
+	inline binaryiterator_t<T, Node> left(const T& item);
 	/// <summary>
 	/// Iterate to the right child node.
 	/// </summary>
 	/// <returns>A new iterator at the next position.</returns>
-	inline binaryiterator_t<T> right() const;
+	inline binaryiterator_t<T, Node> right() const;
+	/// <summary>
+	/// Set the right child node with the given item, and then iterate to that node.
+	/// </summary>
+	/// <param name="item">The item to put in the new node.</param>
+	/// <returns>A new iterator at the next position, or an empty iterator when the tree buffer could not grow.</returns>
+	inline binaryiterator_t<T, Node> right(const T& item);
+	/// <summary>
+	/// Set the left child node with the given item if it is unused, which is safe to call from several threads at once, and then iterate to that node.
+	/// The tree buffer is not grown, see binarytree_t::reserve, and this node has to be fully inserted before a child is claimed.
+	/// </summary>
+	/// <param name="item">The item to put in the new node.</param>
+	/// <returns>A new iterator at the next position, or an empty iterator when another thread claimed the node first or it is past the capacity.</returns>
+	inline binaryiterator_t<T, Node> claim_left(const T& item);
+	/// <summary>
+	/// Set the right child node with the given item if it is unused, which is safe to call from several threads at once, and then iterate to that node.
+	/// The tree buffer is not grown, see binarytree_t::reserve, and this node has to be fully inserted before a child is claimed.
+	/// </summary>
+	/// <param name="item">The item to put in the new node.</param>
+	/// <returns>A new iterator at the next position, or an empty iterator when another thread claimed the node first or it is past the capacity.</returns>
+	inline binaryiterator_t<T, Node> claim_right(const T& item);
+	/// <summary>
+	/// Iterate to the parent node.
+	/// </summary>
+	/// <returns>A new iterator at the next position.</returns>
+	inline binaryiterator_t<T, Node> parent();
+	
+	/// <summary>
+	/// Remove the node where the iterator is, and then iterate to the parent node.
+	/// </summary>
+	/// <returns>A new iterator at the next position.</returns>
+	inline binaryiterator_t<T, Node> remove();
+	
+	/// <summary>
+	/// Gets a value indicating whether or not the node has a left child.
+	/// </summary>
+	inline bool has_left() const;
+	/// <summary>
+	/// Gets a value indicating whether or not the node has a right child.
+	/// </summary>
+	inline bool has_right() const;
+	/// <summary>
+	/// Gets a value indicating whether or not the node is a root node.
+	/// </summary>
+	inline bool root() const;
+	/// <summary>
+	/// Gets a value indicating whether or not the node has any children.
+	/// </summary>
+	inline bool leaf() const;
+	
+	/// <summary>
+	/// Gets a value indicating whether or not the iterator has a node.
+	/// </summary>
+	inline bool empty() const;
+	
+	/// <summary>
+	/// Iterate to the left child node.
+	/// </summary>
+	inline binaryiterator_t<T, Node>& operator++();
+	/// <summary>
+	/// Iterate to the right child node.
+	/// </summary>
+	inline binaryiterator_t<T, Node>& operator--();
+	/// <summary>
+	/// Gets the held item for the current node.
+	/// </summary>
+	inline T& operator*() const;
+	/// <summary>
+	/// Determines whether this iterator is at the same location than the other iterator.
+	/// </summary>
+	/// <param name="other">An instance of binaryiterator_t.</param>
+	inline bool operator==(const binaryiterator_t<T, Node>& other) const;
+	/// <summary>
+	/// Determines whether this iterator is not at the same location than the other iterator.
+	/// </summary>
+	/// <param name="other">An instance of binaryiterator_t.</param>
+	inline bool operator!=(const binaryiterator_t<T, Node>& other) const;
+	
+	treereference_t<Node, 2> _node;
+	
+};
+
+/// <summary>
+/// Contains methods and properties for a binary tree.
+/// The Node parameter selects the node layout, binarynode_t keeps explicit links while compactnode_t only keeps the payload.
+/// </summary>
+template <typename T, typename Node> class binarytree_t
+{
+public:
+	
+	typedef binaryiterator_t<T, Node> iterator;
+	typedef treereference_t<Node, 2> reference;
+	
+	typedef int32_t (*iterationfunc)(const treereference_t<Node, 2>& node, const T& item);
+	
+	friend struct binarynode_t<T>;
+	friend struct binaryiterator_t<T, Node>;
+	
+	inline binarytree_t() :
+		_registry(3, 2) {}
+	/// <param name="rings">The number of rings that make up the tree.</param>
+	/// <param name="storage">How the rings are laid out in memory.</param>
+	/// <param name="allocator">The policy that the tree buffer gets its memory from, or null for calloc and free.</param>
+	inline binarytree_t(const uint32_t rings, const treestorage_t storage = TREE_STORAGE_CONTIGUOUS, treeallocator_t* allocator = 0) :
+		_registry(rings, 2, storage, allocator) {}
+	inline ~binarytree_t() { this->clear(); }
+	
+	/// <summary>
+	/// Sets the root of the tree with the given item.
+	/// </summary>
+	/// <param name="item">An item to put in the root node.</param>
+	/// <returns>An iterator pointing at the root of the tree, or an empty iterator when the tree buffer could not be allocated.</returns>
+	inline iterator set_root(const T& item);
+	
+	/// <summary>
+	/// Searches the tree for the given item.
+	/// </summary>
+	/// <param name="item">An item to search for.</param>
+	/// <reutrns>A value indicating whether or not the given item was found in the tree.</returns>
+	inline iterator search(const T& item);
+	/// <summary>
+	/// Searches the tree for every node that holds the given item, in level order.
+	/// </summary>
+	/// <param name="item">An item to search for.</param>
+	/// <param name="results">An array that receives an iterator for each node that was found, or null to only count them.</param>
+	/// <param name="limit">The number of iterators that fit in the results.</param>
+	/// <returns>The number of nodes that hold the item, which can be more than the limit.</returns>
+	inline size_t search_all(const T& item, iterator* results, const size_t limit);
+	/// <summary>
+	/// Searches the tree for the given item on a pool of threads, which finds the same node as search().
+	/// </summary>
+	/// <param name="item">An item to search for.</param>
+	/// <param name="pool">The pool to run on, or null for the shared pool.</param>
+	inline iterator parallel_search(const T& item, treepool_t* pool = 0);
+	/// <summary>
+	/// Searches the tree for every node that holds the given item on a pool of threads, in level order.
+	/// </summary>
+	/// <param name="item">An item to search for.</param>
+	/// <param name="results">An array that receives an iterator for each node that was found, or null to only count them.</param>
+	/// <param name="limit">The number of iterators that fit in the results.</param>
+	/// <param name="pool">The pool to run on, or null for the shared pool.</param>
+	/// <returns>The number of nodes that hold the item, which can be more than the limit.</returns>
+	inline size_t parallel_search_all(const T& item, iterator* results, const size_t limit, treepool_t* pool = 0);
+	
+	/// <summary>
+	/// Gets an iterator pointing at the root of the tree.
+	/// </summary>
+	inline iterator root() { return iterator(treereference_t<Node, 2>(this->_registry, 0)); }
+	/// <summary>
+	/// Gets an invalid iterator that does not have a node.
+	/// </summary>
+	inline iterator end() const { return iterator(); }
+	
+	/// <summary>
+	/// Call given function for each node in the tree.
+	/// A zero value as a return value will exit.
+	/// </summary>
+	/// <param name="callback">Callback function to call on each node in the tree.</param>
+	inline void each(iterationfunc callback);
+	/// <summary>
+	/// Call to iterate through tree determined by the return value of the callback.
+	/// A positive value will go left, a negative value will go right, and zero will exit.
+	/// </summary>
+	/// <param name="callback">Callback function to call on each node in the path.</param>
+	inline void path(iterationfunc callback);
+	/// <summary>
+	/// Call given callable for each node in the tree, parents before children, without recursion.
+	/// The callable takes a reference to the node and a reference to its item, and a zero return value will exit.
+	/// Callables that convert to iterationfunc use the function pointer overload instead.
+	/// </summary>
+	/// <param name="callback">A function object or lambda to call on each node in the tree.</param>
+	template <typename F, typename = typename std::enable_if<!std::is_convertible<F, iterationfunc>::value>::type> inline void each(F callback);
+	/// <summary>
+	/// Call to iterate through tree determined by the return value of the callable, as with the function pointer overload.
+	/// The callable takes a reference to the node and a reference to its item.
+	/// </summary>
+	/// <param name="callback">A function object or lambda to call on each node in the path.</param>
+	template <typename F, typename = typename std::enable_if<!std::is_convertible<F, iterationfunc>::value>::type> inline void path(F callback);
+	/// <summary>
+	/// Follows a batch of independent paths at once, interleaving their steps so that the cache misses of different paths overlap.
+	/// The callable takes the number of a path, a reference to the node and a reference to its item. A positive value will go left, a negative value will go right, and zero will end the path.
+	/// The paths take their steps in no particular order.
+	/// </summary>
+	/// <param name="count">The number of paths, which are numbered from zero.</param>
+	/// <param name="callback">A function object or lambda to call on each node of each path.</param>
+	template <typename F> inline void paths(const size_t count, F callback);
+	/// <summary>
+	/// Calls a function for every node in the tree on a pool of threads, splitting the tree into subtrees at the given ring.
+	/// Parents are visited before children within a subtree, but there is no order between subtrees and no early exit.
+	/// </summary>
+	/// <param name="function">A callable that takes a reference to a node and a reference to its item.</param>
+	/// <param name="ring">The ring to split the tree at, or zero to pick one with several subtrees per worker.</param>
+	/// <param name="pool">The pool to run on, or null for the shared pool.</param>
+	template <typename F> inline void parallel_each(F function, const uint32_t ring = 0, treepool_t* pool = 0);
+	/// <summary>
+	/// Calls a function for every node in the tree on a pool of threads, with a state for each worker that is combined at the end.
+	/// Which worker visits a subtree is not fixed, so the combine should not depend on the order of the states.
+	/// </summary>
+	/// <param name="initial">The value that every worker's state starts from.</param>
+	/// <param name="function">A callable that takes a reference to the worker's state, a reference to a node and a reference to its item.</param>
+	/// <param name="combine">A callable that takes a reference to a state and folds a second state into it.</param>
+	/// <param name="ring">The ring to split the tree at, or zero to pick one with several subtrees per worker.</param>
+	/// <param name="pool">The pool to run on, or null for the shared pool.</param>
+	/// <returns>The state of every worker combined.</returns>
+	template <typename S, typename F, typename C> inline S parallel_each(const S& initial, F function, C combine, const uint32_t ring = 0, treepool_t* pool = 0);
+	
+	/// <summary>
+	/// Calls a function for every node of a ring, in the order of the tree buffer.
+	/// </summary>
+	/// <param name="ring">The ring to visit.</param>
+	/// <param name="function">A callable that takes a reference to a node and a reference to its item.</param>
+	template <typename F> inline void for_each_ring(const uint32_t ring, F function) { this->for_each_level_order(ring, ring + 1, function); }
+	/// <summary>
+	/// Calls a function for every node ring by ring, streaming the tree buffer from front to back.
+	/// </summary>
+	/// <param name="function">A callable that takes a reference to a node and a reference to its item.</param>
+	template <typename F> inline void for_each_level_order(F function) { this->for_each_level_order(0, TREE_MAX_RINGS, function); }
+	/// <summary>
+	/// Calls a function for every node of a range of rings, streaming the tree buffer from front to back.
+	/// </summary>
+	/// <param name="first">The first ring to visit.</param>
+	/// <param name="last">The ring after the last ring to visit.</param>
+	/// <param name="function">A callable that takes a reference to a node and a reference to its item.</param>
+	template <typename F> inline void for_each_level_order(const uint32_t first, const uint32_t last, F function);
+	
+	/// <summary>
+	/// Gets the nodes of the tree with each node before its children.
+	/// </summary>
+	inline treerange_t<T, Node, 2, TREE_ORDER_PRE> preorder() { return treerange_t<T, Node, 2, TREE_ORDER_PRE>(this->_registry); }
+	/// <summary>
+	/// Gets the nodes of the tree with each node between its left and right subtrees.
+	/// </summary>
+	inline treerange_t<T, Node, 2, TREE_ORDER_IN> inorder() { return treerange_t<T, Node, 2, TREE_ORDER_IN>(this->_registry); }
+	/// <summary>
+	/// Gets the nodes of the tree with each node after its children.
+	/// </summary>
+	inline treerange_t<T, Node, 2, TREE_ORDER_POST> postorder() { return treerange_t<T, Node, 2, TREE_ORDER_POST>(this->_registry); }
+	/// <summary>
+	/// Gets the nodes of the tree ring by ring.
+	/// </summary>
+	inline treerange_t<T, Node, 2, TREE_ORDER_LEVEL> levelorder() { return treerange_t<T, Node, 2, TREE_ORDER_LEVEL>(this->_registry); }
+	
+	/// <summary>
+	/// Gets the number of nodes in the tree.
+	/// </summary>
+	inline size_t size() const { return this->_registry.count(); }
+	/// <summary>
+	/// Gets the number of rings that are allocated for the tree.
+	/// </summary>
+	inline uint32_t rings() const { return this->_registry.rings(); }
+	
+	/// <summary>
+	/// Gets the payloads of a ring as a contiguous array, which needs a Node that only holds the payload such as compactnode_t.
+	/// </summary>
+	/// <param name="ring">The ring to get the payloads of.</param>
+	/// <returns>The ring's payloads in branch order, or null when the ring is not allocated or the storage does not keep rings together.</returns>
+	inline T* payloads(const uint32_t ring) const;
+	/// <summary>
+	/// Gets the occupancy bitmap of a ring, bit n of word n / 64 is set when the ring's payload n is used.
+	/// </summary>
+	/// <param name="ring">The ring to get the bitmap of.</param>
+	inline const uint64_t* occupancy(const uint32_t ring) const { return this->_registry.occupancy(ring); }
+	
+	/// <summary>
+	/// Replaces the nodes of this tree with a copy of another tree's nodes, which needs a Node that only holds a trivially copyable payload, such as compactnode_t of a plain type.
+	/// </summary>
+	/// <param name="other">The tree to copy.</param>
+	/// <returns>A value indicating whether or not the copy was allocated, the tree is left empty when it was not.</returns>
+	inline bool copy(const binarytree_t<T, Node>& other);
+	/// <summary>
+	/// Replaces the nodes of this tree with a level-order array of items, sizing the tree buffer once.
+	/// Nodes that only hold a trivially copyable payload, such as compactnode_t of a plain type, are copied straight from the array,
+	/// and any other node is copy constructed from its item.
+	/// </summary>
+	/// <param name="items">The items in level order, item n goes to the node at index n.</param>
+	/// <param name="count">The number of items in the array.</param>
+	/// <param name="mask">A bitmap where bit n of word n / 64 is set when node n is used, or null when every node is used. The parent of a used node has to be used.</param>
+	/// <returns>A value indicating whether or not the nodes were allocated, the tree is left empty when they were not.</returns>
+	inline bool assign(const T* items, const size_t count, const uint64_t* mask = 0);
+	/// <summary>
+	/// Writes the nodes of this tree to an image file, which needs a Node that only holds a payload without pointers, such as compactnode_t of a plain type.
+	/// </summary>
+	/// <param name="path">The path of the file to write.</param>
+	/// <returns>A value indicating whether or not the whole image was written.</returns>
+	inline bool save(const char* path) const;
+	/// <summary>
+	/// Replaces the nodes of this tree with an image file written by save(), which is mapped rather than read, so the tree opens at once
+	/// and each page of nodes is only read from the file when it is first touched.
+	/// </summary>
+	/// <param name="path">The path of the file to open.</param>
+	/// <returns>A value indicating whether or not the image was opened, the tree is left empty when it was not.</returns>
+	inline bool open(const char* path);
+	/// <summary>
+	/// Writes the used nodes of this tree to a stream, which needs a Node that only holds a payload without pointers, such as compactnode_t of a plain type.
+	/// Only a block of nodes is held at a time, and the stream grows with the number of nodes rather than the capacity.
+	/// </summary>
+	/// <param name="sink">A callable that takes a pointer to bytes and a number of bytes, and returns false when it could not write them.</param>
+	/// <returns>A value indicating whether or not the whole stream was written.</returns>
+	template <typename W> inline bool write(W sink) const;
+	/// <summary>
+	/// Replaces the nodes of this tree with a stream written by write(), keeping this tree's storage.
+	/// </summary>
+	/// <param name="source">A callable that takes a pointer to bytes and a number of bytes to read into it, and returns false when it could not read them.</param>
+	/// <returns>A value indicating whether or not the stream was read, the tree is left empty when it was not.</returns>
+	template <typename R> inline bool read(R source);
+	
+	/// <summary>
+	/// Allocates the given number of rings up front, which inserting from several threads at once needs because it never grows the tree buffer.
+	/// </summary>
+	/// <param name="rings">The number of rings to allocate.</param>
+	/// <returns>A value indicating whether or not the rings were allocated.</returns>
+	inline bool reserve(const uint32_t rings) { return this->_registry.ensure(rings, 2); }
+	/// <summary>
+	/// Clears all nodes from the tree.
+	/// </summary>
+	inline void clear();
+	
+protected:
+	
+	static int32_t execute_each(const treereference_t<Node, 2>& node, iterationfunc callback);
+	static int32_t execute_path(const treereference_t<Node, 2>& node, iterationfunc callback);
+	
+	treealloc_t<Node, 2> _registry;
+	
+};
+
+#include "binarytree.inl"
+
+/// <summary>
+/// Orders items with their less than operator.
+/// </summary>
+template <typename T> struct tree_less_t
+{
+	
+	inline bool operator()(const T& left, const T& right) const { return left < right; }
+	
+};
+
+/// <summary>
+/// Contains methods and properties for a binary search tree that keeps its items ordered, without duplicates.
+/// Items that order before a node are kept in its left subtree, and items that order after it in its right subtree.
+/// The depth is kept within two rings of the smallest possible depth by rebuilding subtrees when an insert goes too deep,
+/// so the registry's capacity stays within a small multiple of the number of items.
+/// Inserting or erasing can move items to other nodes, which invalidates iterators.
+/// </summary>
+template <typename T, typename Compare = tree_less_t<T> > class searchtree_t
+{
+public:
+	
+	typedef binaryiterator_t<T, compactnode_t<T> > iterator;
+	typedef treereference_t<compactnode_t<T>, 2> reference;
+	
+	inline searchtree_t() :
+		_registry(1, 2),
+		_peak(0) {}
+	/// <param name="rings">The number of rings to allocate up front.</param>
+	/// <param name="storage">How the rings are laid out in memory.</param>
+	/// <param name="compare">The function object that orders the items.</param>
+	inline searchtree_t(const uint32_t rings, const treestorage_t storage = TREE_STORAGE_CONTIGUOUS, const Compare& compare = Compare()) :
+		_registry(rings, 2, storage),
+		_compare(compare),
+		_peak(0) {}
+	inline ~searchtree_t() { this->clear(); }
+	
 	/// <summary>
-	/// Set the right child node with the given item, and then iterate to that node.
+	/// Inserts an item into its ordered place in the tree.
 	/// </summary>
-	/// <param name="item">The item to put in the new node.</param>
-	/// <returns>A new iterator at the next position.</returns>
-	inline binaryiterator_t<T> right(const T& item);
+	/// <param name="item">An item to insert.</param>
+	/// <returns>An iterator pointing at the item, or at the equal item that was already in the tree, or an empty iterator when the tree buffer could not grow.</returns>
+	inline iterator insert(const T& item);
 	/// <summary>
-	/// Iterate to the parent node.
+	/// Erases the item that is equal to the given item.
 	/// </summary>
-	/// <returns>A new iterator at the next position.</returns>
-	inline binaryiterator_t<T> parent();
+	/// <param name="item">An item to erase.</param>
+	/// <returns>A value indicating whether or not an item was erased.</returns>
+	inline bool erase(const T& item);
 	
 	/// <summary>
-	/// Remove the node where the iterator is, and then iterate to the parent node.
+	/// Finds the item that is equal to the given item.
 	/// </summary>
-	/// <returns>A new iterator at the next position.</returns>
-	inline binaryiterator_t<T> remove();
-	
+	/// <param name="item">An item to search for.</param>
+	/// <returns>An iterator pointing at the item, or an empty iterator when there is none.</returns>
+	inline iterator find(const T& item);
 	/// <summary>
-	/// Gets a value indicating whether or not the node has a left child.
+	/// Finds the first item that does not order before the given item.
 	/// </summary>
-	inline bool has_left() const;
+	/// <param name="item">An item to search for.</param>
+	/// <returns>An iterator pointing at the item, or an empty iterator when there is none.</returns>
+	inline iterator lower_bound(const T& item);
 	/// <summary>
-	/// Gets a value indicating whether or not the node has a right child.
+	/// Finds the first item that orders after the given item.
 	/// </summary>
-	inline bool has_right() const;
+	/// <param name="item">An item to search for.</param>
+	/// <returns>An iterator pointing at the item, or an empty iterator when there is none.</returns>
+	inline iterator upper_bound(const T& item);
+	
 	/// <summary>
-	/// Gets a value indicating whether or not the node is a root node.
+	/// Gets an iterator pointing at the root of the tree.
 	/// </summary>
-	inline bool root() const;
+	inline iterator root() { return iterator(reference(this->_registry, 0)); }
 	/// <summary>
-	/// Gets a value indicating whether or not the node has any children.
+	/// Gets an invalid iterator that does not have a node.
 	/// </summary>
-	inline bool leaf() const;
+	inline iterator end() const { return iterator(); }
 	
 	/// <summary>
-	/// Gets a value indicating whether or not the iterator has a node.
+	/// Gets the items of the tree from first to last.
 	/// </summary>
-	inline bool empty() const;
+	inline treerange_t<T, compactnode_t<T>, 2, TREE_ORDER_IN> inorder() { return treerange_t<T, compactnode_t<T>, 2, TREE_ORDER_IN>(this->_registry); }
 	
 	/// <summary>
-	/// Iterate to the left child node.
-	/// </summary>
-	inline binaryiterator_t<T>& operator++();
-	/// <summary>
-	/// Iterate to the right child node.
-	/// </summary>
-	inline binaryiterator_t<T>& operator--();
-	/// <summary>
-	/// Gets the held item for the current node.
+	/// Gets the number of items in the tree.
 	/// </summary>
-	inline T& operator*() const;
+	inline size_t size() const { return this->_registry.count(); }
 	/// <summary>
-	/// Determines whether this iterator is at the same location than the other iterator.
+	/// Gets the number of rings that are allocated for the tree.
 	/// </summary>
-	/// <param name="other">An instance of binaryiterator_t.</param>
-	inline bool operator==(const binaryiterator_t<T>& other) const;
+	inline uint32_t rings() const { return this->_registry.rings(); }
+	
 	/// <summary>
-	/// Determines whether this iterator is not at the same location than the other iterator.
+	/// Clears all items from the tree.
 	/// </summary>
-	/// <param name="other">An instance of binaryiterator_t.</param>
-	inline bool operator!=(const binaryiterator_t<T>& other) const;
+	inline void clear();
 	
-	treereference_t<binarynode_t<T> > _node;
+protected:
+	
+	inline size_t locate(const T& item);
+	inline size_t bound(const T& item, const bool after);
+	inline void rebuild(const size_t index);
+	
+	size_t collect(const size_t index, compactnode_t<T>* nodes, size_t count);
+	void place(const size_t index, const compactnode_t<T>* nodes, const size_t first, const size_t last);
+	
+	treealloc_t<compactnode_t<T>, 2> _registry;
+	Compare _compare;
+	size_t _peak;
 	
 };
 
+#include "searchtree.inl"
+
 /// <summary>
-/// Contains methods and properties for a binary tree.
+/// Contains methods and properties for a read-only binary search tree that is built once from sorted items.
+/// The items are kept in the Eytzinger layout, which is the registry's level order, so the tree is complete and every
+/// lookup walks the same number of rings. Lookups choose the next child with arithmetic instead of a branch and
+/// prefetch the nodes four rings further down, so several cache misses of one lookup are in flight at once.
 /// </summary>
-template <typename T> class binarytree_t
+template <typename T, typename Compare = tree_less_t<T> > class statictree_t
 {
 public:
 	
-	typedef binaryiterator_t<T> iterator;
-	
-	typedef int32_t (*iterationfunc)(const treereference_t<binarynode_t<T> >& node, const T& item);
-	
-	friend struct binarynode_t<T>;
-	friend struct binaryiterator_t<T>;
+	typedef binaryiterator_t<T, compactnode_t<T> > iterator;
+	typedef treereference_t<compactnode_t<T>, 2> reference;
 	
-	inline binarytree_t() :
-		_registry(3, 2) {}
-	/// <param name="rings">The number of rings that make up the tree.</param>
-	inline binarytree_t(const uint32_t rings) :
-		_registry(rings, 2) {}
-	inline ~binarytree_t() { this->clear(); }
+	inline statictree_t() :
+		_registry(0, 2) {}
+	/// <param name="items">The items in order, as the compare function orders them.</param>
+	/// <param name="count">The number of items.</param>
+	/// <param name="compare">The function object that orders the items.</param>
+	inline statictree_t(const T* items, const size_t count, const Compare& compare = Compare()) :
+		_registry(0, 2),
+		_compare(compare) { this->assign(items, count); }
+	inline ~statictree_t() { this->clear(); }
 	
 	/// <summary>
-	/// Sets the root of the tree with the given item.
+	/// Replaces the items of the tree, in time linear in the number of items.
 	/// </summary>
-	/// <param name="item">An item to put in the root node.</param>
-	/// <returns>An iterator pointing at the root of the tree.</returns>
-	inline iterator set_root(const T& item);
+	/// <param name="items">The items in order, as the compare function orders them. Equal items are kept.</param>
+	/// <param name="count">The number of items.</param>
+	/// <returns>A value indicating whether or not the items were allocated, the tree is left empty when they were not.</returns>
+	inline bool assign(const T* items, const size_t count);
 	
 	/// <summary>
-	/// Searches the tree for the given item.
+	/// Finds an item that is equal to the given item.
 	/// </summary>
 	/// <param name="item">An item to search for.</param>
-	/// <reutrns>A value indicating whether or not the given item was found in the tree.</returns>
-	inline iterator search(const T& item);
+	/// <returns>An iterator pointing at the first equal item in order, or an empty iterator when there is none.</returns>
+	inline iterator find(const T& item);
+	/// <summary>
+	/// Finds the first item that does not order before the given item.
+	/// </summary>
+	/// <param name="item">An item to search for.</param>
+	/// <returns>An iterator pointing at the item, or an empty iterator when there is none.</returns>
+	inline iterator lower_bound(const T& item);
+	/// <summary>
+	/// Finds the first item that orders after the given item.
+	/// </summary>
+	/// <param name="item">An item to search for.</param>
+	/// <returns>An iterator pointing at the item, or an empty iterator when there is none.</returns>
+	inline iterator upper_bound(const T& item);
 	
 	/// <summary>
 	/// Gets an iterator pointing at the root of the tree.
 	/// </summary>
-	inline iterator root() { return iterator(treereference_t<binarynode_t<T> >(this->_registry, 0)); }
+	inline iterator root() { return iterator(reference(this->_registry, 0)); }
 	/// <summary>
 	/// Gets an invalid iterator that does not have a node.
 	/// </summary>
 	inline iterator end() const { return iterator(); }
 	
 	/// <summary>
-	/// Call given function for each node in the tree.
-	/// A zero value as a return value will exit.
+	/// Gets the items of the tree from first to last.
 	/// </summary>
-	/// <param name="callback">Callback function to call on each node in the tree.</param>
-	inline void each(iterationfunc callback);
+	inline treerange_t<T, compactnode_t<T>, 2, TREE_ORDER_IN> inorder() { return treerange_t<T, compactnode_t<T>, 2, TREE_ORDER_IN>(this->_registry); }
+	
 	/// <summary>
-	/// Call to iterate through tree determined by the return value of the callback.
-	/// A positive value will go left, a negative value will go right, and zero will exit.
+	/// Gets the number of items in the tree.
 	/// </summary>
-	/// <param name="callback">Callback function to call on each node in the path.</param>
-	inline void path(iterationfunc callback);
+	inline size_t size() const { return this->_registry.count(); }
+	/// <summary>
+	/// Gets the number of rings that are allocated for the tree.
+	/// </summary>
+	inline uint32_t rings() const { return this->_registry.rings(); }
 	
 	/// <summary>
-	/// Clears all nodes from the tree.
+	/// Clears all items from the tree.
 	/// </summary>
-	inline void clear();
+	inline void clear() { this->_registry.clear(); }
 	
 protected:
 	
-	static int32_t execute_each(const treereference_t<binarynode_t<T> >& node, iterationfunc callback);
-	static int32_t execute_path(const treereference_t<binarynode_t<T> >& node, iterationfunc callback);
+	inline size_t bound(const T& item, const bool after) const;
 	
-	treealloc_t<binarynode_t<T> > _registry;
+	size_t place(const size_t index, const T* items, const size_t count, size_t next);
+	
+	treealloc_t<compactnode_t<T>, 2> _registry;
+	Compare _compare;
 	
 };
 
-#include "binarytree.inl"
+#include "statictree.inl"
 
 template <typename T> struct quadnode_t;
-template <typename T> struct quaditerator_t;
-template <typename T> class quadtree_t;
+template <typename T, typename Node = quadnode_t<T> > struct quaditerator_t;
+template <typename T, typename Node = quadnode_t<T> > class quadtree_t;
+
+template <typename T> struct tree_stride_t<quadnode_t<T> >
+{
+	static const uint32_t value = 4;
+};
 
 /// <summary>
 /// Contains methods and properties for a node in a quadratic tree.
@@ -435,6 +1812,27 @@ template <typename T> struct quadnode_t
 	/// </summary>
 	inline size_t index() const;
 	
+	/// <summary>
+	/// Creates a node for the same tree as this node.
+	/// </summary>
+	/// <param name="ring">The ring that the new node exists in.</param>
+	/// <param name="branch">The index inside of the ring for the new node.</param>
+	/// <param name="data">The data that the new node holds.</param>
+	inline quadnode_t<T> spawn(const int32_t ring, const int32_t branch, const T& data) const { return quadnode_t<T>(*(this->_tree), ring, branch, data); }
+	/// <summary>
+	/// Links this node to its parent.
+	/// </summary>
+	/// <param name="up">The parent node.</param>
+	/// <param name="child">The number of the quadrant that this node is.</param>
+	/// <param name="self">This node.</param>
+	inline void link(const treereference_t<quadnode_t<T> >& up, const uint32_t child, const treereference_t<quadnode_t<T> >& self);
+	/// <summary>
+	/// Unlinks this node from its parent.
+	/// </summary>
+	/// <param name="up">The parent node.</param>
+	/// <param name="self">This node.</param>
+	inline void unlink(const treereference_t<quadnode_t<T> >& up, const treereference_t<quadnode_t<T> >& self);
+	
 	treereference_t<quadnode_t<T> > _q0;
 	treereference_t<quadnode_t<T> > _q1;
 	treereference_t<quadnode_t<T> > _q2;
@@ -450,12 +1848,12 @@ template <typename T> struct quadnode_t
 /// <summary>
 /// Contains methods and properties for iterating through a quadratic tree.
 /// </summary>
-template <typename T> struct quaditerator_t
+template <typename T, typename Node> struct quaditerator_t
 {
 	
 	inline quaditerator_t() {}
 	/// <param name="node">The current node for the iterator.</param>
-	inline quaditerator_t(const treereference_t<quadnode_t<T> >& node) :
+	inline quaditerator_t(const treereference_t<Node, 4>& node) :
 		_node(node) {}
 	inline ~quaditerator_t() {}
 	
@@ -464,18 +1862,40 @@ template <typename T> struct quaditerator_t
 	/// </summary>
 	/// <param name="quadrant">The number of the quadrant to iterate to.</param>
 	/// <returns>A new iterator at the next position.</returns>
-	inline quaditerator_t<T> child(const int32_t quadrant);
+	inline quaditerator_t<T, Node> child(const int32_t quadrant) const;
+	/// <summary>
+	/// Set the child node at the specified number with the given item, and then iterate to that node.
+	/// </summary>
+	/// <param name="quadrant">The number of the quadrant to iterate to.</param>
+	/// <param name="item">The item to put in the new node.</param>
+	/// <returns>A new iterator at the next position, or an empty iterator when the tree buffer could not grow.</returns>
+	inline quaditerator_t<T, Node> child(const int32_t quadrant, const T& item);
+	/// <summary>
+	/// Set a child quadrant with the given item if it is unused, which is safe to call from several threads at once, and then iterate to that node.
+	/// The tree buffer is not grown, see quadtree_t::reserve, and this node has to be fully inserted before a child is claimed.
+	/// </summary>
+	/// <param name="quadrant">The number of the quadrant to iterate to.</param>
+	/// <param name="item">The item to put in the new node.</param>
+	/// <returns>A new iterator at the next position, or an empty iterator when another thread claimed the node first or it is past the capacity.</returns>
+	inline quaditerator_t<T, Node> claim(const int32_t quadrant, const T& item);
 	/// <summary>
 	/// Iterate to the parent node.
 	/// </summary>
 	/// <returns>A new iterator at the next position.</returns>
-	inline quaditerator_t<T> parent();
+	inline quaditerator_t<T, Node> parent();
+	/// <summary>
+	/// Iterate to the node of a cell in the same ring, at an offset from this node's cell.
+	/// </summary>
+	/// <param name="dx">The number of columns to move, negative to move toward column zero.</param>
+	/// <param name="dy">The number of rows to move, negative to move toward row zero.</param>
+	/// <returns>A new iterator at the next position, or an empty iterator when the cell is outside of the ring or its node is unused.</returns>
+	inline quaditerator_t<T, Node> neighbor(const int32_t dx, const int32_t dy) const;
 	
 	/// <summary>
 	/// Remove the node where the iterator is, and then iterate to the parent node.
 	/// </summary>
 	/// <returns>A new iterator at the next position.</returns>
-	inline quaditerator_t<T> remove();
+	inline quaditerator_t<T, Node> remove();
 	
 	/// <summary>
 	/// Gets a value indicating whether or not the node is a root node.
@@ -485,6 +1905,14 @@ template <typename T> struct quaditerator_t
 	/// Gets a value indicating whether or not the node has any children.
 	/// </summary>
 	inline bool leaf() const;
+	/// <summary>
+	/// Gets the column of the node's cell, on the grid of 2^r by 2^r cells that ring r splits the root into.
+	/// </summary>
+	inline uint32_t x() const;
+	/// <summary>
+	/// Gets the row of the node's cell, on the grid of 2^r by 2^r cells that ring r splits the root into.
+	/// </summary>
+	inline uint32_t y() const;
 	
 	/// <summary>
 	/// Gets a value indicating whether or not the iterator has a node.
@@ -499,48 +1927,52 @@ template <typename T> struct quaditerator_t
 	/// Gets an iterator to a child quadrant.
 	/// </summary>
 	/// <param name="quadrant">The number of the quadrant to iterate to.</param>
-	inline quaditerator_t<T> operator[](const int32_t quadrant);
+	inline quaditerator_t<T, Node> operator[](const int32_t quadrant);
 	/// <summary>
 	/// Determines whether this iterator is at the same location than the other iterator.
 	/// </summary>
 	/// <param name="other">An instance of binaryiterator_t.</param>
-	inline bool operator==(const quaditerator_t<T>& other) const;
+	inline bool operator==(const quaditerator_t<T, Node>& other) const;
 	/// <summary>
 	/// Determines whether this iterator is not at the same location than the other iterator.
 	/// </summary>
 	/// <param name="other">An instance of binaryiterator_t.</param>
-	inline bool operator!=(const quaditerator_t<T>& other) const;
+	inline bool operator!=(const quaditerator_t<T, Node>& other) const;
 	
-	treereference_t<quadnode_t<T> > _node;
+	treereference_t<Node, 4> _node;
 	
 };
 
 /// <summary>
 /// Contains methods and properties for a quadratic tree.
+/// The Node parameter selects the node layout, quadnode_t keeps explicit links while compactnode_t only keeps the payload.
 /// </summary>
-template <typename T> class quadtree_t
+template <typename T, typename Node> class quadtree_t
 {
 public:
 	
-	typedef quaditerator_t<T> iterator;
+	typedef quaditerator_t<T, Node> iterator;
+	typedef treereference_t<Node, 4> reference;
 	
-	typedef int32_t (*iterationfunc)(const treereference_t<quadnode_t<T> >& node, const T& item);
+	typedef int32_t (*iterationfunc)(const treereference_t<Node, 4>& node, const T& item);
 	
 	friend struct quadnode_t<T>;
-	friend struct quaditerator_t<T>;
+	friend struct quaditerator_t<T, Node>;
 	
 	inline quadtree_t() :
 		_registry(3, 4) {}
 	/// <param name="rings">The number of rings that make up the tree.</param>
-	inline quadtree_t(const uint32_t rings) :
-		_registry(rings, 4) {}
+	/// <param name="storage">How the rings are laid out in memory.</param>
+	/// <param name="allocator">The policy that the tree buffer gets its memory from, or null for calloc and free.</param>
+	inline quadtree_t(const uint32_t rings, const treestorage_t storage = TREE_STORAGE_CONTIGUOUS, treeallocator_t* allocator = 0) :
+		_registry(rings, 4, storage, allocator) {}
 	inline ~quadtree_t() { this->clear(); }
 	
 	/// <summary>
 	/// Sets the root of the tree with the given item.
 	/// </summary>
 	/// <param name="item">An item to put in the root node.</param>
-	/// <returns>An iterator pointing at the root of the tree.</returns>
+	/// <returns>An iterator pointing at the root of the tree, or an empty iterator when the tree buffer could not be allocated.</returns>
 	inline iterator set_root(const T& item);
 	
 	/// <summary>
@@ -549,6 +1981,29 @@ public:
 	/// <param name="item">An item to search for.</param>
 	/// <reutrns>A value indicating whether or not the given item was found in the tree.</returns>
 	inline iterator search(const T& item);
+	/// <summary>
+	/// Searches the tree for every node that holds the given item, in level order.
+	/// </summary>
+	/// <param name="item">An item to search for.</param>
+	/// <param name="results">An array that receives an iterator for each node that was found, or null to only count them.</param>
+	/// <param name="limit">The number of iterators that fit in the results.</param>
+	/// <returns>The number of nodes that hold the item, which can be more than the limit.</returns>
+	inline size_t search_all(const T& item, iterator* results, const size_t limit);
+	/// <summary>
+	/// Searches the tree for the given item on a pool of threads, which finds the same node as search().
+	/// </summary>
+	/// <param name="item">An item to search for.</param>
+	/// <param name="pool">The pool to run on, or null for the shared pool.</param>
+	inline iterator parallel_search(const T& item, treepool_t* pool = 0);
+	/// <summary>
+	/// Searches the tree for every node that holds the given item on a pool of threads, in level order.
+	/// </summary>
+	/// <param name="item">An item to search for.</param>
+	/// <param name="results">An array that receives an iterator for each node that was found, or null to only count them.</param>
+	/// <param name="limit">The number of iterators that fit in the results.</param>
+	/// <param name="pool">The pool to run on, or null for the shared pool.</param>
+	/// <returns>The number of nodes that hold the item, which can be more than the limit.</returns>
+	inline size_t parallel_search_all(const T& item, iterator* results, const size_t limit, treepool_t* pool = 0);
 	
 	/// <summary>
 	/// Gets an iterator pointing at the root of the tree.
@@ -559,6 +2014,26 @@ public:
 	/// </summary>
 	inline iterator end() const;
 	
+	/// <summary>
+	/// Gets the node of a cell without walking down from the root. Ring r splits the root into a grid of 2^r by 2^r cells, and as quadrant
+	/// (y << 1) | x of a node covers the upper half along each axis where that bit is set, a node's branch is the Morton code of its cell.
+	/// The cells of a ring are laid out along the Z-order curve, so the four quadrants of a cell are next to each other in memory.
+	/// </summary>
+	/// <param name="ring">The ring of the cell.</param>
+	/// <param name="x">The column of the cell, less than 2^ring.</param>
+	/// <param name="y">The row of the cell, less than 2^ring.</param>
+	/// <returns>An iterator pointing at the node, or an empty iterator when the cell is outside of the ring or its node is unused.</returns>
+	inline iterator cell(const uint32_t ring, const uint32_t x, const uint32_t y);
+	/// <summary>
+	/// Finds the deepest used node whose cell covers a cell of a ring, which is the cell itself when its node is used.
+	/// The ancestors of a cell are its Morton code cut short, and as the parent of a used node is used, the rings are searched by halving.
+	/// </summary>
+	/// <param name="x">The column of the cell, less than 2^ring.</param>
+	/// <param name="y">The row of the cell, less than 2^ring.</param>
+	/// <param name="ring">The ring of the cell.</param>
+	/// <returns>An iterator pointing at the node, or an empty iterator when the tree has no root or the cell is outside of the ring.</returns>
+	inline iterator locate(const uint32_t x, const uint32_t y, const uint32_t ring);
+	
 	/// <summary>
 	/// Call given function for each node in the tree.
 	/// A zero value as a return value will exit.
@@ -571,7 +2046,149 @@ public:
 	/// </summary>
 	/// <param name="callback">Callback function to call on each node in the path.</param>
 	inline void path(iterationfunc callback);
+	/// <summary>
+	/// Call given callable for each node in the tree, parents before children, without recursion.
+	/// The callable takes a reference to the node and a reference to its item, and a zero return value will exit.
+	/// Callables that convert to iterationfunc use the function pointer overload instead.
+	/// </summary>
+	/// <param name="callback">A function object or lambda to call on each node in the tree.</param>
+	template <typename F, typename = typename std::enable_if<!std::is_convertible<F, iterationfunc>::value>::type> inline void each(F callback);
+	/// <summary>
+	/// Call to iterate through tree determined by the return value of the callable, as with the function pointer overload.
+	/// The callable takes a reference to the node and a reference to its item.
+	/// </summary>
+	/// <param name="callback">A function object or lambda to call on each node in the path.</param>
+	template <typename F, typename = typename std::enable_if<!std::is_convertible<F, iterationfunc>::value>::type> inline void path(F callback);
+	/// <summary>
+	/// Follows a batch of independent paths at once, interleaving their steps so that the cache misses of different paths overlap.
+	/// The callable takes the number of a path, a reference to the node and a reference to its item. A value from one to four will go to that quadrant, and any other value will end the path.
+	/// The paths take their steps in no particular order.
+	/// </summary>
+	/// <param name="count">The number of paths, which are numbered from zero.</param>
+	/// <param name="callback">A function object or lambda to call on each node of each path.</param>
+	template <typename F> inline void paths(const size_t count, F callback);
+	/// <summary>
+	/// Calls a function for every node in the tree on a pool of threads, splitting the tree into subtrees at the given ring.
+	/// Parents are visited before children within a subtree, but there is no order between subtrees and no early exit.
+	/// </summary>
+	/// <param name="function">A callable that takes a reference to a node and a reference to its item.</param>
+	/// <param name="ring">The ring to split the tree at, or zero to pick one with several subtrees per worker.</param>
+	/// <param name="pool">The pool to run on, or null for the shared pool.</param>
+	template <typename F> inline void parallel_each(F function, const uint32_t ring = 0, treepool_t* pool = 0);
+	/// <summary>
+	/// Calls a function for every node in the tree on a pool of threads, with a state for each worker that is combined at the end.
+	/// Which worker visits a subtree is not fixed, so the combine should not depend on the order of the states.
+	/// </summary>
+	/// <param name="initial">The value that every worker's state starts from.</param>
+	/// <param name="function">A callable that takes a reference to the worker's state, a reference to a node and a reference to its item.</param>
+	/// <param name="combine">A callable that takes a reference to a state and folds a second state into it.</param>
+	/// <param name="ring">The ring to split the tree at, or zero to pick one with several subtrees per worker.</param>
+	/// <param name="pool">The pool to run on, or null for the shared pool.</param>
+	/// <returns>The state of every worker combined.</returns>
+	template <typename S, typename F, typename C> inline S parallel_each(const S& initial, F function, C combine, const uint32_t ring = 0, treepool_t* pool = 0);
 	
+	/// <summary>
+	/// Calls a function for every node of a ring, in the order of the tree buffer.
+	/// </summary>
+	/// <param name="ring">The ring to visit.</param>
+	/// <param name="function">A callable that takes a reference to a node and a reference to its item.</param>
+	template <typename F> inline void for_each_ring(const uint32_t ring, F function) { this->for_each_level_order(ring, ring + 1, function); }
+	/// <summary>
+	/// Calls a function for every node ring by ring, streaming the tree buffer from front to back.
+	/// </summary>
+	/// <param name="function">A callable that takes a reference to a node and a reference to its item.</param>
+	template <typename F> inline void for_each_level_order(F function) { this->for_each_level_order(0, TREE_MAX_RINGS, function); }
+	/// <summary>
+	/// Calls a function for every node of a range of rings, streaming the tree buffer from front to back.
+	/// </summary>
+	/// <param name="first">The first ring to visit.</param>
+	/// <param name="last">The ring after the last ring to visit.</param>
+	/// <param name="function">A callable that takes a reference to a node and a reference to its item.</param>
+	template <typename F> inline void for_each_level_order(const uint32_t first, const uint32_t last, F function);
+	
+	/// <summary>
+	/// Gets the nodes of the tree with each node before its children.
+	/// </summary>
+	inline treerange_t<T, Node, 4, TREE_ORDER_PRE> preorder() { return treerange_t<T, Node, 4, TREE_ORDER_PRE>(this->_registry); }
+	/// <summary>
+	/// Gets the nodes of the tree with each node after its children.
+	/// </summary>
+	inline treerange_t<T, Node, 4, TREE_ORDER_POST> postorder() { return treerange_t<T, Node, 4, TREE_ORDER_POST>(this->_registry); }
+	/// <summary>
+	/// Gets the nodes of the tree ring by ring.
+	/// </summary>
+	inline treerange_t<T, Node, 4, TREE_ORDER_LEVEL> levelorder() { return treerange_t<T, Node, 4, TREE_ORDER_LEVEL>(this->_registry); }
+	
+	/// <summary>
+	/// Gets the number of nodes in the tree.
+	/// </summary>
+	inline size_t size() const { return this->_registry.count(); }
+	/// <summary>
+	/// Gets the number of rings that are allocated for the tree.
+	/// </summary>
+	inline uint32_t rings() const { return this->_registry.rings(); }
+	
+	/// <summary>
+	/// Gets the payloads of a ring as a contiguous array, which needs a Node that only holds the payload such as compactnode_t.
+	/// </summary>
+	/// <param name="ring">The ring to get the payloads of.</param>
+	/// <returns>The ring's payloads in branch order, or null when the ring is not allocated or the storage does not keep rings together.</returns>
+	inline T* payloads(const uint32_t ring) const;
+	/// <summary>
+	/// Gets the occupancy bitmap of a ring, bit n of word n / 64 is set when the ring's payload n is used.
+	/// </summary>
+	/// <param name="ring">The ring to get the bitmap of.</param>
+	inline const uint64_t* occupancy(const uint32_t ring) const { return this->_registry.occupancy(ring); }
+	
+	/// <summary>
+	/// Replaces the nodes of this tree with a copy of another tree's nodes, which needs a Node that only holds a trivially copyable payload, such as compactnode_t of a plain type.
+	/// </summary>
+	/// <param name="other">The tree to copy.</param>
+	/// <returns>A value indicating whether or not the copy was allocated, the tree is left empty when it was not.</returns>
+	inline bool copy(const quadtree_t<T, Node>& other);
+	/// <summary>
+	/// Replaces the nodes of this tree with a level-order array of items, sizing the tree buffer once.
+	/// Nodes that only hold a trivially copyable payload, such as compactnode_t of a plain type, are copied straight from the array,
+	/// and any other node is copy constructed from its item.
+	/// </summary>
+	/// <param name="items">The items in level order, item n goes to the node at index n.</param>
+	/// <param name="count">The number of items in the array.</param>
+	/// <param name="mask">A bitmap where bit n of word n / 64 is set when node n is used, or null when every node is used. The parent of a used node has to be used.</param>
+	/// <returns>A value indicating whether or not the nodes were allocated, the tree is left empty when they were not.</returns>
+	inline bool assign(const T* items, const size_t count, const uint64_t* mask = 0);
+	/// <summary>
+	/// Writes the nodes of this tree to an image file, which needs a Node that only holds a payload without pointers, such as compactnode_t of a plain type.
+	/// </summary>
+	/// <param name="path">The path of the file to write.</param>
+	/// <returns>A value indicating whether or not the whole image was written.</returns>
+	inline bool save(const char* path) const;
+	/// <summary>
+	/// Replaces the nodes of this tree with an image file written by save(), which is mapped rather than read, so the tree opens at once
+	/// and each page of nodes is only read from the file when it is first touched.
+	/// </summary>
+	/// <param name="path">The path of the file to open.</param>
+	/// <returns>A value indicating whether or not the image was opened, the tree is left empty when it was not.</returns>
+	inline bool open(const char* path);
+	/// <summary>
+	/// Writes the used nodes of this tree to a stream, which needs a Node that only holds a payload without pointers, such as compactnode_t of a plain type.
+	/// Only a block of nodes is held at a time, and the stream grows with the number of nodes rather than the capacity.
+	/// </summary>
+	/// <param name="sink">A callable that takes a pointer to bytes and a number of bytes, and returns false when it could not write them.</param>
+	/// <returns>A value indicating whether or not the whole stream was written.</returns>
+	template <typename W> inline bool write(W sink) const;
+	/// <summary>
+	/// Replaces the nodes of this tree with a stream written by write(), keeping this tree's storage.
+	/// </summary>
+	/// <param name="source">A callable that takes a pointer to bytes and a number of bytes to read into it, and returns false when it could not read them.</param>
+	/// <returns>A value indicating whether or not the stream was read, the tree is left empty when it was not.</returns>
+	template <typename R> inline bool read(R source);
+	
+	/// <summary>
+	/// Allocates the given number of rings up front, which inserting from several threads at once needs because it never grows the tree buffer.
+	/// </summary>
+	/// <param name="rings">The number of rings to allocate.</param>
+	/// <returns>A value indicating whether or not the rings were allocated.</returns>
+	inline bool reserve(const uint32_t rings) { return this->_registry.ensure(rings, 4); }
 	/// <summary>
 	/// Clears all nodes from the tree.
 	/// </summary>
@@ -579,11 +2196,264 @@ public:
 	
 protected:
 	
-	static int32_t execute_each(const treereference_t<quadnode_t<T> >& node, iterationfunc callback);
-	static int32_t execute_path(const treereference_t<quadnode_t<T> >& node, iterationfunc callback);
+	static int32_t execute_each(const treereference_t<Node, 4>& node, iterationfunc callback);
+	static int32_t execute_path(const treereference_t<Node, 4>& node, iterationfunc callback);
+	
+	treealloc_t<Node, 4> _registry;
+	
+};
+
+#include "quadtree.inl"
+
+/// <summary>
+/// Contains a point in a spatialtree_t instance, with the item that it holds.
+/// </summary>
+template <typename T> struct spatialpoint_t
+{
+	double _x;
+	double _y;
+	T _data;
+};
+
+/// <summary>
+/// Contains the bucket of points of a cell in a spatialtree_t instance. Once the cell is split into quadrants it has no bucket,
+/// and the count is the number of points in the cell's subtree.
+/// </summary>
+template <typename T> struct spatialnode_t
+{
+	spatialpoint_t<T>* _points;
+	uint32_t _count;
+	uint32_t _capacity;
+};
+
+/// <summary>
+/// Contains methods and properties for a point quadtree that owns a bounding box, for finding points by where they are.
+/// Each node is a cell of the box: the root is the whole box, and the quadrants of a cell split it at its center, with quadrant
+/// (y << 1) | x holding the upper half along each axis where that bit is set. Points are kept in buckets at the leaf cells, and a
+/// bucket that fills up is split into the four quadrants until the last ring, where buckets grow instead.
+/// As the bounds of a cell follow from its place in the tree, queries skip every cell that is out of reach without looking at its points.
+/// </summary>
+template <typename T> class spatialtree_t
+{
+public:
+	
+	inline spatialtree_t() :
+		_registry(1, 4, TREE_STORAGE_SPARSE),
+		_minx(0.0),
+		_miny(0.0),
+		_maxx(1.0),
+		_maxy(1.0),
+		_bucket(32),
+		_depth(16),
+		_count(0) {}
+	/// <param name="minx">The lowest x of the bounding box.</param>
+	/// <param name="miny">The lowest y of the bounding box.</param>
+	/// <param name="maxx">The highest x of the bounding box.</param>
+	/// <param name="maxy">The highest y of the bounding box.</param>
+	/// <param name="bucket">The number of points that a cell holds before it is split.</param>
+	/// <param name="rings">The largest number of rings that the tree can split into, which is clamped to tree_max_rings(4), or 32.</param>
+	/// <param name="storage">How the rings are laid out in memory. Sparse storage only allocates the cells that are used, which suits clustered points.</param>
+	inline spatialtree_t(const double minx, const double miny, const double maxx, const double maxy, const uint32_t bucket = 32, const uint32_t rings = 16, const treestorage_t storage = TREE_STORAGE_SPARSE) :
+		_registry(1, 4, storage),
+		_minx(minx),
+		_miny(miny),
+		_maxx(maxx),
+		_maxy(maxy),
+		_bucket(max(bucket, 1u)),
+		_depth(min(max(rings, 1u), tree_max_rings(4))),
+		_count(0) {}
+	inline ~spatialtree_t() { this->clear(); }
+	
+	/// <summary>
+	/// Inserts a point into the cell that covers it, splitting the cell when its bucket is full.
+	/// </summary>
+	/// <param name="x">The x of the point.</param>
+	/// <param name="y">The y of the point.</param>
+	/// <param name="item">The item that the point holds.</param>
+	/// <returns>A value indicating whether or not the point was inserted, which it is not when it is outside of the bounding box.</returns>
+	inline bool insert(const double x, const double y, const T& item);
+	
+	/// <summary>
+	/// Calls a function for every point inside of a rectangle, edges included. Points come in no particular order.
+	/// </summary>
+	/// <param name="minx">The lowest x of the rectangle.</param>
+	/// <param name="miny">The lowest y of the rectangle.</param>
+	/// <param name="maxx">The highest x of the rectangle.</param>
+	/// <param name="maxy">The highest y of the rectangle.</param>
+	/// <param name="function">A callable that takes a reference to a point.</param>
+	/// <returns>The number of points that were found.</returns>
+	template <typename F> inline size_t query_rect(const double minx, const double miny, const double maxx, const double maxy, F function);
+	/// <summary>
+	/// Calls a function for every point within a distance of a position, the edge included. Points come in no particular order.
+	/// </summary>
+	/// <param name="x">The x of the position.</param>
+	/// <param name="y">The y of the position.</param>
+	/// <param name="radius">The largest distance from the position.</param>
+	/// <param name="function">A callable that takes a reference to a point.</param>
+	/// <returns>The number of points that were found.</returns>
+	template <typename F> inline size_t query_radius(const double x, const double y, const double radius, F function);
+	/// <summary>
+	/// Finds the points that are nearest to a position.
+	/// </summary>
+	/// <param name="x">The x of the position.</param>
+	/// <param name="y">The y of the position.</param>
+	/// <param name="k">The number of points to find.</param>
+	/// <param name="results">An array that receives up to k points, nearest first.</param>
+	/// <returns>The number of points that were found, which is less than k when the tree has fewer points.</returns>
+	inline size_t nearest_k(const double x, const double y, const size_t k, spatialpoint_t<T>* results);
+	
+	/// <summary>
+	/// Gets the number of points in the tree.
+	/// </summary>
+	inline size_t size() const { return this->_count; }
+	/// <summary>
+	/// Gets the number of rings that are allocated for the tree.
+	/// </summary>
+	inline uint32_t rings() const { return this->_registry.rings(); }
+	
+	/// <summary>
+	/// Clears all points from the tree.
+	/// </summary>
+	inline void clear();
+	
+protected:
+	
+	struct cell_t
+	{
+		size_t _index;
+		double _minx;
+		double _miny;
+		double _maxx;
+		double _maxy;
+		bool _inside;
+	};
+	
+	inline cell_t quadrant(const cell_t& cell, const uint32_t quadrant) const;
+	inline uint32_t choose(const cell_t& cell, const double x, const double y) const;
+	inline bool split(const cell_t& cell, const uint32_t ring);
+	
+	static bool divided(const spatialnode_t<T>& node);
+	static void append(spatialnode_t<T>& node, const spatialpoint_t<T>& point);
+	
+	treealloc_t<spatialnode_t<T>, 4> _registry;
+	double _minx;
+	double _miny;
+	double _maxx;
+	double _maxy;
+	uint32_t _bucket;
+	uint32_t _depth;
+	size_t _count;
+	
+};
+
+#include "spatialtree.inl"
+
+template <typename Tree> struct treereader_t;
+
+/// <summary>
+/// Contains a tree that one writer thread changes, and the last snapshot of it that was published for any number of reader threads.
+/// Readers never see the writer's tree, and a snapshot that was replaced is only freed once no reader that could have seen it is left,
+/// which is tracked with a global epoch and one slot per active reader.
+/// </summary>
+template <typename Tree> class treeshared_t
+{
+public:
+	
+	friend struct treereader_t<Tree>;
+	
+	/// <summary>
+	/// The number of readers that can be active at the same time, more readers wait for a slot.
+	/// </summary>
+	static const uint32_t readers = 64;
+	
+	/// <param name="rings">The number of rings that make up the writer's tree.</param>
+	/// <param name="storage">How the rings of the writer's tree are laid out in memory.</param>
+	inline treeshared_t(const uint32_t rings = 3, const treestorage_t storage = TREE_STORAGE_CONTIGUOUS);
+	inline ~treeshared_t();
+	
+	/// <summary>
+	/// Gets the tree that the writer changes, which only the writer thread may use.
+	/// </summary>
+	inline Tree& writer() { return this->_writer; }
+	/// <summary>
+	/// Gets the snapshot that is published to readers, for as long as the reader is alive.
+	/// </summary>
+	inline treereader_t<Tree> read() { return treereader_t<Tree>(*this); }
+	
+	/// <summary>
+	/// Publishes a copy of the writer's tree for readers, which is only called by the writer thread.
+	/// Readers that are already active keep the snapshot they have, and the replaced snapshot is freed once they are done.
+	/// </summary>
+	inline void publish();
+	/// <summary>
+	/// Frees the replaced snapshots that no active reader can still see, which is only called by the writer thread.
+	/// </summary>
+	/// <returns>The number of replaced snapshots that are still waiting for readers.</returns>
+	inline size_t reclaim();
+	
+protected:
+	
+	struct alignas(64) slot_t
+	{
+		std::atomic<uint64_t> _epoch;
+	};
+	
+	struct retired_t
+	{
+		Tree* _tree;
+		uint64_t _epoch;
+	};
+	
+	inline uint32_t enter();
+	inline void leave(const uint32_t slot);
+	
+	Tree _writer;
+	std::atomic<Tree*> _published;
+	std::atomic<uint64_t> _epoch;
+	slot_t _slots[readers];
+	retired_t* _retired;
+	size_t _count;
+	size_t _capacity;
+	
+};
+
+/// <summary>
+/// Contains a reader's hold on a published snapshot, which stays valid until the reader is destroyed.
+/// The snapshot must only be read, with search, each, path, the walkers and the iterators of nodes that are used.
+/// </summary>
+template <typename Tree> struct treereader_t
+{
+public:
+	
+	/// <param name="shared">The shared tree to read.</param>
+	inline treereader_t(treeshared_t<Tree>& shared) :
+		_shared(&shared),
+		_slot(shared.enter()),
+		_tree(shared._published.load()) {}
+	inline treereader_t(treereader_t<Tree>&& other) :
+		_shared(other._shared),
+		_slot(other._slot),
+		_tree(other._tree) { other._shared = 0; }
+	inline ~treereader_t() { if (this->_shared != 0) { this->_shared->leave(this->_slot); } }
+	
+	treereader_t(const treereader_t<Tree>& other) = delete;
+	treereader_t<Tree>& operator=(const treereader_t<Tree>& other) = delete;
+	
+	/// <summary>
+	/// Gets the snapshot.
+	/// </summary>
+	inline Tree& operator*() const { return *(this->_tree); }
+	/// <summary>
+	/// Gets the snapshot.
+	/// </summary>
+	inline Tree* operator->() const { return this->_tree; }
+	
+protected:
 	
-	treealloc_t<quadnode_t<T> > _registry;
+	treeshared_t<Tree>* _shared;
+	uint32_t _slot;
+	Tree* _tree;
 	
 };
 
-#include "quadtree.inl"
\ No newline at end of file
+#include "treeshared.inl"
\ No newline at end of file
@@ -1,154 +1,1862 @@
 #pragma once
 
-inline uint32_t tree_ring_by_index(const size_t index, const uint32_t stride)
+inline constexpr uint32_t tree_log2(const uint64_t value)
 {
-	float e = 0.0f;
-	size_t last = 0;
-	while (index >= (last += (size_t)pow((float)stride, e)))
+#if defined(__GNUC__) || defined(__clang__)
+	return value > 1 ? 63 - (uint32_t)__builtin_clzll(value) : 0;
+#else
+	uint32_t result = 0;
+	uint64_t rest = value;
+	for (uint32_t shift = 32; shift > 0; shift >>= 1)
 	{
-		e += 1.0f;
+		if (rest >= ((uint64_t)1 << shift))
+		{
+			rest >>= shift;
+			result += shift;
+		}
 	}
 	
-	return (uint32_t)e;
+	return result;
+#endif
 }
 
-inline uint32_t tree_branch_by_index(const size_t index, const uint32_t stride)
+inline constexpr uint32_t tree_ctz64(const uint64_t value)
 {
-	uint32_t i = index + 1;
-	float e = 0.0f;
-	size_t last = 0;
-	while (i > (last = (size_t)pow((float)stride, e)))
+#if defined(__GNUC__) || defined(__clang__)
+	return value != 0 ? (uint32_t)__builtin_ctzll(value) : 64;
+#else
+	uint32_t result = 0;
+	for (uint64_t rest = value; result < 64 && (rest & 1) == 0; rest >>= 1)
 	{
-		i -= last;
-		e += 1.0f;
+		result++;
 	}
 	
-	return i - 1;
+	return result;
+#endif
 }
 
-inline size_t tree_size(const uint32_t rings, const uint32_t stride)
+inline constexpr uint32_t tree_popcount64(const uint64_t value)
 {
-	size_t size = 0;
-	for (uint32_t i = 0; i < rings; i++)
+#if defined(__GNUC__) || defined(__clang__)
+	return (uint32_t)__builtin_popcountll(value);
+#else
+	uint64_t rest = value - ((value >> 1) & 0x5555555555555555ull);
+	rest = (rest & 0x3333333333333333ull) + ((rest >> 2) & 0x3333333333333333ull);
+	rest = (rest + (rest >> 4)) & 0x0f0f0f0f0f0f0f0full;
+	return (uint32_t)((rest * 0x0101010101010101ull) >> 56);
+#endif
+}
+
+inline uint64_t tree_atomic_or64(uint64_t* word, const uint64_t bits)
+{
+#if defined(__GNUC__) || defined(__clang__)
+	return __atomic_fetch_or(word, bits, __ATOMIC_ACQ_REL);
+#else
+	return (uint64_t)_InterlockedOr64((volatile long long*)word, (long long)bits);
+#endif
+}
+
+inline uint64_t tree_atomic_load64(const uint64_t* word)
+{
+#if defined(__GNUC__) || defined(__clang__)
+	return __atomic_load_n(word, __ATOMIC_ACQUIRE);
+#else
+	return *(const volatile uint64_t*)word;
+#endif
+}
+
+inline void tree_atomic_add(size_t* value, const size_t amount)
+{
+#if defined(__GNUC__) || defined(__clang__)
+	__atomic_fetch_add(value, amount, __ATOMIC_RELAXED);
+#else
+	_InterlockedExchangeAdd64((volatile long long*)value, (long long)amount);
+#endif
+}
+
+inline void* tree_atomic_load_pointer(void* const* slot)
+{
+#if defined(__GNUC__) || defined(__clang__)
+	return __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+#else
+	return *(void* const volatile*)slot;
+#endif
+}
+
+inline void* tree_atomic_install_pointer(void** slot, void* expected, void* desired)
+{
+#if defined(__GNUC__) || defined(__clang__)
+	void* current = expected;
+	return __atomic_compare_exchange_n(slot, &current, desired, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE) ? desired : current;
+#else
+	void* current = _InterlockedCompareExchangePointer(slot, desired, expected);
+	return current == expected ? desired : current;
+#endif
+}
+inline void tree_prefetch(const void* address)
+{
+#if defined(__GNUC__) || defined(__clang__)
+	__builtin_prefetch(address);
+#elif defined(TREE_SIMD_SSE2)
+	_mm_prefetch((const char*)address, _MM_HINT_T0);
+#endif
+}
+
+inline constexpr size_t tree_pow(const uint32_t exponent, const uint32_t stride)
+{
+	if ((stride & (stride - 1)) == 0)
+	{
+		if (stride == 0)
+		{
+			return exponent == 0 ? 1 : 0;
+		}
+		
+		// Widened so that a large exponent can't overflow the shift count itself.
+		const uint64_t shift = (uint64_t)tree_log2(stride) * exponent;
+		return shift < 64 ? (size_t)1 << shift : SIZE_MAX;
+	}
+	
+	size_t result = 1;
+	size_t base = stride;
+	for (uint32_t e = exponent; e > 0; e >>= 1)
 	{
-		size += (size_t)pow((float)stride, i);
+		if ((e & 1) != 0)
+		{
+			if (result > SIZE_MAX / base)
+			{
+				return SIZE_MAX;
+			}
+			
+			result *= base;
+		}
+		
+		if ((e >> 1) > 0)
+		{
+			if (base > SIZE_MAX / base)
+			{
+				return SIZE_MAX;
+			}
+			
+			base *= base;
+		}
 	}
 	
-	return size;
+	return result;
 }
 
-inline size_t tree_ring_length(const uint32_t ring, const uint32_t stride)
+inline constexpr uint32_t tree_ring_by_index(const size_t index, const uint32_t stride)
 {
-	return (size_t)pow((float)stride, (float)ring);
+	if (stride <= 1)
+	{
+		return (uint32_t)index;
+	}
+	
+	if ((stride & (stride - 1)) == 0 && index <= (SIZE_MAX - 1) / (stride - 1))
+	{
+		// The ring starts at (stride^ring - 1) / (stride - 1), so the ring is the
+		// whole number of stride digits in (stride - 1) * index + 1.
+		return tree_log2((stride - 1) * (uint64_t)index + 1) / tree_log2(stride);
+	}
+	
+	uint32_t ring = 0;
+	size_t rest = index;
+	size_t length = 1;
+	while (rest >= length)
+	{
+		rest -= length;
+		ring++;
+		if (length > rest / stride)
+		{
+			break;
+		}
+		
+		length *= stride;
+	}
+	
+	return ring;
 }
 
-inline size_t tree_index(const uint32_t ring, const uint32_t branch, const uint32_t stride)
+inline constexpr size_t tree_branch_by_index(const size_t index, const uint32_t stride)
 {
-	return (tree_ring_length(ring, stride) - 1) + (size_t)branch;
+	return index - tree_size(tree_ring_by_index(index, stride), stride);
 }
 
-template <typename T> inline void treealloc_t<T>::alloc(const uint32_t rings, const uint32_t stride)
+inline constexpr size_t tree_size(const uint32_t rings, const uint32_t stride)
 {
-	size_t size = tree_size(rings, stride);
-	size_t bytes = size * sizeof(T);
-	T* clean = (T*)calloc(size, sizeof(T));
-	if (this->_buffer != 0)
+	if (stride <= 1 || rings == 0)
 	{
-		memcpy(clean, this->_buffer, min(bytes, this->_bytes));
+		return stride == 1 ? rings : (rings > 0 ? 1 : 0);
 	}
 	
-	this->clear();
-	this->_buffer = clean;
-	this->_bytes = bytes;
+	if (rings > tree_max_rings(stride))
+	{
+		return SIZE_MAX;
+	}
+	
+	// Sum of the geometric series, written so that only stride^(rings - 1) has to fit.
+	return ((tree_pow(rings - 1, stride) - 1) / (stride - 1)) * stride + 1;
+}
+
+inline constexpr uint32_t tree_max_rings(const uint32_t stride)
+{
+	if (stride <= 1)
+	{
+		return TREE_MAX_RINGS;
+	}
+	
+	if ((stride & (stride - 1)) == 0)
+	{
+		// The last ring holds 2^(log2(stride) * (rings - 1)) elements, and the rings before it add up to less than that again.
+		return min(63 / tree_log2(stride) + 1, (uint32_t)TREE_MAX_RINGS);
+	}
+	
+	uint32_t rings = 1;
+	size_t length = 1;
+	size_t size = 1;
+	while (rings < TREE_MAX_RINGS && length <= (SIZE_MAX - size) / stride)
+	{
+		length *= stride;
+		size += length;
+		rings++;
+	}
+	
+	return rings;
+}
+
+inline constexpr size_t tree_ring_length(const uint32_t ring, const uint32_t stride)
+{
+	return tree_pow(ring, stride);
+}
+
+inline constexpr size_t tree_index(const uint32_t ring, const size_t branch, const uint32_t stride)
+{
+	return tree_size(ring, stride) + branch;
+}
+
+inline constexpr size_t tree_parent_index(const size_t index, const uint32_t stride)
+{
+	return (index - 1) / stride;
+}
+
+inline constexpr size_t tree_child_index(const size_t index, const uint32_t child, const uint32_t stride)
+{
+	return (index * stride) + 1 + child;
+}
+
+inline uint64_t tree_morton_spread(const uint32_t value)
+{
+	// Each step moves the upper half of every group of bits up by half the group's width, leaving a zero between each pair of bits.
+	uint64_t result = value;
+	result = (result | (result << 16)) & 0x0000ffff0000ffffull;
+	result = (result | (result << 8)) & 0x00ff00ff00ff00ffull;
+	result = (result | (result << 4)) & 0x0f0f0f0f0f0f0f0full;
+	result = (result | (result << 2)) & 0x3333333333333333ull;
+	result = (result | (result << 1)) & 0x5555555555555555ull;
+	return result;
+}
+inline uint32_t tree_morton_gather(const uint64_t value)
+{
+	uint64_t result = value & 0x5555555555555555ull;
+	result = (result | (result >> 1)) & 0x3333333333333333ull;
+	result = (result | (result >> 2)) & 0x0f0f0f0f0f0f0f0full;
+	result = (result | (result >> 4)) & 0x00ff00ff00ff00ffull;
+	result = (result | (result >> 8)) & 0x0000ffff0000ffffull;
+	result = (result | (result >> 16)) & 0x00000000ffffffffull;
+	return (uint32_t)result;
+}
+
+inline uint64_t tree_morton_encode(const uint32_t x, const uint32_t y)
+{
+#if defined(TREE_BMI2)
+	return _pdep_u64(x, 0x5555555555555555ull) | _pdep_u64(y, 0xaaaaaaaaaaaaaaaaull);
+#else
+	return tree_morton_spread(x) | (tree_morton_spread(y) << 1);
+#endif
+}
+inline void tree_morton_decode(const uint64_t code, uint32_t* x, uint32_t* y)
+{
+#if defined(TREE_BMI2)
+	*x = (uint32_t)_pext_u64(code, 0x5555555555555555ull);
+	*y = (uint32_t)_pext_u64(code, 0xaaaaaaaaaaaaaaaaull);
+#else
+	*x = tree_morton_gather(code);
+	*y = tree_morton_gather(code >> 1);
+#endif
+}
+
+inline void treeveb_t::build(const uint32_t rings, const uint32_t stride)
+{
+	// The top half of the tree comes first, then every bottom subtree in branch order, each laid out the same way.
+	this->_power = (stride & (stride - 1)) == 0;
+	for (uint32_t ring = 0; ring < rings && ring < TREE_MAX_RINGS; ring++)
+	{
+		uint32_t depth = ring;
+		uint32_t height = rings;
+		uint32_t count = 0;
+		while (height > 1)
+		{
+			uint32_t top = height >> 1;
+			if (depth < top)
+			{
+				height = top;
+				continue;
+			}
+			
+			depth -= top;
+			height -= top;
+			step_t& step = this->_steps[ring][count++];
+			step._shift = tree_log2(stride) * depth;
+			step._width = tree_pow(depth, stride);
+			step._base = tree_size(top, stride);
+			step._scale = tree_size(height, stride);
+		}
+		
+		this->_count[ring] = count;
+	}
+}
+inline size_t treeveb_t::offset(const uint32_t ring, const size_t branch) const
+{
+	size_t offset = 0;
+	size_t position = branch;
+	for (uint32_t i = 0; i < this->_count[ring]; i++)
+	{
+		const step_t& step = this->_steps[ring][i];
+		size_t subtree = this->_power ? position >> step._shift : position / step._width;
+		position -= subtree * step._width;
+		offset += step._base + (subtree * step._scale);
+	}
+	
+	return offset;
+}
+
+template <typename T, uint32_t Stride> inline bool treealloc_t<T, Stride>::alloc(const uint32_t rings, const uint32_t stride)
+{
+	const uint32_t step = Stride > 0 ? Stride : stride;
+	if (rings > tree_max_rings(step))
+	{
+		// Rings past the last one whose size fits in a size_t can't be addressed, so the tree stops growing there.
+		return this->alloc(tree_max_rings(step), stride);
+	}
+	
+	size_t size = tree_size(rings, step);
+	if (this->_stride != step)
+	{
+		this->clear();
+	}
+	
+	if (!this->detach())
+	{
+		return false;
+	}
+	
+	// Every block is allocated before anything is moved or given back, so a failed allocation leaves the tree as it was.
+	// Bitmaps and segments that were allocated before the failure stay with the tree, and are used the next time it grows.
+	T* clean = 0;
+	uint64_t* layout = 0;
+	treeveb_t* veb = 0;
+	if (this->_storage != TREE_STORAGE_SPARSE)
+	{
+		for (uint32_t i = 0; i < rings && i < TREE_MAX_RINGS; i++)
+		{
+			if (this->_occupancy[i] == 0 && (this->_occupancy[i] = (uint64_t*)this->allocate((tree_ring_length(i, step) + 63) >> 6, sizeof(uint64_t))) == 0)
+			{
+				return false;
+			}
+			
+			if (this->_storage == TREE_STORAGE_SEGMENTED && this->_segments[i] == 0 && (this->_segments[i] = (T*)this->allocate(tree_ring_length(i, step), sizeof(T))) == 0)
+			{
+				return false;
+			}
+		}
+		
+		if (this->_storage == TREE_STORAGE_VEB)
+		{
+			clean = (T*)this->allocate(size, sizeof(T));
+			layout = clean != 0 ? (uint64_t*)this->allocate((size + 63) >> 6, sizeof(uint64_t)) : 0;
+			veb = layout != 0 ? (treeveb_t*)this->allocate(1, sizeof(treeveb_t)) : 0;
+			if (veb == 0)
+			{
+				if (layout != 0)
+				{
+					this->deallocate(layout, (size + 63) >> 6, sizeof(uint64_t));
+				}
+				
+				if (clean != 0)
+				{
+					this->deallocate(clean, size, sizeof(T));
+				}
+				
+				return false;
+			}
+		}
+		else if (this->_storage == TREE_STORAGE_CONTIGUOUS && (clean = (T*)this->allocate(size, sizeof(T))) == 0)
+		{
+			return false;
+		}
+	}
+	
+	// Elements in the rings that are given back stop being counted.
+	for (uint32_t i = rings; i < this->_rings && i < TREE_MAX_RINGS && this->_capacity > 0; i++)
+	{
+		this->_count -= this->range(i, 0, tree_ring_length(i, step), false);
+	}
+	
+	if (this->_storage == TREE_STORAGE_SPARSE)
+	{
+		// Pages are only allocated when they are written, so only the rings that are given back are touched.
+		for (uint32_t i = rings; i < TREE_MAX_RINGS; i++)
+		{
+			if (this->_pages[i] != 0)
+			{
+				this->release(this->_pages[i], levels(tree_ring_length(i, step)));
+				this->_pages[i] = 0;
+			}
+		}
+		
+		this->_capacity = size;
+		this->_rings = rings;
+		this->_stride = step;
+		return true;
+	}
+	
+	if (this->_storage == TREE_STORAGE_SEGMENTED)
+	{
+		// Only the rings that are missing were allocated, the existing ones are left where they are.
+		for (uint32_t i = rings; i < TREE_MAX_RINGS; i++)
+		{
+			if (this->_segments[i] != 0)
+			{
+				this->deallocate(this->_segments[i], tree_ring_length(i, step), sizeof(T));
+				this->_segments[i] = 0;
+			}
+		}
+	}
+	else if (this->_storage == TREE_STORAGE_VEB)
+	{
+		// Every offset depends on the height of the tree, so the used elements are moved to their new places one at a time.
+		const uint32_t height = this->_capacity > 0 ? tree_ring_by_index(this->_capacity, step) : 0;
+		veb->build(rings, step);
+		for (uint32_t i = 0; i < rings && i < height && i < TREE_MAX_RINGS && this->_buffer != 0; i++)
+		{
+			const size_t words = (tree_ring_length(i, step) + 63) >> 6;
+			for (size_t word = 0; word < words; word++)
+			{
+				for (uint64_t mask = this->_occupancy[i][word]; mask != 0; mask &= mask - 1)
+				{
+					size_t branch = (word << 6) + tree_ctz64(mask);
+					size_t to = veb->offset(i, branch);
+					memcpy((void*)(clean + to), (const void*)(this->_buffer + this->_veb->offset(i, branch)), sizeof(T));
+					layout[to >> 6] |= (uint64_t)1 << (to & 63);
+				}
+			}
+		}
+		
+		if (this->_buffer != 0)
+		{
+			this->deallocate(this->_buffer, this->_capacity, sizeof(T));
+			this->deallocate(this->_layout, (this->_capacity + 63) >> 6, sizeof(uint64_t));
+			this->deallocate(this->_veb, 1, sizeof(treeveb_t));
+		}
+		
+		this->_buffer = clean;
+		this->_layout = layout;
+		this->_veb = veb;
+	}
+	else
+	{
+		if (this->_buffer != 0)
+		{
+			memcpy((void*)clean, (const void*)this->_buffer, sizeof(T) * min(size, this->_capacity));
+			this->deallocate(this->_buffer, this->_capacity, sizeof(T));
+		}
+		
+		this->_buffer = clean;
+	}
+	
+	// The occupancy bitmaps are kept per ring in both layouts, so growing never copies them.
+	for (uint32_t i = rings; i < TREE_MAX_RINGS; i++)
+	{
+		if (this->_occupancy[i] != 0)
+		{
+			this->deallocate(this->_occupancy[i], (tree_ring_length(i, step) + 63) >> 6, sizeof(uint64_t));
+			this->_occupancy[i] = 0;
+		}
+	}
+	
+	this->_capacity = size;
 	this->_rings = rings;
-	this->_stride = stride;
+	this->_stride = step;
+	return true;
 }
-template <typename T> inline void treealloc_t<T>::ensure(const uint32_t rings, const uint32_t stride)
+template <typename T, uint32_t Stride> inline bool treealloc_t<T, Stride>::ensure(const uint32_t rings, const uint32_t stride)
 {
-	if (this->_stride != stride)
+	if (Stride == 0 && this->_stride != stride)
 	{
 		this->clear();
 	}
 	
-	if (rings > this->_rings || this->_bytes < 1)
+	// The rings are only raised by alloc(), so that a tree that fails to grow keeps the rings it has.
+	const uint32_t fit = min(rings, tree_max_rings(Stride > 0 ? Stride : stride));
+	if (fit > this->_rings || this->_capacity < 1)
 	{
-		this->_rings = max(this->_rings, rings);
 		this->_stride = max(this->_stride, stride);
-		this->alloc(this->_rings, this->_stride);
+		return this->alloc(max(this->_rings, fit), this->stride());
 	}
+	
+	return true;
 }
 
-template <typename T> inline void treealloc_t<T>::clear()
+template <typename T, uint32_t Stride> inline void treealloc_t<T, Stride>::clear()
 {
+	if (this->_image != 0)
+	{
+		// The elements and the occupancy words of a mapped image belong to the mapping, so only the mapping is given back.
+		unmap(this->_image, this->_length);
+		this->_image = 0;
+		this->_length = 0;
+		this->_buffer = 0;
+		memset(this->_occupancy, 0, sizeof(this->_occupancy));
+	}
+	
 	if (this->_buffer != 0)
 	{
-		free(this->_buffer);
+		this->deallocate(this->_buffer, this->_capacity, sizeof(T));
+	}
+	
+	for (uint32_t i = 0; i < TREE_MAX_RINGS; i++)
+	{
+		if (this->_segments[i] != 0)
+		{
+			this->deallocate(this->_segments[i], tree_ring_length(i, this->stride()), sizeof(T));
+			this->_segments[i] = 0;
+		}
+		
+		if (this->_occupancy[i] != 0)
+		{
+			this->deallocate(this->_occupancy[i], (tree_ring_length(i, this->stride()) + 63) >> 6, sizeof(uint64_t));
+			this->_occupancy[i] = 0;
+		}
+		
+		if (this->_pages[i] != 0)
+		{
+			this->release(this->_pages[i], levels(tree_ring_length(i, this->stride())));
+			this->_pages[i] = 0;
+		}
+	}
+	
+	if (this->_layout != 0)
+	{
+		this->deallocate(this->_layout, (this->_capacity + 63) >> 6, sizeof(uint64_t));
+		this->deallocate(this->_veb, 1, sizeof(treeveb_t));
 	}
 	
 	this->_buffer = 0;
-	this->_bytes = 0;
+	this->_layout = 0;
+	this->_veb = 0;
+	this->_capacity = 0;
+	this->_count = 0;
+}
+template <typename T, uint32_t Stride> inline void treealloc_t<T, Stride>::zero()
+{
+	this->_count = 0;
+	if (this->_storage == TREE_STORAGE_SPARSE)
+	{
+		for (uint32_t i = 0; i < TREE_MAX_RINGS; i++)
+		{
+			if (this->_pages[i] != 0)
+			{
+				this->release(this->_pages[i], levels(tree_ring_length(i, this->stride())));
+				this->_pages[i] = 0;
+			}
+		}
+		
+		return;
+	}
+	
+	for (uint32_t i = 0; i < TREE_MAX_RINGS && this->_occupancy[i] != 0; i++)
+	{
+		memset(this->_occupancy[i], 0, sizeof(uint64_t) * ((tree_ring_length(i, this->stride()) + 63) >> 6));
+	}
+	
+	if (this->_storage == TREE_STORAGE_SEGMENTED)
+	{
+		for (uint32_t i = 0; i < TREE_MAX_RINGS && this->_segments[i] != 0; i++)
+		{
+			memset((void*)this->_segments[i], 0, sizeof(T) * tree_ring_length(i, this->stride()));
+		}
+		
+		return;
+	}
+	
+	if (this->_buffer != 0)
+	{
+		memset((void*)this->_buffer, 0, sizeof(T) * this->_capacity);
+	}
+	
+	if (this->_layout != 0)
+	{
+		memset(this->_layout, 0, sizeof(uint64_t) * ((this->_capacity + 63) >> 6));
+	}
+}
+
+template <typename T, uint32_t Stride> inline bool treealloc_t<T, Stride>::copy(const treealloc_t<T, Stride>& other)
+{
+	this->clear();
+	this->_storage = other._storage;
+	this->_stride = other._stride;
+	if (other._capacity == 0)
+	{
+		this->_rings = other._rings;
+		return true;
+	}
+	
+	if (!this->alloc(other._rings, other.stride()))
+	{
+		this->clear();
+		return false;
+	}
+	
+	// Only the blocks that have used elements are copied, so a sparse copy only touches the pages of the original.
+	const uint32_t stride = this->stride();
+	for (uint32_t ring = 0; ring < this->_rings && ring < TREE_MAX_RINGS; ring++)
+	{
+		const size_t length = tree_ring_length(ring, stride);
+		const size_t words = (length + 63) >> 6;
+		for (size_t block = other.next_block(ring, 0); block < words; block = other.next_block(ring, block + 1))
+		{
+			T* from = 0;
+			const uint64_t* bits = other.block(ring, block, &from);
+			if (*bits == 0)
+			{
+				continue;
+			}
+			
+			T* to = 0;
+			uint64_t* word = 0;
+			if (this->_storage == TREE_STORAGE_SPARSE)
+			{
+				treepage_t<T>* page = this->touch(ring, block);
+				if (page == 0)
+				{
+					this->clear();
+					return false;
+				}
+				
+				to = page->_elements;
+				word = &(page->_bits);
+			}
+			else
+			{
+				word = this->block(ring, block, &to);
+			}
+			
+			*word = *bits;
+			if (to != 0)
+			{
+				memcpy((void*)to, (const void*)from, sizeof(T) * min(length - (block << 6), (size_t)64));
+			}
+		}
+	}
+	
+	if (this->_storage == TREE_STORAGE_VEB)
+	{
+		// Both buffers have the same height, so the whole layout is copied as it is.
+		memcpy((void*)this->_buffer, (const void*)other._buffer, sizeof(T) * this->_capacity);
+		memcpy(this->_layout, other._layout, sizeof(uint64_t) * ((this->_capacity + 63) >> 6));
+	}
+	
+	this->_count = other._count;
+	return true;
+}
+
+template <typename T, uint32_t Stride> inline bool treealloc_t<T, Stride>::assign(const T* elements, const size_t count, const uint64_t* mask)
+{
+	const uint32_t stride = this->stride();
+	this->clear();
+	if (count == 0)
+	{
+		return true;
+	}
+	
+	if (!this->alloc(tree_ring_by_index(count - 1, stride) + 1, stride) || this->_capacity < count)
+	{
+		this->clear();
+		return false;
+	}
+	
+	for (uint32_t ring = 0; ring < this->_rings && ring < TREE_MAX_RINGS; ring++)
+	{
+		// Each block of the ring takes its occupancy word from the mask, which is shifted by where the ring starts.
+		const size_t first = tree_size(ring, stride);
+		const size_t length = min(tree_ring_length(ring, stride), count - first);
+		for (size_t block = 0; (block << 6) < length; block++)
+		{
+			const size_t start = first + (block << 6);
+			const size_t size = min(length - (block << 6), (size_t)64);
+			uint64_t bits = size < 64 ? ((uint64_t)1 << size) - 1 : ~(uint64_t)0;
+			if (mask != 0)
+			{
+				uint64_t window = mask[start >> 6] >> (start & 63);
+				if ((start & 63) != 0 && ((start >> 6) + 1) << 6 < count)
+				{
+					window |= mask[(start >> 6) + 1] << (64 - (start & 63));
+				}
+				
+				bits &= window;
+			}
+			
+			if (bits == 0)
+			{
+				continue;
+			}
+			
+			T* target = 0;
+			uint64_t* word = 0;
+			if (this->_storage == TREE_STORAGE_SPARSE)
+			{
+				treepage_t<T>* page = this->touch(ring, block);
+				if (page == 0)
+				{
+					this->clear();
+					return false;
+				}
+				
+				target = page->_elements;
+				word = &(page->_bits);
+			}
+			else
+			{
+				word = this->block(ring, block, &target);
+			}
+			
+			*word = bits;
+			this->_count += tree_popcount64(bits);
+			if (elements != 0 && target != 0)
+			{
+				memcpy((void*)target, (const void*)(elements + start), size * sizeof(T));
+			}
+			
+			if (this->_storage == TREE_STORAGE_VEB)
+			{
+				for (uint64_t rest = bits; rest != 0; rest &= rest - 1)
+				{
+					size_t branch = (block << 6) + tree_ctz64(rest);
+					size_t offset = this->_veb->offset(ring, branch);
+					this->_layout[offset >> 6] |= (uint64_t)1 << (offset & 63);
+					if (elements != 0)
+					{
+						memcpy((void*)(this->_buffer + offset), (const void*)(elements + first + branch), sizeof(T));
+					}
+				}
+			}
+		}
+	}
+	
+	return true;
+}
+
+template <typename T, uint32_t Stride> inline bool treealloc_t<T, Stride>::save(const char* path) const
+{
+	FILE* file = fopen(path, "wb");
+	if (file == 0)
+	{
+		return false;
+	}
+	
+	const uint32_t stride = this->stride();
+	const uint32_t rings = this->_capacity > 0 ? min(this->_rings, (uint32_t)TREE_MAX_RINGS) : 0;
+	size_t words = 0;
+	for (uint32_t ring = 0; ring < rings; ring++)
+	{
+		words += (tree_ring_length(ring, stride) + 63) >> 6;
+	}
+	
+	treeimage_t header;
+	memset(&header, 0, sizeof(treeimage_t));
+	memcpy(header._magic, "TREE", 4);
+	header._version = 1;
+	header._stride = stride;
+	header._rings = rings;
+	header._size = sizeof(T);
+	header._count = this->_count;
+	header._elements = 64;
+	header._occupancy = (header._elements + tree_size(rings, stride) * sizeof(T) + 63) & ~(uint64_t)63;
+	header._length = header._occupancy + words * sizeof(uint64_t);
+	
+	// Blocks without elements of their own, such as unwritten sparse pages, are written from a block of zeroes.
+	unsigned char padding[64];
+	memset(padding, 0, sizeof(padding));
+	T* scratch = (T*)calloc(64, sizeof(T));
+	bool written = scratch != 0 && fwrite(&header, sizeof(treeimage_t), 1, file) == 1 && fwrite(padding, header._elements - sizeof(treeimage_t), 1, file) == 1;
+	for (uint32_t ring = 0; ring < rings && written; ring++)
+	{
+		const size_t length = tree_ring_length(ring, stride);
+		for (size_t block = 0; (block << 6) < length && written; block++)
+		{
+			T* elements = 0;
+			const uint64_t* bits = this->block(ring, block, &elements);
+			if (elements == 0)
+			{
+				memset((void*)scratch, 0, 64 * sizeof(T));
+				if (bits != 0)
+				{
+					this->gather(ring, block, scratch);
+				}
+				
+				elements = scratch;
+			}
+			
+			written = fwrite(elements, sizeof(T), min(length - (block << 6), (size_t)64), file) == min(length - (block << 6), (size_t)64);
+		}
+	}
+	
+	const size_t gap = (size_t)(header._occupancy - header._elements - tree_size(rings, stride) * sizeof(T));
+	written = written && (gap == 0 || fwrite(padding, gap, 1, file) == 1);
+	for (uint32_t ring = 0; ring < rings && written; ring++)
+	{
+		const size_t length = tree_ring_length(ring, stride);
+		for (size_t block = 0; (block << 6) < length && written; block++)
+		{
+			T* elements = 0;
+			const uint64_t* bits = this->block(ring, block, &elements);
+			uint64_t word = bits != 0 ? *bits : 0;
+			written = fwrite(&word, sizeof(uint64_t), 1, file) == 1;
+		}
+	}
+	
+	free(scratch);
+	return fclose(file) == 0 && written;
+}
+template <typename T, uint32_t Stride> inline bool treealloc_t<T, Stride>::map(const char* path)
+{
+	this->clear();
+	void* image = 0;
+	size_t length = 0;
+#if defined(_WIN32)
+	HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+	
+	LARGE_INTEGER size;
+	if (GetFileSizeEx(file, &size) && (uint64_t)size.QuadPart >= sizeof(treeimage_t))
+	{
+		// A copy on write view keeps changes private, as MAP_PRIVATE does.
+		HANDLE mapping = CreateFileMappingA(file, 0, PAGE_WRITECOPY, 0, 0, 0);
+		if (mapping != 0)
+		{
+			image = MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+			length = (size_t)size.QuadPart;
+			CloseHandle(mapping);
+		}
+	}
+	
+	CloseHandle(file);
+#else
+	int file = ::open(path, O_RDONLY);
+	if (file < 0)
+	{
+		return false;
+	}
+	
+	struct stat info;
+	if (fstat(file, &info) == 0 && (uint64_t)info.st_size >= sizeof(treeimage_t))
+	{
+		image = mmap(0, (size_t)info.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, file, 0);
+		image = image != MAP_FAILED ? image : 0;
+		length = (size_t)info.st_size;
+	}
+	
+	::close(file);
+#endif
+	if (image == 0)
+	{
+		return false;
+	}
+	
+	// The header is checked against this tree buffer's element type and stride, and every offset against the length of the file.
+	// Each region is compared against what is left of the image after its start, so that no offset plus a size can wrap around.
+	const treeimage_t* header = (const treeimage_t*)image;
+	const uint32_t stride = Stride > 0 ? Stride : header->_stride;
+	bool valid = memcmp(header->_magic, "TREE", 4) == 0 && header->_version == 1 && header->_stride == stride && stride > 0 && header->_size == sizeof(T) && header->_rings <= tree_max_rings(stride);
+	const size_t nodes = valid ? tree_size(header->_rings, stride) : 0;
+	size_t words = 0;
+	for (uint32_t ring = 0; valid && ring < header->_rings; ring++)
+	{
+		words += (tree_ring_length(ring, stride) + 63) >> 6;
+	}
+	
+	valid = valid && header->_length <= length && header->_elements >= sizeof(treeimage_t) && (header->_elements & 63) == 0 && header->_elements <= header->_occupancy;
+	valid = valid && nodes <= (header->_occupancy - header->_elements) / sizeof(T);
+	valid = valid && (header->_occupancy & 7) == 0 && header->_occupancy <= header->_length && (header->_length - header->_occupancy) / sizeof(uint64_t) == words && (header->_length - header->_occupancy) % sizeof(uint64_t) == 0;
+	
+	// The count has to match the occupancy bits, and no bit may be set past the end of its ring, as nothing else bounds a walk.
+	const uint64_t* bits = valid ? (const uint64_t*)((const unsigned char*)image + header->_occupancy) : 0;
+	uint64_t used = 0;
+	for (uint32_t ring = 0; valid && ring < header->_rings; ring++)
+	{
+		const size_t width = tree_ring_length(ring, stride);
+		const size_t count = (width + 63) >> 6;
+		for (size_t word = 0; word < count; word++)
+		{
+			used += tree_popcount64(bits[word]);
+		}
+		
+		valid = (width & 63) == 0 || (bits[count - 1] >> (width & 63)) == 0;
+		bits += count;
+	}
+	
+	valid = valid && used == header->_count;
+	if (!valid)
+	{
+		unmap(image, length);
+		return false;
+	}
+	
+	this->_image = image;
+	this->_length = length;
+	this->_storage = TREE_STORAGE_CONTIGUOUS;
+	this->_stride = stride;
+	this->_rings = header->_rings;
+	this->_capacity = tree_size(header->_rings, stride);
+	this->_count = (size_t)header->_count;
+	this->_buffer = (T*)((unsigned char*)image + header->_elements);
+	uint64_t* occupancy = (uint64_t*)((unsigned char*)image + header->_occupancy);
+	for (uint32_t ring = 0; ring < this->_rings; ring++)
+	{
+		this->_occupancy[ring] = occupancy;
+		occupancy += (tree_ring_length(ring, stride) + 63) >> 6;
+	}
+	
+	return true;
+}
+
+template <typename T, uint32_t Stride> template <typename W> inline bool treealloc_t<T, Stride>::write(W sink) const
+{
+	const uint32_t stride = this->stride();
+	treestream_t header;
+	memset(&header, 0, sizeof(treestream_t));
+	memcpy(header._magic, "TRES", 4);
+	header._version = 1;
+	header._stride = stride;
+	header._rings = this->_capacity > 0 ? min(this->_rings, (uint32_t)TREE_MAX_RINGS) : 0;
+	header._size = sizeof(T);
+	header._count = this->_count;
+	if (!sink((const void*)&header, sizeof(treestream_t)))
+	{
+		return false;
+	}
+	
+	// A record is at most a ten byte number, the occupancy word and 64 elements, which is all the memory the writer holds.
+	unsigned char* record = (unsigned char*)malloc(10 + sizeof(uint64_t) + 64 * sizeof(T));
+	bool written = record != 0;
+	for (uint32_t ring = 0; ring < header._rings && written; ring++)
+	{
+		const size_t words = (tree_ring_length(ring, stride) + 63) >> 6;
+		size_t previous = 0;
+		for (size_t block = this->next_block(ring, 0); block < words && written; block = this->next_block(ring, block + 1))
+		{
+			T* elements = 0;
+			const uint64_t bits = *(this->block(ring, block, &elements));
+			if (bits == 0)
+			{
+				continue;
+			}
+			
+			size_t length = 0;
+			for (uint64_t distance = block + 1 - previous; ; distance >>= 7)
+			{
+				record[length++] = (unsigned char)((distance & 127) | (distance >= 128 ? 128 : 0));
+				if (distance < 128)
+				{
+					break;
+				}
+			}
+			
+			memcpy(record + length, &bits, sizeof(uint64_t));
+			length += sizeof(uint64_t);
+			if (bits == ~(uint64_t)0 && elements != 0)
+			{
+				// A full block is already packed, so it goes to the sink as it is.
+				written = sink((const void*)record, length) && sink((const void*)elements, 64 * sizeof(T));
+				previous = block + 1;
+				continue;
+			}
+			
+			for (uint64_t rest = bits; rest != 0; rest &= rest - 1)
+			{
+				const size_t branch = (block << 6) + tree_ctz64(rest);
+				memcpy(record + length, (const void*)(elements != 0 ? elements + (branch & 63) : this->locate(ring, branch)), sizeof(T));
+				length += sizeof(T);
+			}
+			
+			written = sink((const void*)record, length);
+			previous = block + 1;
+		}
+		
+		const unsigned char end = 0;
+		written = written && sink((const void*)&end, 1);
+	}
+	
+	free(record);
+	return written;
+}
+template <typename T, uint32_t Stride> template <typename R> inline bool treealloc_t<T, Stride>::read(R source)
+{
+	this->clear();
+	treestream_t header;
+	const uint32_t stride = this->stride();
+	if (!source((void*)&header, sizeof(treestream_t)) || memcmp(header._magic, "TRES", 4) != 0 || header._version != 1 || header._stride != stride || header._size != sizeof(T) || header._rings > tree_max_rings(stride))
+	{
+		return false;
+	}
+	
+	// The rings are only grown as their records arrive, so a header can't make the tree allocate more than the stream holds.
+	T* scratch = (T*)malloc(64 * sizeof(T));
+	bool valid = scratch != 0;
+	for (uint32_t ring = 0; ring < header._rings && valid; ring++)
+	{
+		const size_t length = tree_ring_length(ring, stride);
+		const size_t words = (length + 63) >> 6;
+		size_t block = 0;
+		while (valid)
+		{
+			uint64_t distance = 0;
+			unsigned char byte = 128;
+			for (uint32_t shift = 0; (byte & 128) != 0 && valid; shift += 7)
+			{
+				valid = shift < 64 && source((void*)&byte, 1);
+				distance |= (uint64_t)(byte & 127) << (shift & 63);
+			}
+			
+			if (!valid || distance == 0)
+			{
+				break;
+			}
+			
+			// The distance is checked against the blocks left in the ring before it is added, so a large one can't wrap around.
+			uint64_t bits = 0;
+			valid = distance - 1 < words - block;
+			block += valid ? distance - 1 : 0;
+			valid = valid && source((void*)&bits, sizeof(uint64_t)) && bits != 0 && (length - (block << 6) >= 64 || (bits >> (length - (block << 6))) == 0);
+			valid = valid && this->ensure(ring + 1, stride);
+			if (!valid)
+			{
+				break;
+			}
+			
+			// Full blocks of a ring that is contiguous in memory are read in place, the others are spread out from a packed copy.
+			T* elements = 0;
+			uint64_t* word = 0;
+			if (this->_storage == TREE_STORAGE_SPARSE)
+			{
+				treepage_t<T>* page = this->touch(ring, block);
+				if (page == 0)
+				{
+					valid = false;
+					break;
+				}
+				
+				elements = page->_elements;
+				word = &(page->_bits);
+			}
+			else
+			{
+				word = this->block(ring, block, &elements);
+			}
+			
+			const size_t count = tree_popcount64(bits);
+			if (bits == ~(uint64_t)0 && elements != 0)
+			{
+				valid = source((void*)elements, 64 * sizeof(T));
+			}
+			else if ((valid = source((void*)scratch, count * sizeof(T))))
+			{
+				size_t packed = 0;
+				for (uint64_t rest = bits; rest != 0; rest &= rest - 1)
+				{
+					const size_t branch = (block << 6) + tree_ctz64(rest);
+					memcpy((void*)(elements != 0 ? elements + (branch & 63) : this->locate(ring, branch)), (const void*)(scratch + packed++), sizeof(T));
+				}
+			}
+			
+			*word = bits;
+			this->_count += count;
+			if (this->_storage == TREE_STORAGE_VEB)
+			{
+				for (uint64_t rest = bits; rest != 0; rest &= rest - 1)
+				{
+					size_t offset = this->_veb->offset(ring, (block << 6) + tree_ctz64(rest));
+					this->_layout[offset >> 6] |= (uint64_t)1 << (offset & 63);
+				}
+			}
+			
+			block++;
+		}
+	}
+	
+	free(scratch);
+	if (!valid || this->_count != header._count)
+	{
+		this->clear();
+		return false;
+	}
+	
+	return true;
+}
+
+template <typename T, uint32_t Stride> inline void treealloc_t<T, Stride>::remove(const size_t index)
+{
+	if (index >= this->capacity())
+	{
+		return;
+	}
+	
+	const uint32_t stride = this->stride();
+	uint32_t ring = tree_ring_by_index(index, stride);
+	size_t branch = tree_branch_by_index(index, stride);
+	for (uint32_t i = ring; i < this->_rings && i < TREE_MAX_RINGS; i++)
+	{
+		size_t length = tree_ring_length(i - ring, stride);
+		this->_count -= this->range(i, branch, branch + length, true);
+		branch = branch * stride;
+	}
+}
+template <typename T, uint32_t Stride> inline size_t treealloc_t<T, Stride>::count(const size_t index) const
+{
+	if (index >= this->capacity())
+	{
+		return 0;
+	}
+	
+	const uint32_t stride = this->stride();
+	uint32_t ring = tree_ring_by_index(index, stride);
+	size_t branch = tree_branch_by_index(index, stride);
+	size_t result = 0;
+	for (uint32_t i = ring; i < this->_rings && i < TREE_MAX_RINGS; i++)
+	{
+		size_t length = tree_ring_length(i - ring, stride);
+		result += this->range(i, branch, branch + length, false);
+		branch = branch * stride;
+	}
+	
+	return result;
+}
+
+template <typename T, uint32_t Stride> inline bool treealloc_t<T, Stride>::occupy(const size_t index)
+{
+	if (index >= this->capacity() && (!this->ensure(tree_ring_by_index(index, this->stride()) + 1, this->stride()) || index >= this->capacity()))
+	{
+		return false;
+	}
+	
+	uint32_t ring = tree_ring_by_index(index, this->stride());
+	size_t branch = index - tree_size(ring, this->stride());
+	treepage_t<T>* page = this->_storage == TREE_STORAGE_SPARSE ? this->touch(ring, branch >> 6) : 0;
+	if (this->_storage == TREE_STORAGE_SPARSE && page == 0)
+	{
+		return false;
+	}
+	
+	uint64_t& word = page != 0 ? page->_bits : this->_occupancy[ring][branch >> 6];
+	uint64_t bit = (uint64_t)1 << (branch & 63);
+	this->_count += (word & bit) == 0 ? 1 : 0;
+	word |= bit;
+	if (this->_storage == TREE_STORAGE_VEB)
+	{
+		size_t offset = this->_veb->offset(ring, branch);
+		this->_layout[offset >> 6] |= (uint64_t)1 << (offset & 63);
+	}
+	
+	return true;
+}
+template <typename T, uint32_t Stride> inline T* treealloc_t<T, Stride>::claim(const size_t index)
+{
+	uint32_t ring = tree_ring_by_index(index, this->stride());
+	if (index >= this->_capacity || ring >= TREE_MAX_RINGS)
+	{
+		return 0;
+	}
+	
+	size_t branch = index - tree_size(ring, this->stride());
+	T* elements = 0;
+	uint64_t* word = 0;
+	if (this->_storage == TREE_STORAGE_SPARSE)
+	{
+		treepage_t<T>* page = this->touch(ring, branch >> 6);
+		if (page == 0)
+		{
+			return 0;
+		}
+		
+		elements = page->_elements;
+		word = &(page->_bits);
+	}
+	else
+	{
+		word = this->block(ring, branch >> 6, &elements);
+	}
+	
+	// Siblings share an occupancy word, so the bit is set atomically and only the thread that flipped it owns the element.
+	uint64_t bit = (uint64_t)1 << (branch & 63);
+	if ((tree_atomic_or64(word, bit) & bit) != 0)
+	{
+		return 0;
+	}
+	
+	tree_atomic_add(&(this->_count), 1);
+	if (this->_storage == TREE_STORAGE_VEB)
+	{
+		size_t offset = this->_veb->offset(ring, branch);
+		tree_atomic_or64(this->_layout + (offset >> 6), (uint64_t)1 << (offset & 63));
+		return this->_buffer + offset;
+	}
+	
+	return elements + (branch & 63);
+}
+template <typename T, uint32_t Stride> inline bool treealloc_t<T, Stride>::occupied(const size_t index) const
+{
+	if (index >= this->capacity())
+	{
+		return false;
+	}
+	
+	uint32_t ring = tree_ring_by_index(index, this->stride());
+	size_t branch = index - tree_size(ring, this->stride());
+	if (ring >= TREE_MAX_RINGS)
+	{
+		return false;
+	}
+	
+	if (this->_storage == TREE_STORAGE_VEB)
+	{
+		// The layout's own bitmap keeps the check next to the node, instead of in the ring's bitmap.
+		size_t offset = this->_veb->offset(ring, branch);
+		return (tree_atomic_load64(this->_layout + (offset >> 6)) & ((uint64_t)1 << (offset & 63))) != 0;
+	}
+	
+	T* elements = 0;
+	const uint64_t* word = this->block(ring, branch >> 6, &elements);
+	return word != 0 && (tree_atomic_load64(word) & ((uint64_t)1 << (branch & 63))) != 0;
+}
+template <typename T, uint32_t Stride> inline bool treealloc_t<T, Stride>::occupied(const uint32_t ring, const size_t branch) const
+{
+	if (ring >= TREE_MAX_RINGS || branch >= tree_ring_length(ring, this->stride()) || tree_index(ring, branch, this->stride()) >= this->capacity())
+	{
+		return false;
+	}
+	
+	if (this->_storage == TREE_STORAGE_VEB)
+	{
+		size_t offset = this->_veb->offset(ring, branch);
+		return (tree_atomic_load64(this->_layout + (offset >> 6)) & ((uint64_t)1 << (offset & 63))) != 0;
+	}
+	
+	T* elements = 0;
+	const uint64_t* word = this->block(ring, branch >> 6, &elements);
+	return word != 0 && (tree_atomic_load64(word) & ((uint64_t)1 << (branch & 63))) != 0;
+}
+template <typename T, uint32_t Stride> inline size_t treealloc_t<T, Stride>::next(const size_t index) const
+{
+	const uint32_t stride = this->stride();
+	const size_t capacity = this->capacity();
+	if (index >= capacity)
+	{
+		return capacity;
+	}
+	
+	uint32_t ring = tree_ring_by_index(index, stride);
+	size_t branch = index - tree_size(ring, stride);
+	for (; ring < this->_rings && ring < TREE_MAX_RINGS; ring++, branch = 0)
+	{
+		size_t words = (tree_ring_length(ring, stride) + 63) >> 6;
+		for (size_t word = this->next_block(ring, branch >> 6); word < words; word = this->next_block(ring, word + 1))
+		{
+			T* elements = 0;
+			uint64_t mask = *(this->block(ring, word, &elements)) & (word == (branch >> 6) ? ~(uint64_t)0 << (branch & 63) : ~(uint64_t)0);
+			if (mask != 0)
+			{
+				return tree_size(ring, stride) + (word << 6) + tree_ctz64(mask);
+			}
+		}
+	}
+	
+	return capacity;
+}
+
+template <typename T, uint32_t Stride> inline uint64_t* treealloc_t<T, Stride>::block(const uint32_t ring, const size_t block, T** elements) const
+{
+	if (this->_storage == TREE_STORAGE_SPARSE)
+	{
+		treepage_t<T>* page = this->page(ring, block);
+		if (page == 0)
+		{
+			return 0;
+		}
+		
+		*elements = page->_elements;
+		return &(page->_bits);
+	}
+	
+	*elements = this->_storage != TREE_STORAGE_VEB ? this->ring(ring) + (block << 6) : 0;
+	return this->_occupancy[ring] + block;
+}
+template <typename T, uint32_t Stride> inline T* treealloc_t<T, Stride>::locate(const uint32_t ring, const size_t branch) const
+{
+	if (this->_storage == TREE_STORAGE_SPARSE)
+	{
+		treepage_t<T>* page = this->page(ring, branch >> 6);
+		return page != 0 ? page->_elements + (branch & 63) : 0;
+	}
+	else if (this->_storage == TREE_STORAGE_VEB)
+	{
+		return this->_buffer + this->_veb->offset(ring, branch);
+	}
+	
+	return this->ring(ring) + branch;
+}
+template <typename T, uint32_t Stride> inline void treealloc_t<T, Stride>::gather(const uint32_t ring, const size_t block, T* elements) const
+{
+	T* from = 0;
+	const uint64_t* word = this->block(ring, block, &from);
+	for (uint64_t mask = word != 0 ? *word : 0; mask != 0; mask &= mask - 1)
+	{
+		uint32_t i = tree_ctz64(mask);
+		memcpy((void*)(elements + i), (const void*)(from != 0 ? from + i : this->locate(ring, (block << 6) + i)), sizeof(T));
+	}
+}
+template <typename T, uint32_t Stride> inline size_t treealloc_t<T, Stride>::next_block(const uint32_t ring, const size_t block) const
+{
+	if (this->_storage == TREE_STORAGE_SPARSE)
+	{
+		const size_t length = tree_ring_length(ring, this->stride());
+		size_t found = seek(this->_pages[ring], levels(length), block);
+		return min(found, (length + 63) >> 6);
+	}
+	
+	return block;
+}
+
+template <typename T, uint32_t Stride> template <typename F> inline void treealloc_t<T, Stride>::sweep(const uint32_t first, const uint32_t last, F function)
+{
+	const uint32_t stride = this->stride();
+	for (uint32_t ring = first; ring < last && ring < this->_rings && ring < TREE_MAX_RINGS && this->_capacity > 0; ring++)
+	{
+		const size_t words = (tree_ring_length(ring, stride) + 63) >> 6;
+		for (size_t block = this->next_block(ring, 0); block < words; block = this->next_block(ring, block + 1))
+		{
+			T* elements = 0;
+			uint64_t mask = *(this->block(ring, block, &elements));
+			if (elements == 0)
+			{
+				for (; mask != 0; mask &= mask - 1)
+				{
+					function(*this->locate(ring, (block << 6) + tree_ctz64(mask)));
+				}
+				
+				continue;
+			}
+			
+			if (mask == ~(uint64_t)0)
+			{
+				// A full block is a plain loop, which the compiler can unroll or vectorize.
+				for (uint32_t i = 0; i < 64; i++)
+				{
+					function(elements[i]);
+				}
+				
+				continue;
+			}
+			
+			for (; mask != 0; mask &= mask - 1)
+			{
+				function(elements[tree_ctz64(mask)]);
+			}
+		}
+	}
+}
+
+template <typename T, uint32_t Stride> template <typename F> inline void treealloc_t<T, Stride>::descend(const uint32_t ring, const size_t branch, const uint32_t last, F function)
+{
+	static_assert(Stride != 0, "descend needs a compile-time stride");
+	
+	// An explicit stack replaces recursion, each entry keeps its ring and branch so that no index has to be decoded.
+	const uint32_t stride = this->stride();
+	uint32_t rings[TREE_MAX_RINGS * (Stride - 1) + 1];
+	size_t branches[TREE_MAX_RINGS * (Stride - 1) + 1];
+	uint32_t top = 0;
+	rings[0] = ring;
+	branches[0] = branch;
+	top++;
+	while (top > 0)
+	{
+		top--;
+		const uint32_t current = rings[top];
+		const size_t offset = branches[top];
+		if (current >= last || current >= this->_rings || current >= TREE_MAX_RINGS)
+		{
+			continue;
+		}
+		
+		T* elements = 0;
+		const uint64_t* word = this->block(current, offset >> 6, &elements);
+		if (word == 0 || (*word & ((uint64_t)1 << (offset & 63))) == 0)
+		{
+			continue;
+		}
+		
+		if (function(elements != 0 ? elements[offset & 63] : *this->locate(current, offset)) == 0)
+		{
+			return;
+		}
+		
+		for (uint32_t k = 0; k < stride; k++)
+		{
+			rings[top] = current + 1;
+			branches[top] = (offset * stride) + (stride == 2 ? k : stride - 1 - k);
+			top++;
+		}
+	}
+}
+template <typename T, uint32_t Stride> template <typename F> inline void treealloc_t<T, Stride>::paths(const size_t count, F function)
+{
+	// The paths in flight take turns, a step each. A path that ends hands its place to the next path that has not started,
+	// so the group stays full until the last paths. Each path keeps its ring and branch, and the rings that are contiguous
+	// are read through their first element, so a step is a bit test and a load.
+	const uint32_t stride = this->stride();
+	const uint32_t rings = this->_capacity > 0 ? min(this->_rings, (uint32_t)TREE_MAX_RINGS) : 0;
+	T* starts[TREE_MAX_RINGS];
+	for (uint32_t ring = 0; ring < rings; ring++)
+	{
+		starts[ring] = this->ring(ring);
+	}
+	
+	const size_t group = 16;
+	size_t queries[group];
+	uint32_t levels[group];
+	size_t branches[group];
+	size_t places[group];
+	size_t active = 0;
+	size_t started = 0;
+	for (; active < group && started < count; active++)
+	{
+		queries[active] = started++;
+		levels[active] = 0;
+		branches[active] = 0;
+		places[active] = 0;
+	}
+	
+	this->prefetch(0, 0);
+	while (active > 0)
+	{
+		for (size_t slot = 0; slot < active;)
+		{
+			const uint32_t ring = levels[slot];
+			const size_t branch = branches[slot];
+			T* element = 0;
+			if (ring < rings)
+			{
+				if (starts[ring] != 0)
+				{
+					element = (this->_occupancy[ring][branch >> 6] & ((uint64_t)1 << (branch & 63))) != 0 ? starts[ring] + branch : 0;
+				}
+				else if (this->_storage == TREE_STORAGE_VEB)
+				{
+					const size_t offset = places[slot];
+					element = (this->_layout[offset >> 6] & ((uint64_t)1 << (offset & 63))) != 0 ? this->_buffer + offset : 0;
+				}
+				else if (this->occupied(tree_index(ring, branch, stride)))
+				{
+					element = this->locate(ring, branch);
+				}
+			}
+			
+			int32_t child = element != 0 ? function(queries[slot], *element) : -1;
+			if (child >= 0 && (uint32_t)child < stride)
+			{
+				levels[slot] = ring + 1;
+				branches[slot] = branch * stride + (uint32_t)child;
+				if (this->_storage == TREE_STORAGE_VEB && ring + 1 < rings)
+				{
+					// The offset is kept for the next step, as it costs more than the rest of the step.
+					places[slot] = this->_veb->offset(ring + 1, branches[slot]);
+					tree_prefetch(this->_layout + (places[slot] >> 6));
+					tree_prefetch(this->_buffer + places[slot]);
+				}
+				else
+				{
+					this->prefetch(ring + 1, branches[slot]);
+				}
+				
+				slot++;
+			}
+			else if (started < count)
+			{
+				queries[slot] = started++;
+				levels[slot] = 0;
+				branches[slot] = 0;
+				places[slot] = 0;
+				slot++;
+			}
+			else
+			{
+				active--;
+				queries[slot] = queries[active];
+				levels[slot] = levels[active];
+				branches[slot] = branches[active];
+				places[slot] = places[active];
+			}
+		}
+	}
+}
+
+template <typename T, uint32_t Stride> inline size_t treealloc_t<T, Stride>::range(const uint32_t ring, const size_t first, const size_t last, const bool clear) const
+{
+	size_t result = 0;
+	for (size_t block = this->next_block(ring, first >> 6); (block << 6) < last; block = this->next_block(ring, block + 1))
+	{
+		T* elements = 0;
+		uint64_t* word = this->block(ring, block, &elements);
+		size_t from = max(first, block << 6);
+		size_t count = min(last, (block + 1) << 6) - from;
+		uint64_t mask = (count == 64 ? ~(uint64_t)0 : (((uint64_t)1 << count) - 1)) << (from & 63);
+		result += tree_popcount64(*word & mask);
+		if (clear && elements == 0)
+		{
+			// Elements that are not contiguous are cleared one at a time, along with their bit in the layout's bitmap.
+			for (uint64_t used = *word & mask; used != 0; used &= used - 1)
+			{
+				size_t branch = (block << 6) + tree_ctz64(used);
+				size_t offset = this->_veb->offset(ring, branch);
+				this->_layout[offset >> 6] &= ~((uint64_t)1 << (offset & 63));
+				memset((void*)(this->_buffer + offset), 0, sizeof(T));
+			}
+			
+			*word &= ~mask;
+		}
+		else if (clear)
+		{
+			*word &= ~mask;
+			memset((void*)(elements + (from & 63)), 0, sizeof(T) * count);
+		}
+	}
+	
+	return result;
+}
+template <typename T, uint32_t Stride> inline treepage_t<T>* treealloc_t<T, Stride>::page(const uint32_t ring, const size_t block) const
+{
+	void* node = tree_atomic_load_pointer(&(this->_pages[ring]));
+	for (uint32_t level = levels(tree_ring_length(ring, this->stride())); level > 0 && node != 0; level--)
+	{
+		node = tree_atomic_load_pointer(&(((void**)node)[(block >> (6 * (level - 1))) & 63]));
+	}
+	
+	return (treepage_t<T>*)node;
+}
+template <typename T, uint32_t Stride> inline void treealloc_t<T, Stride>::prefetch(const uint32_t ring, const size_t branch) const
+{
+	if (this->_capacity == 0 || ring >= this->_rings || ring >= TREE_MAX_RINGS)
+	{
+		return;
+	}
+	
+	if (this->_storage == TREE_STORAGE_SPARSE)
+	{
+		treepage_t<T>* page = this->page(ring, branch >> 6);
+		if (page != 0)
+		{
+			tree_prefetch(&(page->_bits));
+			tree_prefetch(page->_elements + (branch & 63));
+		}
+	}
+	else if (this->_storage == TREE_STORAGE_VEB)
+	{
+		size_t offset = this->_veb->offset(ring, branch);
+		tree_prefetch(this->_layout + (offset >> 6));
+		tree_prefetch(this->_buffer + offset);
+	}
+	else
+	{
+		tree_prefetch(this->_occupancy[ring] + (branch >> 6));
+		tree_prefetch(this->ring(ring) + branch);
+	}
+}
+template <typename T, uint32_t Stride> inline treepage_t<T>* treealloc_t<T, Stride>::touch(const uint32_t ring, const size_t block)
+{
+	// Tables and pages are installed with a compare and swap, so that threads claiming elements can touch pages at the same time.
+	void** slot = &(this->_pages[ring]);
+	for (uint32_t level = levels(tree_ring_length(ring, this->stride())); level > 0; level--)
+	{
+		void* table = tree_atomic_load_pointer(slot);
+		if (table == 0)
+		{
+			void* created = this->allocate(64, sizeof(void*));
+			if (created == 0)
+			{
+				return 0;
+			}
+			
+			table = tree_atomic_install_pointer(slot, 0, created);
+			if (table != created)
+			{
+				this->deallocate(created, 64, sizeof(void*));
+			}
+		}
+		
+		slot = &(((void**)table)[(block >> (6 * (level - 1))) & 63]);
+	}
+	
+	void* page = tree_atomic_load_pointer(slot);
+	if (page == 0)
+	{
+		void* created = this->allocate(1, sizeof(treepage_t<T>));
+		if (created == 0)
+		{
+			return 0;
+		}
+		
+		page = tree_atomic_install_pointer(slot, 0, created);
+		if (page != created)
+		{
+			this->deallocate(created, 1, sizeof(treepage_t<T>));
+		}
+	}
+	
+	return (treepage_t<T>*)page;
+}
+
+template <typename T, uint32_t Stride> inline bool treealloc_t<T, Stride>::detach()
+{
+	if (this->_image == 0)
+	{
+		return true;
+	}
+	
+	// The image is copied into heap memory, after which the tree buffer is like any other contiguous one. Every block is
+	// allocated before the first one replaces a pointer into the image, so the tree stays mapped if one of them fails.
+	const uint32_t rings = min(this->_rings, (uint32_t)TREE_MAX_RINGS);
+	uint64_t* occupancy[TREE_MAX_RINGS];
+	T* buffer = (T*)this->allocate(this->_capacity, sizeof(T));
+	bool failed = buffer == 0;
+	for (uint32_t ring = 0; ring < rings; ring++)
+	{
+		occupancy[ring] = failed ? 0 : (uint64_t*)this->allocate((tree_ring_length(ring, this->stride()) + 63) >> 6, sizeof(uint64_t));
+		failed = failed || occupancy[ring] == 0;
+	}
+	
+	if (failed)
+	{
+		for (uint32_t ring = 0; ring < rings && occupancy[ring] != 0; ring++)
+		{
+			this->deallocate(occupancy[ring], (tree_ring_length(ring, this->stride()) + 63) >> 6, sizeof(uint64_t));
+		}
+		
+		if (buffer != 0)
+		{
+			this->deallocate(buffer, this->_capacity, sizeof(T));
+		}
+		
+		return false;
+	}
+	
+	memcpy((void*)buffer, (const void*)this->_buffer, this->_capacity * sizeof(T));
+	for (uint32_t ring = 0; ring < rings; ring++)
+	{
+		memcpy(occupancy[ring], this->_occupancy[ring], ((tree_ring_length(ring, this->stride()) + 63) >> 6) * sizeof(uint64_t));
+		this->_occupancy[ring] = occupancy[ring];
+	}
+	
+	unmap(this->_image, this->_length);
+	this->_image = 0;
+	this->_length = 0;
+	this->_buffer = buffer;
+	return true;
 }
-template <typename T> inline void treealloc_t<T>::zero()
+
+template <typename T, uint32_t Stride> inline uint32_t treealloc_t<T, Stride>::levels(const size_t length)
 {
-	memset(this->_buffer, 0, this->_bytes);
+	// Each level of the radix table picks one of 64 slots, the last level points at the pages themselves.
+	uint32_t result = 0;
+	for (size_t blocks = (length + 63) >> 6; blocks > 1; blocks = (blocks + 63) >> 6)
+	{
+		result++;
+	}
+	
+	return result;
+}
+template <typename T, uint32_t Stride> inline size_t treealloc_t<T, Stride>::seek(const void* node, const uint32_t level, const size_t block)
+{
+	// The block is relative to the node, and the span of the node is given back when none of its pages are at or after it.
+	if (level == 0)
+	{
+		return node != 0 && block == 0 ? 0 : 1;
+	}
+	
+	const size_t span = (size_t)1 << (6 * (level - 1));
+	if (node == 0)
+	{
+		return span << 6;
+	}
+	
+	for (size_t slot = block / span; slot < 64; slot++)
+	{
+		size_t found = seek(((void* const*)node)[slot], level - 1, slot == block / span ? block % span : 0);
+		if (found < span)
+		{
+			return slot * span + found;
+		}
+	}
+	
+	return span << 6;
+}
+template <typename T, uint32_t Stride> inline void* treealloc_t<T, Stride>::allocate(const size_t count, const size_t size)
+{
+	// Empty blocks are allocated as one byte, so that the policy never sees a size of zero.
+	const size_t bytes = max(count * size, (size_t)1);
+	return this->_allocator != 0 ? this->_allocator->allocate(bytes) : calloc(bytes, 1);
+}
+template <typename T, uint32_t Stride> inline void treealloc_t<T, Stride>::deallocate(void* memory, const size_t count, const size_t size)
+{
+	if (this->_allocator != 0)
+	{
+		this->_allocator->release(memory, max(count * size, (size_t)1));
+	}
+	else
+	{
+		free(memory);
+	}
+}
+template <typename T, uint32_t Stride> inline size_t treealloc_t<T, Stride>::release(void* node, const uint32_t level)
+{
+	if (node == 0)
+	{
+		return 0;
+	}
+	
+	size_t result = 0;
+	if (level == 0)
+	{
+		result = tree_popcount64(((treepage_t<T>*)node)->_bits);
+	}
+	else
+	{
+		for (uint32_t slot = 0; slot < 64; slot++)
+		{
+			result += this->release(((void**)node)[slot], level - 1);
+		}
+	}
+	
+	if (level == 0)
+	{
+		this->deallocate(node, 1, sizeof(treepage_t<T>));
+	}
+	else
+	{
+		this->deallocate(node, 64, sizeof(void*));
+	}
+	
+	return result;
+}
+template <typename T, uint32_t Stride> inline void treealloc_t<T, Stride>::unmap(void* image, const size_t length)
+{
+#if defined(_WIN32)
+	UnmapViewOfFile(image);
+#else
+	munmap(image, length);
+#endif
 }
 
-template <typename T> inline void treealloc_t<T>::remove(const size_t index)
+template <typename T, uint32_t Stride> inline T* treealloc_t<T, Stride>::ring(const uint32_t ring) const
 {
-	uint32_t ring = tree_ring_by_index(index, this->_stride);
-	size_t root = index % this->capacity();
-	uint32_t branch = tree_branch_by_index(root, this->_stride);
-	for (uint32_t i = ring; i < this->_rings; i++)
+	if (this->_storage == TREE_STORAGE_SPARSE || this->_storage == TREE_STORAGE_VEB)
+	{
+		return 0;
+	}
+	
+	if (this->_storage == TREE_STORAGE_SEGMENTED)
 	{
-		memset(this->_buffer + tree_index(i, branch, this->_stride), 0, sizeof(T) * tree_ring_length(i - ring, this->_stride));
-		branch = branch * this->_stride;
+		return this->_segments[ring];
 	}
+	
+	return this->_buffer + tree_size(ring, this->stride());
 }
 
-template <typename T> inline T& treealloc_t<T>::operator[](const size_t index)
+template <typename T, uint32_t Stride> inline T& treealloc_t<T, Stride>::operator[](const size_t index)
+{
+	// The common case is kept small enough to inline, the other layouts go through element().
+	if (index < this->_capacity && this->_storage == TREE_STORAGE_CONTIGUOUS)
+	{
+		return this->_buffer[index];
+	}
+	
+	return *(this->element(index));
+}
+template <typename T, uint32_t Stride> inline T* treealloc_t<T, Stride>::element(const size_t index)
 {
-	uint32_t ring = tree_ring_by_index(index, this->_stride);
-	this->ensure(ring + 1, this->_stride);
-	return *(this->_buffer + index);
+	// The tree buffer is only grown by ensure() and occupy(), which report when they fail, so an index past the capacity has no element.
+	if (index >= this->capacity())
+	{
+		return 0;
+	}
+	
+	if (this->_storage != TREE_STORAGE_CONTIGUOUS)
+	{
+		uint32_t ring = tree_ring_by_index(index, this->stride());
+		size_t branch = index - tree_size(ring, this->stride());
+		if (this->_storage == TREE_STORAGE_SPARSE)
+		{
+			treepage_t<T>* page = this->touch(ring, branch >> 6);
+			return page != 0 ? page->_elements + (branch & 63) : 0;
+		}
+		else if (this->_storage == TREE_STORAGE_VEB)
+		{
+			return this->_buffer + this->_veb->offset(ring, branch);
+		}
+		
+		return this->_segments[ring] + branch;
+	}
+	
+	return this->_buffer + index;
 }
 
-template <typename T> inline bool treereference_t<T>::empty() const
+template <typename T, uint32_t Stride> inline bool treereference_t<T, Stride>::empty() const
 {
-	return this->_registry == 0 || this->_index < 0;
+	return this->_registry == 0 || this->_index < 0 || (size_t)this->_index >= this->_registry->capacity();
 }
 
-template <typename T> inline treereference_t<T>& treereference_t<T>::operator=(const int32_t index)
+template <typename T, uint32_t Stride> inline treereference_t<T, Stride>& treereference_t<T, Stride>::operator=(const int64_t index)
 {
 	this->_index = index;
 	return *this;
 }
-template <typename T> inline treereference_t<T>& treereference_t<T>::operator=(const treereference_t<T>& other)
+template <typename T, uint32_t Stride> inline treereference_t<T, Stride>& treereference_t<T, Stride>::operator=(const treereference_t<T, Stride>& other)
 {
 	this->_index = other._index;
 	this->_registry = other._registry;
 	return *this;
 }
-template <typename T> inline T& treereference_t<T>::operator*() const
+template <typename T, uint32_t Stride> inline T& treereference_t<T, Stride>::operator*() const
 {
 	// if (this->_registry != 0 && this->_index >= 0)
 	// {
 		return (*(this->_registry))[this->_index];
 	// }
 }
-template <typename T> inline T* treereference_t<T>::operator->() const
+template <typename T, uint32_t Stride> inline T* treereference_t<T, Stride>::operator->() const
 {
 	if (this->_registry != 0 && this->_index >= 0)
 	{
-		return &((*(this->_registry))[this->_index]);
+		return this->_registry->element((size_t)this->_index);
 	}
 	
 	return 0;
 }
-template <typename T> inline treereference_t<T>::operator T*() const
+template <typename T, uint32_t Stride> inline treereference_t<T, Stride>::operator T*() const
 {
 	if (this->_registry != 0 && this->_index >= 0)
 	{
-		return &((*(this->_registry))[this->_index]);
+		return this->_registry->element((size_t)this->_index);
 	}
 	
 	return 0;
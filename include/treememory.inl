@@ -0,0 +1,102 @@
+#pragma once
+
+inline void* treealigned_t::allocate(const size_t size)
+{
+#if defined(_WIN32)
+	void* memory = _aligned_malloc(size, this->_alignment);
+#else
+	void* memory = 0;
+	if (posix_memalign(&memory, this->_alignment, size) != 0)
+	{
+		memory = 0;
+	}
+#endif
+	if (memory != 0)
+	{
+		memset(memory, 0, size);
+	}
+	
+	return memory;
+}
+inline void treealigned_t::release(void* memory, const size_t size)
+{
+#if defined(_WIN32)
+	_aligned_free(memory);
+#else
+	free(memory);
+#endif
+}
+
+inline void* treehugepages_t::allocate(const size_t size)
+{
+	// Blocks smaller than a huge page could not fill one, so they are only aligned to a cache line. Larger blocks are rounded up
+	// to whole huge pages, and the hint is given before the block is zeroed so that the pages are huge from the first touch.
+	if (size < TREE_HUGE_PAGE)
+	{
+		return treealigned_t(64).allocate(size);
+	}
+	
+	const size_t length = (size + TREE_HUGE_PAGE - 1) & ~(TREE_HUGE_PAGE - 1);
+#if defined(_WIN32)
+	void* memory = _aligned_malloc(length, this->_alignment);
+#else
+	void* memory = 0;
+	if (posix_memalign(&memory, this->_alignment, length) != 0)
+	{
+		return 0;
+	}
+#endif
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+	if (memory != 0)
+	{
+		madvise(memory, length, MADV_HUGEPAGE);
+	}
+#endif
+	if (memory != 0)
+	{
+		memset(memory, 0, length);
+	}
+	
+	return memory;
+}
+
+inline void* treearena_t::allocate(const size_t size)
+{
+	std::lock_guard<std::mutex> lock(this->_lock);
+	unsigned char* start = (unsigned char*)(((uintptr_t)this->_next + 63) & ~(uintptr_t)63);
+	if (this->_next == 0 || start + size > this->_end)
+	{
+		// A block that does not fit gets a new chunk, with room for the chunk's header and the alignment. Chunks come from calloc,
+		// and no byte is handed out twice, so every block is already zeroed.
+		const size_t length = max(this->_chunk, size + sizeof(chunk_t) + 64);
+		chunk_t* chunk = (chunk_t*)calloc(length, 1);
+		if (chunk == 0)
+		{
+			return 0;
+		}
+		
+		chunk->_next = this->_chunks;
+		this->_chunks = chunk;
+		this->_next = (unsigned char*)(chunk + 1);
+		this->_end = (unsigned char*)chunk + length;
+		start = (unsigned char*)(((uintptr_t)this->_next + 63) & ~(uintptr_t)63);
+	}
+	
+	this->_next = start + size;
+	this->_used += size;
+	return start;
+}
+inline void treearena_t::reset()
+{
+	std::lock_guard<std::mutex> lock(this->_lock);
+	while (this->_chunks != 0)
+	{
+		chunk_t* next = this->_chunks->_next;
+		free(this->_chunks);
+		this->_chunks = next;
+	}
+	
+	this->_next = 0;
+	this->_end = 0;
+	this->_used = 0;
+}
\ No newline at end of file
@@ -0,0 +1,353 @@
+#pragma once
+
+inline treepool_t::treepool_t(const uint32_t workers) :
+	_workers(workers),
+	_threads(0),
+	_queues(0),
+	_generation(0),
+	_active(0),
+	_stop(false),
+	_task(0),
+	_context(0)
+{
+	if (this->_workers == 0)
+	{
+		this->_workers = max(std::thread::hardware_concurrency(), 1u);
+	}
+	
+	this->_queues = new queue_t[this->_workers];
+	for (uint32_t i = 0; i < this->_workers; i++)
+	{
+		this->_queues[i]._head = 0;
+		this->_queues[i]._tail = 0;
+	}
+	
+	this->_threads = new std::thread[this->_workers - 1];
+	for (uint32_t i = 1; i < this->_workers; i++)
+	{
+		this->_threads[i - 1] = std::thread(&treepool_t::loop, this, i);
+	}
+}
+inline treepool_t::~treepool_t()
+{
+	{
+		std::lock_guard<std::mutex> lock(this->_lock);
+		this->_stop = true;
+	}
+	
+	this->_wake.notify_all();
+	for (uint32_t i = 1; i < this->_workers; i++)
+	{
+		this->_threads[i - 1].join();
+	}
+	
+	delete[] this->_threads;
+	delete[] this->_queues;
+}
+
+inline treepool_t& treepool_t::shared()
+{
+	static treepool_t pool;
+	return pool;
+}
+
+inline void treepool_t::dispatch(const size_t count, taskfunc task, void* context)
+{
+	std::lock_guard<std::mutex> serial(this->_run);
+	if (count == 0)
+	{
+		return;
+	}
+	
+	if (this->_workers == 1 || count == 1)
+	{
+		for (size_t i = 0; i < count; i++)
+		{
+			task(context, 0, i);
+		}
+		
+		return;
+	}
+	
+	for (uint32_t i = 0; i < this->_workers; i++)
+	{
+		std::lock_guard<std::mutex> lock(this->_queues[i]._lock);
+		this->_queues[i]._head = (count * i) / this->_workers;
+		this->_queues[i]._tail = (count * (i + 1)) / this->_workers;
+	}
+	
+	{
+		std::lock_guard<std::mutex> lock(this->_lock);
+		this->_task = task;
+		this->_context = context;
+		this->_active = this->_workers - 1;
+		this->_generation++;
+	}
+	
+	this->_wake.notify_all();
+	this->work(0, task, context);
+	std::unique_lock<std::mutex> lock(this->_lock);
+	this->_done.wait(lock, [this]() { return this->_active == 0; });
+}
+inline void treepool_t::loop(const uint32_t worker)
+{
+	uint64_t generation = 0;
+	while (true)
+	{
+		taskfunc task = 0;
+		void* context = 0;
+		{
+			std::unique_lock<std::mutex> lock(this->_lock);
+			this->_wake.wait(lock, [&]() { return this->_stop || this->_generation != generation; });
+			if (this->_stop)
+			{
+				return;
+			}
+			
+			generation = this->_generation;
+			task = this->_task;
+			context = this->_context;
+		}
+		
+		this->work(worker, task, context);
+		std::lock_guard<std::mutex> lock(this->_lock);
+		if (--(this->_active) == 0)
+		{
+			this->_done.notify_all();
+		}
+	}
+}
+inline void treepool_t::work(const uint32_t worker, taskfunc task, void* context)
+{
+	size_t next = 0;
+	while (this->take(worker, &next))
+	{
+		task(context, worker, next);
+	}
+}
+inline bool treepool_t::take(const uint32_t worker, size_t* task)
+{
+	queue_t& own = this->_queues[worker];
+	{
+		std::lock_guard<std::mutex> lock(own._lock);
+		if (own._head < own._tail)
+		{
+			*task = own._head++;
+			return true;
+		}
+	}
+	
+	// Tasks are taken from the front of a queue and stolen from the back, half of what is left at a time.
+	for (uint32_t k = 1; k < this->_workers; k++)
+	{
+		queue_t& victim = this->_queues[(worker + k) % this->_workers];
+		size_t first = 0;
+		size_t last = 0;
+		{
+			std::lock_guard<std::mutex> lock(victim._lock);
+			if (victim._head >= victim._tail)
+			{
+				continue;
+			}
+			
+			first = victim._head + ((victim._tail - victim._head) >> 1);
+			last = victim._tail;
+			victim._tail = first;
+		}
+		
+		std::lock_guard<std::mutex> lock(own._lock);
+		own._head = first + 1;
+		own._tail = last;
+		*task = first;
+		return true;
+	}
+	
+	return false;
+}
+
+template <typename Node, uint32_t Stride, typename S, typename F, typename C> inline S tree_parallel_each(treealloc_t<Node, Stride>& registry, const S& initial, F function, C combine, const uint32_t ring, treepool_t& pool)
+{
+	const uint32_t stride = registry.stride();
+	const uint32_t workers = pool.workers();
+	uint32_t split = ring;
+	if (split == 0)
+	{
+		split = 1;
+		while (split + 1 < registry.rings() && tree_ring_length(split, stride) < (size_t)workers * 8)
+		{
+			split++;
+		}
+	}
+	
+	treeslot_t<S>* slots = new treeslot_t<S>[workers];
+	for (uint32_t i = 0; i < workers; i++)
+	{
+		slots[i]._value = initial;
+	}
+	
+	// The few nodes above the split are visited on the calling thread, then every subtree at the split is a task.
+	registry.descend(0, 0, split, [&](Node& node) { function(slots[0]._value, node, node._data); return 1; });
+	if (split < registry.rings() && split < TREE_MAX_RINGS)
+	{
+		pool.run(tree_ring_length(split, stride), [&](const uint32_t worker, const size_t task)
+		{
+			registry.descend(split, task, TREE_MAX_RINGS, [&](Node& node) { function(slots[worker]._value, node, node._data); return 1; });
+		});
+	}
+	
+	S result = slots[0]._value;
+	for (uint32_t i = 1; i < workers; i++)
+	{
+		combine(result, slots[i]._value);
+	}
+	
+	delete[] slots;
+	return result;
+}
+
+template <typename Node, uint32_t Stride, typename F> inline void tree_parallel_blocks(const treealloc_t<Node, Stride>& registry, treepool_t& pool, F function)
+{
+	// A chunk of 64 blocks is 4096 nodes, which is enough work to pay for taking a task and small enough to balance.
+	const size_t chunk = 64;
+	const uint32_t stride = registry.stride();
+	// A tree that was never allocated has rings but no occupancy to read, so it has no tasks.
+	const uint32_t rings = registry.capacity() > 0 ? min(registry.rings(), (uint32_t)TREE_MAX_RINGS) : 0;
+	size_t starts[TREE_MAX_RINGS + 1];
+	starts[0] = 0;
+	for (uint32_t ring = 0; ring < rings; ring++)
+	{
+		const size_t words = (tree_ring_length(ring, stride) + 63) >> 6;
+		starts[ring + 1] = starts[ring] + ((words + chunk - 1) / chunk);
+	}
+	
+	pool.run(starts[rings], [&](const uint32_t worker, const size_t task)
+	{
+		uint32_t ring = 0;
+		while (starts[ring + 1] <= task)
+		{
+			ring++;
+		}
+		
+		const size_t length = tree_ring_length(ring, stride);
+		const size_t words = (length + 63) >> 6;
+		const size_t first = (task - starts[ring]) * chunk;
+		const size_t last = min(first + chunk, words);
+		for (size_t block = registry.next_block(ring, first); block < last; block = registry.next_block(ring, block + 1))
+		{
+			Node* nodes = 0;
+			uint64_t mask = *(registry.block(ring, block, &nodes));
+			uint64_t gathered[(sizeof(Node) * 64 + 7) / 8];
+			if (mask != 0 && nodes == 0)
+			{
+				memset(gathered, 0, sizeof(gathered));
+				registry.gather(ring, block, (Node*)gathered);
+				nodes = (Node*)gathered;
+			}
+			
+			if (mask != 0 && !function(worker, tree_size(ring, stride) + (block << 6), (const Node*)nodes, mask, min(length - (block << 6), (size_t)64)))
+			{
+				return;
+			}
+		}
+	});
+}
+
+template <typename T, typename Node, uint32_t Stride> inline size_t tree_parallel_search(const treealloc_t<Node, Stride>& registry, const T& item, treepool_t& pool)
+{
+	std::atomic<size_t> best(registry.capacity());
+	tree_parallel_blocks(registry, pool, [&](const uint32_t worker, const size_t base, const Node* nodes, const uint64_t mask, const size_t count)
+	{
+		if (base >= best.load(std::memory_order_relaxed))
+		{
+			return false;
+		}
+		
+		uint64_t found = tree_match_t<T, Node>::match(nodes, item, mask, count);
+		if (found == 0)
+		{
+			return true;
+		}
+		
+		size_t index = base + tree_ctz64(found);
+		size_t current = best.load(std::memory_order_relaxed);
+		while (index < current && !best.compare_exchange_weak(current, index, std::memory_order_relaxed))
+		{
+		}
+		
+		return false;
+	});
+	return best.load();
+}
+
+template <typename T, typename Node, uint32_t Stride> inline size_t tree_parallel_search_all(const treealloc_t<Node, Stride>& registry, const T& item, treepool_t& pool, size_t* results, const size_t limit)
+{
+	struct found_t
+	{
+		size_t* _indices;
+		size_t _count;
+		size_t _capacity;
+	};
+	
+	const uint32_t workers = pool.workers();
+	treeslot_t<found_t>* slots = new treeslot_t<found_t>[workers];
+	memset((void*)slots, 0, sizeof(treeslot_t<found_t>) * workers);
+	tree_parallel_blocks(registry, pool, [&](const uint32_t worker, const size_t base, const Node* nodes, const uint64_t mask, const size_t count)
+	{
+		found_t& found = slots[worker]._value;
+		uint64_t matches = tree_match_t<T, Node>::match(nodes, item, mask, count);
+		if (results == 0)
+		{
+			found._count += tree_popcount64(matches);
+			return true;
+		}
+		
+		for (; matches != 0; matches &= matches - 1)
+		{
+			if (found._count == found._capacity)
+			{
+				found._capacity = max(found._capacity * 2, (size_t)64);
+				found._indices = (size_t*)realloc(found._indices, sizeof(size_t) * found._capacity);
+			}
+			
+			found._indices[found._count++] = base + tree_ctz64(matches);
+		}
+		
+		return true;
+	});
+	
+	size_t total = 0;
+	for (uint32_t i = 0; i < workers; i++)
+	{
+		total += slots[i]._value._count;
+	}
+	
+	if (results != 0 && total > 0)
+	{
+		// Stolen chunks finish out of order, so the indices of every worker are merged and sorted back into level order.
+		size_t* indices = (size_t*)calloc(total, sizeof(size_t));
+		size_t offset = 0;
+		for (uint32_t i = 0; i < workers; i++)
+		{
+			if (slots[i]._value._count > 0)
+			{
+				memcpy(indices + offset, slots[i]._value._indices, sizeof(size_t) * slots[i]._value._count);
+				offset += slots[i]._value._count;
+			}
+		}
+		
+		qsort(indices, total, sizeof(size_t), [](const void* a, const void* b) -> int
+		{
+			return *(const size_t*)a < *(const size_t*)b ? -1 : (*(const size_t*)a > *(const size_t*)b ? 1 : 0);
+		});
+		memcpy(results, indices, sizeof(size_t) * min(total, limit));
+		free(indices);
+	}
+	
+	for (uint32_t i = 0; i < workers; i++)
+	{
+		free(slots[i]._value._indices);
+	}
+	
+	delete[] slots;
+	return total;
+}
\ No newline at end of file
@@ -0,0 +1,193 @@
+#pragma once
+
+#if defined(TREE_SIMD_AVX2)
+inline bool tree_simd_avx2()
+{
+	static const bool supported = (__builtin_cpu_init(), __builtin_cpu_supports("avx2") != 0);
+	return supported;
+}
+
+__attribute__((target("avx2"))) inline uint64_t tree_match64_32_avx2(const void* values, const uint32_t item)
+{
+	const __m256i needle = _mm256_set1_epi32((int32_t)item);
+	const __m256i* data = (const __m256i*)values;
+	uint64_t mask = 0;
+	for (uint32_t i = 0; i < 8; i++)
+	{
+		__m256i equal = _mm256_cmpeq_epi32(_mm256_loadu_si256(data + i), needle);
+		mask |= (uint64_t)(uint32_t)_mm256_movemask_ps(_mm256_castsi256_ps(equal)) << (i * 8);
+	}
+	
+	return mask;
+}
+__attribute__((target("avx2"))) inline uint64_t tree_match64_64_avx2(const void* values, const uint64_t item)
+{
+	const __m256i needle = _mm256_set1_epi64x((int64_t)item);
+	const __m256i* data = (const __m256i*)values;
+	uint64_t mask = 0;
+	for (uint32_t i = 0; i < 16; i++)
+	{
+		__m256i equal = _mm256_cmpeq_epi64(_mm256_loadu_si256(data + i), needle);
+		mask |= (uint64_t)(uint32_t)_mm256_movemask_pd(_mm256_castsi256_pd(equal)) << (i * 4);
+	}
+	
+	return mask;
+}
+#endif
+
+#if defined(TREE_SIMD_SSE2)
+inline uint64_t tree_match64_32_sse2(const void* values, const uint32_t item)
+{
+	const __m128i needle = _mm_set1_epi32((int32_t)item);
+	const __m128i* data = (const __m128i*)values;
+	uint64_t mask = 0;
+	for (uint32_t i = 0; i < 16; i++)
+	{
+		__m128i equal = _mm_cmpeq_epi32(_mm_loadu_si128(data + i), needle);
+		mask |= (uint64_t)(uint32_t)_mm_movemask_ps(_mm_castsi128_ps(equal)) << (i * 4);
+	}
+	
+	return mask;
+}
+inline uint64_t tree_match64_64_sse2(const void* values, const uint64_t item)
+{
+	const __m128i needle = _mm_set1_epi64x((int64_t)item);
+	const __m128i* data = (const __m128i*)values;
+	uint64_t mask = 0;
+	for (uint32_t i = 0; i < 32; i++)
+	{
+		// SSE2 has no 64 bit compare, so both 32 bit halves have to match.
+		__m128i equal = _mm_cmpeq_epi32(_mm_loadu_si128(data + i), needle);
+		equal = _mm_and_si128(equal, _mm_shuffle_epi32(equal, _MM_SHUFFLE(2, 3, 0, 1)));
+		mask |= (uint64_t)(uint32_t)_mm_movemask_pd(_mm_castsi128_pd(equal)) << (i * 2);
+	}
+	
+	return mask;
+}
+#endif
+
+inline uint64_t tree_match64_32(const void* values, const uint32_t item)
+{
+#if defined(TREE_SIMD_AVX2)
+	if (tree_simd_avx2())
+	{
+		return tree_match64_32_avx2(values, item);
+	}
+#endif
+#if defined(TREE_SIMD_SSE2)
+	return tree_match64_32_sse2(values, item);
+#else
+	uint64_t mask = 0;
+	for (uint32_t i = 0; i < 64; i++)
+	{
+		uint32_t value;
+		memcpy(&value, (const uint32_t*)values + i, sizeof(uint32_t));
+		mask |= (uint64_t)(value == item ? 1 : 0) << i;
+	}
+	
+	return mask;
+#endif
+}
+inline uint64_t tree_match64_64(const void* values, const uint64_t item)
+{
+#if defined(TREE_SIMD_AVX2)
+	if (tree_simd_avx2())
+	{
+		return tree_match64_64_avx2(values, item);
+	}
+#endif
+#if defined(TREE_SIMD_SSE2)
+	return tree_match64_64_sse2(values, item);
+#else
+	uint64_t mask = 0;
+	for (uint32_t i = 0; i < 64; i++)
+	{
+		uint64_t value;
+		memcpy(&value, (const uint64_t*)values + i, sizeof(uint64_t));
+		mask |= (uint64_t)(value == item ? 1 : 0) << i;
+	}
+	
+	return mask;
+#endif
+}
+
+template <typename T, typename Node, size_t Bytes> inline uint64_t tree_match_t<T, Node, Bytes>::match(const Node* nodes, const T& item, const uint64_t mask, const size_t count)
+{
+	uint64_t result = 0;
+	for (uint64_t rest = mask; rest != 0; rest &= rest - 1)
+	{
+		uint32_t i = tree_ctz64(rest);
+		if (memcmp(&(nodes[i]._data), &item, sizeof(T)) == 0)
+		{
+			result |= (uint64_t)1 << i;
+		}
+	}
+	
+	return result;
+}
+
+// Payload only nodes of 4 or 8 bytes are compared bit for bit, which gives the same answer as memcmp for any type.
+template <typename T, typename Node> struct tree_match_t<T, Node, 4>
+{
+	
+	static inline uint64_t match(const Node* nodes, const T& item, const uint64_t mask, const size_t count)
+	{
+		uint32_t bits;
+		memcpy(&bits, &item, sizeof(uint32_t));
+		return count == 64 ? mask & tree_match64_32(nodes, bits) : tree_match_t<T, Node, 0>::match(nodes, item, mask, count);
+	}
+	
+};
+template <typename T, typename Node> struct tree_match_t<T, Node, 8>
+{
+	
+	static inline uint64_t match(const Node* nodes, const T& item, const uint64_t mask, const size_t count)
+	{
+		uint64_t bits;
+		memcpy(&bits, &item, sizeof(uint64_t));
+		return count == 64 ? mask & tree_match64_64(nodes, bits) : tree_match_t<T, Node, 0>::match(nodes, item, mask, count);
+	}
+	
+};
+
+template <typename T, typename Node, uint32_t Stride> inline size_t tree_search(const treealloc_t<Node, Stride>& registry, const T& item, const size_t index)
+{
+	const uint32_t stride = registry.stride();
+	const size_t capacity = registry.capacity();
+	if (index >= capacity)
+	{
+		return capacity;
+	}
+	
+	uint32_t ring = tree_ring_by_index(index, stride);
+	size_t branch = index - tree_size(ring, stride);
+	for (; ring < registry.rings() && ring < TREE_MAX_RINGS; ring++, branch = 0)
+	{
+		// Each ring is scanned a block of 64 nodes at a time, only comparing the blocks that have used nodes.
+		const size_t length = tree_ring_length(ring, stride);
+		const size_t words = (length + 63) >> 6;
+		for (size_t word = registry.next_block(ring, branch >> 6); word < words; word = registry.next_block(ring, word + 1))
+		{
+			Node* nodes = 0;
+			uint64_t mask = *(registry.block(ring, word, &nodes)) & (word == (branch >> 6) ? ~(uint64_t)0 << (branch & 63) : ~(uint64_t)0);
+			if (mask != 0)
+			{
+				uint64_t gathered[(sizeof(Node) * 64 + 7) / 8];
+				if (nodes == 0)
+				{
+					memset(gathered, 0, sizeof(gathered));
+					registry.gather(ring, word, (Node*)gathered);
+					nodes = (Node*)gathered;
+				}
+				
+				mask = tree_match_t<T, Node>::match(nodes, item, mask, min(length - (word << 6), (size_t)64));
+				if (mask != 0)
+				{
+					return tree_size(ring, stride) + (word << 6) + tree_ctz64(mask);
+				}
+			}
+		}
+	}
+	
+	return capacity;
+}
\ No newline at end of file
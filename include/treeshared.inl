@@ -0,0 +1,100 @@
+#pragma once
+
+template <typename Tree> inline treeshared_t<Tree>::treeshared_t(const uint32_t rings, const treestorage_t storage) :
+	_writer(rings, storage),
+	_published(0),
+	_epoch(1),
+	_retired(0),
+	_count(0),
+	_capacity(0)
+{
+	for (uint32_t i = 0; i < readers; i++)
+	{
+		this->_slots[i]._epoch.store(0);
+	}
+	
+	Tree* snapshot = new Tree();
+	snapshot->copy(this->_writer);
+	this->_published.store(snapshot);
+}
+template <typename Tree> inline treeshared_t<Tree>::~treeshared_t()
+{
+	for (size_t i = 0; i < this->_count; i++)
+	{
+		delete this->_retired[i]._tree;
+	}
+	
+	free(this->_retired);
+	delete this->_published.load();
+}
+
+template <typename Tree> inline void treeshared_t<Tree>::publish()
+{
+	Tree* snapshot = new Tree();
+	snapshot->copy(this->_writer);
+	Tree* replaced = this->_published.exchange(snapshot);
+	if (this->_count == this->_capacity)
+	{
+		this->_capacity = max(this->_capacity * 2, (size_t)8);
+		this->_retired = (retired_t*)realloc(this->_retired, sizeof(retired_t) * this->_capacity);
+	}
+	
+	// A reader that entered at the epoch before this one could still be holding the replaced snapshot.
+	this->_retired[this->_count]._tree = replaced;
+	this->_retired[this->_count]._epoch = this->_epoch.fetch_add(1);
+	this->_count++;
+	this->reclaim();
+}
+template <typename Tree> inline size_t treeshared_t<Tree>::reclaim()
+{
+	uint64_t oldest = UINT64_MAX;
+	for (uint32_t i = 0; i < readers; i++)
+	{
+		uint64_t epoch = this->_slots[i]._epoch.load();
+		if (epoch != 0 && epoch < oldest)
+		{
+			oldest = epoch;
+		}
+	}
+	
+	size_t kept = 0;
+	for (size_t i = 0; i < this->_count; i++)
+	{
+		if (this->_retired[i]._epoch < oldest)
+		{
+			delete this->_retired[i]._tree;
+		}
+		else
+		{
+			this->_retired[kept++] = this->_retired[i];
+		}
+	}
+	
+	this->_count = kept;
+	return kept;
+}
+
+template <typename Tree> inline uint32_t treeshared_t<Tree>::enter()
+{
+	// Each thread starts looking at the slot it had last, so readers on different threads rarely race for the same slot.
+	static thread_local uint32_t hint = 0;
+	while (true)
+	{
+		for (uint32_t k = 0; k < readers; k++)
+		{
+			uint32_t slot = (hint + k) % readers;
+			uint64_t idle = 0;
+			if (this->_slots[slot]._epoch.load(std::memory_order_relaxed) == 0 && this->_slots[slot]._epoch.compare_exchange_strong(idle, this->_epoch.load()))
+			{
+				hint = slot;
+				return slot;
+			}
+		}
+		
+		std::this_thread::yield();
+	}
+}
+template <typename Tree> inline void treeshared_t<Tree>::leave(const uint32_t slot)
+{
+	this->_slots[slot]._epoch.store(0);
+}
\ No newline at end of file
@@ -0,0 +1,119 @@
+#pragma once
+
+template <typename T, typename Node, uint32_t Stride, treeorder_t Order> inline treewalker_t<T, Node, Stride, Order> treewalker_t<T, Node, Stride, Order>::first(treealloc_t<Node, Stride>& registry)
+{
+	static_assert(Order != TREE_ORDER_IN || Stride == 2, "in-order walks need a binary tree");
+	treewalker_t<T, Node, Stride, Order> result(registry, SIZE_MAX);
+	if (Order == TREE_ORDER_LEVEL)
+	{
+		size_t index = registry.next(0);
+		result._index = index < registry.capacity() ? index : SIZE_MAX;
+	}
+	else if (registry.occupied(0))
+	{
+		result._index = Order == TREE_ORDER_PRE ? 0 : result.descend(0);
+	}
+	
+	return result;
+}
+
+template <typename T, typename Node, uint32_t Stride, treeorder_t Order> inline size_t treewalker_t<T, Node, Stride, Order>::advance(const size_t index) const
+{
+	if (index == SIZE_MAX)
+	{
+		return SIZE_MAX;
+	}
+	
+	const treealloc_t<Node, Stride>& registry = *(this->_registry);
+	if (Order == TREE_ORDER_LEVEL)
+	{
+		size_t next = registry.next(index + 1);
+		return next < registry.capacity() ? next : SIZE_MAX;
+	}
+	else if (Order == TREE_ORDER_PRE)
+	{
+		for (uint32_t k = 0; k < registry.stride(); k++)
+		{
+			size_t child = registry.child(index, this->visit(k));
+			if (registry.occupied(child))
+			{
+				return child;
+			}
+		}
+		
+		for (size_t up = index; up > 0; up = registry.parent(up))
+		{
+			size_t next = this->sibling(up);
+			if (next != SIZE_MAX)
+			{
+				return next;
+			}
+		}
+		
+		return SIZE_MAX;
+	}
+	else if (Order == TREE_ORDER_IN)
+	{
+		size_t right = registry.child(index, 0);
+		if (registry.occupied(right))
+		{
+			return this->descend(right);
+		}
+		
+		for (size_t up = index; up > 0; up = registry.parent(up))
+		{
+			if (up == registry.child(registry.parent(up), 1))
+			{
+				return registry.parent(up);
+			}
+		}
+		
+		return SIZE_MAX;
+	}
+	
+	if (index == 0)
+	{
+		return SIZE_MAX;
+	}
+	
+	size_t next = this->sibling(index);
+	return next != SIZE_MAX ? this->descend(next) : registry.parent(index);
+}
+template <typename T, typename Node, uint32_t Stride, treeorder_t Order> inline size_t treewalker_t<T, Node, Stride, Order>::descend(const size_t index) const
+{
+	// In-order walks start at the leftmost node of a subtree, post-order walks at the first leaf that it reaches.
+	const treealloc_t<Node, Stride>& registry = *(this->_registry);
+	size_t result = index;
+	bool deeper = true;
+	while (deeper)
+	{
+		deeper = false;
+		for (uint32_t k = 0; k < (Order == TREE_ORDER_IN ? 1 : registry.stride()); k++)
+		{
+			size_t child = registry.child(result, this->visit(k));
+			if (registry.occupied(child))
+			{
+				result = child;
+				deeper = true;
+				break;
+			}
+		}
+	}
+	
+	return result;
+}
+template <typename T, typename Node, uint32_t Stride, treeorder_t Order> inline size_t treewalker_t<T, Node, Stride, Order>::sibling(const size_t index) const
+{
+	const treealloc_t<Node, Stride>& registry = *(this->_registry);
+	size_t up = registry.parent(index);
+	for (uint32_t k = this->visit((uint32_t)(index - registry.child(up, 0))) + 1; k < registry.stride(); k++)
+	{
+		size_t next = registry.child(up, this->visit(k));
+		if (registry.occupied(next))
+		{
+			return next;
+		}
+	}
+	
+	return SIZE_MAX;
+}
\ No newline at end of file
@@ -0,0 +1,1193 @@
+#include <stdio.h>
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "../include/tree.h"
+
+static volatile size_t bench_sink = 0;
+
+template <typename F> double bench_nanoseconds(const size_t count, F function)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	function();
+	std::chrono::steady_clock::time_point stop = std::chrono::steady_clock::now();
+	return std::chrono::duration<double, std::nano>(stop - start).count() / (double)count;
+}
+
+static inline size_t bench_random(size_t& state)
+{
+	state = state * 6364136223846793005ull + 1442695040888963407ull;
+	return (size_t)(state >> 16);
+}
+
+// The float pow() based index math that treealloc_t used before the closed forms, kept for comparison.
+static inline uint32_t legacy_ring_by_index(const size_t index, const uint32_t stride)
+{
+	float e = 0.0f;
+	size_t last = 0;
+	while (index >= (last += (size_t)pow((float)stride, e)))
+	{
+		e += 1.0f;
+	}
+	
+	return (uint32_t)e;
+}
+
+static inline uint32_t legacy_branch_by_index(const size_t index, const uint32_t stride)
+{
+	uint32_t i = index + 1;
+	float e = 0.0f;
+	size_t last = 0;
+	while (i > (last = (size_t)pow((float)stride, e)))
+	{
+		i -= last;
+		e += 1.0f;
+	}
+	
+	return i - 1;
+}
+
+void index_bench()
+{
+	printf("  index math, ns per call\n");
+	const uint32_t strides[] = { 2, 4, 8 };
+	const uint32_t rings[] = { 20, 10, 7 };
+	const size_t count = 2000000;
+	for (int s = 0; s < 3; s++)
+	{
+		uint32_t stride = strides[s];
+		size_t size = tree_size(rings[s], stride);
+		
+		size_t state = 1;
+		double legacy = bench_nanoseconds(count, [&]()
+		{
+			size_t sum = 0;
+			for (size_t i = 0; i < count; i++)
+			{
+				sum += legacy_ring_by_index(bench_random(state) % size, stride);
+			}
+			
+			bench_sink = sum;
+		});
+		state = 1;
+		double exact = bench_nanoseconds(count, [&]()
+		{
+			size_t sum = 0;
+			for (size_t i = 0; i < count; i++)
+			{
+				sum += tree_ring_by_index(bench_random(state) % size, stride);
+			}
+			
+			bench_sink = sum;
+		});
+		printf("    stride %u, ring by index: pow %.2f, integer %.2f\n", stride, legacy, exact);
+		
+		treealloc_t<int> registry(rings[s], stride);
+		registry[size - 1] = 1;
+		int* buffer = &(registry[0]);
+		state = 1;
+		legacy = bench_nanoseconds(count, [&]()
+		{
+			size_t sum = 0;
+			for (size_t i = 0; i < count; i++)
+			{
+				size_t index = bench_random(state) % size;
+				sum += legacy_ring_by_index(index, stride) < rings[s] ? buffer[index] : 0;
+			}
+			
+			bench_sink = sum;
+		});
+		state = 1;
+		exact = bench_nanoseconds(count, [&]()
+		{
+			size_t sum = 0;
+			for (size_t i = 0; i < count; i++)
+			{
+				sum += registry[bench_random(state) % size];
+			}
+			
+			bench_sink = sum;
+		});
+		printf("    stride %u, element access: pow %.2f, integer %.2f\n", stride, legacy, exact);
+		registry.clear();
+	}
+	
+	printf("\n");
+	printf("  index math, mismatches against the exact ring and branch past 2^24\n");
+	const uint32_t checked[] = { 2, 3, 4, 8 };
+	for (int s = 0; s < 4; s++)
+	{
+		size_t state = 7;
+		size_t mismatches = 0;
+		for (size_t i = 0; i < 100000; i++)
+		{
+			size_t index = ((size_t)1 << 24) + (bench_random(state) % ((size_t)1 << 36));
+			if (legacy_ring_by_index(index, checked[s]) != tree_ring_by_index(index, checked[s]) ||
+				legacy_branch_by_index(index, checked[s]) != tree_branch_by_index(index, checked[s]))
+			{
+				mismatches++;
+			}
+		}
+		
+		printf("    stride %u: %zu of 100000\n", checked[s], mismatches);
+	}
+	
+	printf("\n");
+}
+
+struct bench_payload_t
+{
+	uint64_t values[8];
+};
+
+static inline double bench_milliseconds(const std::chrono::steady_clock::time_point& start)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void growth_run(const char* name, const treestorage_t storage)
+{
+	const int depth = 20;
+	double total = 0.0;
+	double worst = 0.0;
+	binarytree_t<int> tree(1, storage);
+	binarytree_t<int>::iterator i = tree.set_root(0);
+	for (int ring = 1; ring < depth; ring++)
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		i = i.left(ring);
+		double elapsed = bench_milliseconds(start);
+		total += elapsed;
+		worst = max(worst, elapsed);
+	}
+	
+	printf("    %s, path to ring %d: total %.3f ms, worst insert %.3f ms\n", name, depth - 1, total, worst);
+	tree.clear();
+	
+	const size_t size = tree_size(depth, 2);
+	total = 0.0;
+	worst = 0.0;
+	size_t spikes = 0;
+	treealloc_t<bench_payload_t> registry(1, 2, storage);
+	for (size_t index = 0; index < size; index++)
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		registry[index].values[0] = index;
+		double elapsed = bench_milliseconds(start);
+		total += elapsed;
+		worst = max(worst, elapsed);
+		spikes += elapsed > 0.01 ? 1 : 0;
+	}
+	
+	printf("    %s, level order fill of %zu: total %.3f ms, worst insert %.3f ms, %zu inserts over 10 us\n", name, size, total, worst, spikes);
+	registry.clear();
+}
+
+void growth_bench()
+{
+	printf("  growth latency\n");
+	growth_run("contiguous", TREE_STORAGE_CONTIGUOUS);
+	growth_run("segmented", TREE_STORAGE_SEGMENTED);
+	growth_run("sparse", TREE_STORAGE_SPARSE);
+	printf("\n");
+}
+
+template <typename T, typename Node> void scan_run(const char* name)
+{
+	const uint32_t depth = 18;
+	binarytree_t<T, Node> tree(depth);
+	std::vector<typename binarytree_t<T, Node>::iterator> level(1, tree.set_root(0));
+	T value = 1;
+	for (uint32_t ring = 1; ring < depth; ring++)
+	{
+		std::vector<typename binarytree_t<T, Node>::iterator> below;
+		for (size_t i = 0; i < level.size(); i++)
+		{
+			below.push_back(level[i].left(value++));
+			below.push_back(level[i].right(value++));
+		}
+		
+		level.swap(below);
+	}
+	
+	const size_t count = 20;
+	double elapsed = bench_nanoseconds(count, [&]()
+	{
+		size_t sum = 0;
+		for (size_t i = 0; i < count; i++)
+		{
+			sum += tree.search(-1).empty() ? 1 : 0;
+		}
+		
+		bench_sink = sum;
+	});
+	printf("    %s, %zu byte nodes, missed search over %zu nodes: %.3f ms\n", name, sizeof(Node), tree.size(), elapsed / 1000000.0);
+	elapsed = bench_nanoseconds(count, [&]()
+	{
+		size_t sum = 0;
+		for (size_t i = 0; i < count; i++)
+		{
+			sum += tree.parallel_search(-1).empty() ? 1 : 0;
+		}
+		
+		bench_sink = sum;
+	});
+	printf("    %s, %zu byte nodes, missed parallel search on %u workers: %.3f ms\n", name, sizeof(Node), treepool_t::shared().workers(), elapsed / 1000000.0);
+	tree.clear();
+}
+
+// A missed search over the payload arrays one element at a time, which is what search() did before it was vectorized.
+template <typename T> void scan_scalar_run(const char* name)
+{
+	const uint32_t depth = 18;
+	binarytree_t<T, compactnode_t<T> > tree(depth);
+	tree.set_root(0);
+	for (uint32_t ring = 1; ring < depth; ring++)
+	{
+		T* payloads = tree.payloads(ring);
+		for (size_t branch = 0; branch < tree_ring_length(ring, 2); branch++)
+		{
+			payloads[branch] = (T)(tree_size(ring, 2) + branch);
+		}
+	}
+	
+	const size_t count = 20;
+	const T item = -1;
+	double elapsed = bench_nanoseconds(count, [&]()
+	{
+		size_t sum = 0;
+		for (size_t i = 0; i < count; i++)
+		{
+			for (uint32_t ring = 0; ring < tree.rings(); ring++)
+			{
+				const T* payloads = tree.payloads(ring);
+				for (size_t branch = 0; branch < tree_ring_length(ring, 2); branch++)
+				{
+					sum += memcmp(&(payloads[branch]), &item, sizeof(T)) == 0 ? 1 : 0;
+				}
+			}
+		}
+		
+		bench_sink = sum;
+	});
+	printf("    %s, one payload at a time over %zu nodes: %.3f ms\n", name, tree_size(depth, 2), elapsed / 1000000.0);
+	tree.clear();
+}
+
+void scan_bench()
+{
+	printf("  payload scan\n");
+	scan_run<int, binarynode_t<int> >("linked int");
+	scan_scalar_run<int>("compact int");
+	scan_run<int, compactnode_t<int> >("compact int");
+	scan_scalar_run<double>("compact double");
+	scan_run<double, compactnode_t<double> >("compact double");
+	printf("\n");
+}
+
+void ordered_bench()
+{
+	printf("  ordered tree, ns per call\n");
+	const size_t count = 1000000;
+	searchtree_t<int> sorted;
+	double elapsed = bench_nanoseconds(count, [&]()
+	{
+		for (size_t i = 0; i < count; i++)
+		{
+			sorted.insert((int)i);
+		}
+	});
+	printf("    insert %zu in order: %.1f, rings %u\n", count, elapsed, sorted.rings());
+	sorted.clear();
+	
+	searchtree_t<int> tree;
+	size_t state = 3;
+	elapsed = bench_nanoseconds(count, [&]()
+	{
+		for (size_t i = 0; i < count; i++)
+		{
+			tree.insert((int)(bench_random(state) % (count * 4)));
+		}
+	});
+	printf("    insert %zu at random: %.1f, rings %u\n", count, elapsed, tree.rings());
+	elapsed = bench_nanoseconds(count, [&]()
+	{
+		size_t sum = 0;
+		for (size_t i = 0; i < count; i++)
+		{
+			sum += tree.lower_bound((int)(bench_random(state) % (count * 4))).empty() ? 0 : 1;
+		}
+		
+		bench_sink = sum;
+	});
+	printf("    lower bound at random: %.1f\n", elapsed);
+	elapsed = bench_nanoseconds(count, [&]()
+	{
+		size_t sum = 0;
+		for (size_t i = 0; i < count; i++)
+		{
+			sum += tree.erase((int)(bench_random(state) % (count * 4))) ? 1 : 0;
+		}
+		
+		bench_sink = sum;
+	});
+	printf("    erase at random: %.1f, %zu left\n", elapsed, tree.size());
+	tree.clear();
+	
+	// A build-once tree against a binary search over the same sorted items, past the size of the caches.
+	for (size_t items = count; items <= count * 16; items *= 4)
+	{
+		std::vector<int> keys(items);
+		for (size_t i = 0; i < items; i++)
+		{
+			keys[i] = (int)(i * 4);
+		}
+		
+		statictree_t<int> fixed;
+		elapsed = bench_nanoseconds(items, [&]()
+		{
+			fixed.assign(keys.data(), items);
+		});
+		printf("    static tree of %zu, build %.1f", items, elapsed);
+		elapsed = bench_nanoseconds(count, [&]()
+		{
+			size_t sum = 0;
+			for (size_t i = 0; i < count; i++)
+			{
+				sum += fixed.lower_bound((int)(bench_random(state) % (items * 4))).empty() ? 0 : 1;
+			}
+			
+			bench_sink = sum;
+		});
+		printf(", lower bound at random %.1f", elapsed);
+		elapsed = bench_nanoseconds(count, [&]()
+		{
+			size_t sum = 0;
+			for (size_t i = 0; i < count; i++)
+			{
+				sum += std::lower_bound(keys.begin(), keys.end(), (int)(bench_random(state) % (items * 4))) == keys.end() ? 0 : 1;
+			}
+			
+			bench_sink = sum;
+		});
+		printf(", sorted array %.1f\n", elapsed);
+		fixed.clear();
+	}
+	
+	printf("\n");
+}
+
+template <typename Node> int32_t traverse_sum(const treereference_t<Node, 2>& node, const int& item)
+{
+	bench_sink += item;
+	return 1;
+}
+
+template <typename Node, typename Range> double traverse_walk(const size_t nodes, Range range)
+{
+	return bench_nanoseconds(nodes, [&]()
+	{
+		size_t sum = 0;
+		for (typename Range::iterator i = range.begin(); i != range.end(); ++i)
+		{
+			sum += *i;
+		}
+		
+		bench_sink = sum;
+	});
+}
+
+template <typename Node> void traverse_run(const char* name)
+{
+	const uint32_t depth = 20;
+	binarytree_t<int, Node> tree(depth);
+	std::vector<typename binarytree_t<int, Node>::iterator> level(1, tree.set_root(0));
+	int value = 1;
+	for (uint32_t ring = 1; ring < depth; ring++)
+	{
+		std::vector<typename binarytree_t<int, Node>::iterator> below;
+		for (size_t i = 0; i < level.size(); i++)
+		{
+			below.push_back(level[i].left(value++));
+			below.push_back(level[i].right(value++));
+		}
+		
+		level.swap(below);
+	}
+	
+	const size_t nodes = tree.size();
+	double recursive = bench_nanoseconds(nodes, [&]()
+	{
+		tree.each(&traverse_sum<Node>);
+	});
+	printf("    %s, %zu nodes: recursive each %.2f, pre-order %.2f, in-order %.2f, post-order %.2f, level-order %.2f\n", name, nodes, recursive,
+		traverse_walk<Node>(nodes, tree.preorder()),
+		traverse_walk<Node>(nodes, tree.inorder()),
+		traverse_walk<Node>(nodes, tree.postorder()),
+		traverse_walk<Node>(nodes, tree.levelorder()));
+	double sweep = bench_nanoseconds(nodes, [&]()
+	{
+		size_t sum = 0;
+		tree.for_each_level_order([&](Node& node, int& item) { sum += item; });
+		bench_sink = sum;
+	});
+	printf("    %s, %zu nodes: level-order sweep %.2f\n", name, nodes, sweep);
+	tree.clear();
+}
+
+void traverse_bench()
+{
+	printf("  whole tree traversal, ns per node\n");
+	traverse_run<binarynode_t<int> >("linked");
+	traverse_run<compactnode_t<int> >("compact");
+	printf("\n");
+}
+
+template <typename Node> int32_t callback_left(const treereference_t<Node, 2>& node, const int& item)
+{
+	bench_sink += item;
+	return 1;
+}
+
+template <typename Node> void callback_run(const char* name)
+{
+	const uint32_t depth = 20;
+	binarytree_t<int, Node> tree(depth);
+	std::vector<typename binarytree_t<int, Node>::iterator> level(1, tree.set_root(0));
+	int value = 1;
+	for (uint32_t ring = 1; ring < depth; ring++)
+	{
+		std::vector<typename binarytree_t<int, Node>::iterator> below;
+		for (size_t i = 0; i < level.size(); i++)
+		{
+			below.push_back(level[i].left(value++));
+			below.push_back(level[i].right(value++));
+		}
+		
+		level.swap(below);
+	}
+	
+	const size_t nodes = tree.size();
+	double pointer = bench_nanoseconds(nodes, [&]()
+	{
+		tree.each(&traverse_sum<Node>);
+	});
+	double lambda = bench_nanoseconds(nodes, [&]()
+	{
+		size_t sum = 0;
+		tree.each([&](Node& node, int& item) -> int32_t { sum += item; return 1; });
+		bench_sink = sum;
+	});
+	printf("    %s, each over %zu nodes: function pointer %.2f, lambda %.2f\n", name, nodes, pointer, lambda);
+	const size_t paths = 100000;
+	pointer = bench_nanoseconds(paths * depth, [&]()
+	{
+		for (size_t i = 0; i < paths; i++)
+		{
+			tree.path(&callback_left<Node>);
+		}
+	});
+	lambda = bench_nanoseconds(paths * depth, [&]()
+	{
+		size_t sum = 0;
+		for (size_t i = 0; i < paths; i++)
+		{
+			tree.path([&](Node& node, int& item) -> int32_t { sum += item; return 1; });
+		}
+		
+		bench_sink = sum;
+	});
+	printf("    %s, path of %u nodes: function pointer %.2f, lambda %.2f\n", name, depth, pointer, lambda);
+	tree.clear();
+}
+
+void callback_bench()
+{
+	printf("  summing callback, ns per node\n");
+	callback_run<binarynode_t<int> >("linked");
+	callback_run<compactnode_t<int> >("compact");
+	printf("\n");
+}
+
+template <typename Tree> void parallel_run(const char* name, Tree& tree)
+{
+	const size_t nodes = tree.size();
+	double serial = bench_nanoseconds(nodes, [&]()
+	{
+		size_t sum = 0;
+		tree.each([&](compactnode_t<int>& node, int& item) -> int32_t { sum += item; return 1; });
+		bench_sink = sum;
+	});
+	double parallel = bench_nanoseconds(nodes, [&]()
+	{
+		bench_sink = tree.parallel_each((size_t)0, [](size_t& sum, compactnode_t<int>& node, int& item) { sum += item; }, [](size_t& sum, const size_t& other) { sum += other; });
+	});
+	printf("    %s, %zu nodes: each %.2f, parallel each %.2f on %u workers\n", name, nodes, serial, parallel, treepool_t::shared().workers());
+}
+
+void parallel_bench()
+{
+	printf("  summing every node, ns per node\n");
+	int value = 0;
+	binarytree_t<int, compactnode_t<int> > binary(22);
+	std::vector<binaryiterator_t<int, compactnode_t<int> > > level(1, binary.set_root(value++));
+	for (uint32_t ring = 1; ring < 22; ring++)
+	{
+		std::vector<binaryiterator_t<int, compactnode_t<int> > > below;
+		for (size_t i = 0; i < level.size(); i++)
+		{
+			below.push_back(level[i].left(value++));
+			below.push_back(level[i].right(value++));
+		}
+		
+		level.swap(below);
+	}
+	
+	quadtree_t<int, compactnode_t<int> > quad(11);
+	std::vector<quaditerator_t<int, compactnode_t<int> > > quads(1, quad.set_root(value++));
+	for (uint32_t ring = 1; ring < 11; ring++)
+	{
+		std::vector<quaditerator_t<int, compactnode_t<int> > > below;
+		for (size_t i = 0; i < quads.size(); i++)
+		{
+			for (int32_t q = 0; q < 4; q++)
+			{
+				below.push_back(quads[i].child(q, value++));
+			}
+		}
+		
+		quads.swap(below);
+	}
+	
+	parallel_run("binary", binary);
+	parallel_run("quad", quad);
+	binary.clear();
+	quad.clear();
+	printf("\n");
+}
+
+double build_run(const uint32_t workers, const treestorage_t storage)
+{
+	// The rings above the split are claimed by one thread, then each subtree at the split is built by whichever worker takes it.
+	const uint32_t depth = 20;
+	const uint32_t split = 6;
+	treepool_t pool(workers);
+	binarytree_t<int, compactnode_t<int> > tree(depth, storage);
+	tree.reserve(depth);
+	std::vector<binaryiterator_t<int, compactnode_t<int> > > roots(1, tree.set_root(0));
+	double elapsed = bench_nanoseconds(tree_size(depth, 2), [&]()
+	{
+		for (uint32_t ring = 1; ring < split; ring++)
+		{
+			std::vector<binaryiterator_t<int, compactnode_t<int> > > below;
+			for (size_t i = 0; i < roots.size(); i++)
+			{
+				below.push_back(roots[i].claim_left((int)ring));
+				below.push_back(roots[i].claim_right((int)ring));
+			}
+			
+			roots.swap(below);
+		}
+		
+		pool.run(roots.size(), [&](const uint32_t worker, const size_t task)
+		{
+			binaryiterator_t<int, compactnode_t<int> > stack[depth * 2];
+			uint32_t top = 0;
+			stack[top++] = roots[task];
+			while (top > 0)
+			{
+				binaryiterator_t<int, compactnode_t<int> > node = stack[--top];
+				if (node._node.ring() + 1 < depth)
+				{
+					stack[top++] = node.claim_left((int)task);
+					stack[top++] = node.claim_right((int)task);
+				}
+			}
+		});
+	});
+	if (tree.size() != tree_size(depth, 2))
+	{
+		printf("    built %zu nodes out of %zu\n", tree.size(), tree_size(depth, 2));
+	}
+	
+	tree.clear();
+	return elapsed;
+}
+
+void build_bench()
+{
+	printf("  building disjoint subtrees from several threads, ns per node\n");
+	for (uint32_t workers = 1; workers <= max(std::thread::hardware_concurrency(), 4u); workers *= 2)
+	{
+		printf("    %u threads: contiguous %.2f, sparse %.2f\n", workers, build_run(workers, TREE_STORAGE_CONTIGUOUS), build_run(workers, TREE_STORAGE_SPARSE));
+	}
+	
+	printf("\n");
+}
+
+template <typename Node> void load_run(const char* name)
+{
+	const uint32_t depth = 22;
+	const size_t nodes = tree_size(depth, 2);
+	std::vector<int> items(nodes);
+	for (size_t i = 0; i < nodes; i++)
+	{
+		items[i] = (int)i;
+	}
+	
+	binarytree_t<int, Node> chained;
+	double elapsed = bench_nanoseconds(nodes, [&]()
+	{
+		// Each parent is revisited by its index, so the chained build is not slowed down by keeping a list of iterators.
+		typename binarytree_t<int, Node>::iterator top = chained.set_root(items[0]);
+		for (size_t i = 0; i < nodes / 2; i++)
+		{
+			typename binarytree_t<int, Node>::iterator up(treereference_t<Node, 2>(*(top._node.registry()), i));
+			up.right(items[tree_child_index(i, 0, 2)]);
+			up.left(items[tree_child_index(i, 1, 2)]);
+		}
+	});
+	printf("    %s, %zu nodes: set_root then left and right %.2f", name, chained.size(), elapsed);
+	chained.clear();
+	
+	binarytree_t<int, Node> loaded;
+	elapsed = bench_nanoseconds(nodes, [&]()
+	{
+		loaded.assign(items.data(), nodes);
+	});
+	printf(", assign %.2f\n", elapsed);
+	loaded.clear();
+}
+
+void load_bench()
+{
+	printf("  building a full tree from a level-order array, ns per node\n");
+	load_run<binarynode_t<int> >("linked");
+	load_run<compactnode_t<int> >("compact");
+	printf("\n");
+}
+
+void image_bench()
+{
+	printf("  saving and loading a tree, ms\n");
+	const uint32_t depth = 24;
+	const size_t nodes = tree_size(depth, 2);
+	std::vector<int> items(nodes);
+	for (size_t i = 0; i < nodes; i++)
+	{
+		items[i] = (int)i;
+	}
+	
+	binarytree_t<int, compactnode_t<int> > built;
+	double elapsed = bench_nanoseconds(1000000, [&]()
+	{
+		built.assign(items.data(), nodes);
+	});
+	printf("    %zu nodes: assign %.2f", nodes, elapsed);
+	elapsed = bench_nanoseconds(1000000, [&]()
+	{
+		built.save("bench.tree");
+	});
+	printf(", save %.2f", elapsed);
+	built.clear();
+	
+	// Opening only maps the file, the pages of a path are read when it first touches them.
+	binarytree_t<int, compactnode_t<int> > opened;
+	elapsed = bench_nanoseconds(1000000, [&]()
+	{
+		opened.open("bench.tree");
+	});
+	printf(", open %.3f", elapsed);
+	size_t state = 1;
+	elapsed = bench_nanoseconds(1000000, [&]()
+	{
+		size_t sum = 0;
+		for (size_t i = 0; i < 1000; i++)
+		{
+			size_t turns = bench_random(state);
+			opened.path([&](compactnode_t<int>& node, int& item) -> int32_t { sum += item; turns >>= 1; return (turns & 1) != 0 ? 1 : -1; });
+		}
+		
+		bench_sink = sum;
+	});
+	printf(", first 1000 paths %.2f\n", elapsed);
+	
+	// The stream is kept in memory, so the times are the cost of the format rather than of a disk.
+	std::vector<unsigned char> stream;
+	stream.reserve(nodes * sizeof(int) + (nodes >> 3) + 4096);
+	elapsed = bench_nanoseconds(1000000, [&]()
+	{
+		opened.write([&](const void* data, size_t size) { stream.insert(stream.end(), (const unsigned char*)data, (const unsigned char*)data + size); return true; });
+	});
+	printf("    %zu nodes: write to a stream %.2f, %zu bytes", nodes, elapsed, stream.size());
+	opened.clear();
+	remove("bench.tree");
+	size_t position = 0;
+	elapsed = bench_nanoseconds(1000000, [&]()
+	{
+		opened.read([&](void* data, size_t size) { memcpy(data, stream.data() + position, size); position += size; return true; });
+	});
+	printf(", read back %.2f\n", elapsed);
+	opened.clear();
+	printf("\n");
+}
+
+template <typename Node> double path_run(const uint32_t depth, const treestorage_t storage, const bool batched)
+{
+	binarytree_t<int, Node> tree(depth, storage);
+	tree.reserve(depth);
+	binaryiterator_t<int, Node> stack[64];
+	uint32_t top = 0;
+	stack[top++] = tree.set_root(0);
+	while (top > 0)
+	{
+		binaryiterator_t<int, Node> node = stack[--top];
+		if (node._node.ring() + 1 < depth)
+		{
+			stack[top++] = node.left(1);
+			stack[top++] = node.right(1);
+		}
+	}
+	
+	// Each path picks its turns from a random number, so that consecutive paths share little more than the top rings.
+	const size_t count = 1000000;
+	std::vector<size_t> turns(count);
+	size_t state = 1;
+	for (size_t i = 0; i < count; i++)
+	{
+		turns[i] = bench_random(state);
+	}
+	
+	double elapsed = bench_nanoseconds(count, [&]()
+	{
+		size_t sum = 0;
+		if (batched)
+		{
+			tree.paths(count, [&](const size_t query, Node& node, int& item) -> int32_t { sum += item; turns[query] >>= 1; return (turns[query] & 1) != 0 ? 1 : -1; });
+		}
+		else
+		{
+			for (size_t i = 0; i < count; i++)
+			{
+				size_t bits = turns[i];
+				tree.path([&](Node& node, int& item) -> int32_t { sum += item; bits >>= 1; return (bits & 1) != 0 ? 1 : -1; });
+			}
+		}
+		
+		bench_sink = sum;
+	});
+	tree.clear();
+	return elapsed;
+}
+
+void path_bench()
+{
+	printf("  random root to leaf paths, ns per path\n");
+	for (uint32_t depth = 16; depth <= 22; depth += 3)
+	{
+		printf("    %u rings: linked contiguous %.1f, linked van Emde Boas %.1f, compact contiguous %.1f, compact van Emde Boas %.1f\n", depth,
+			path_run<binarynode_t<int> >(depth, TREE_STORAGE_CONTIGUOUS, false),
+			path_run<binarynode_t<int> >(depth, TREE_STORAGE_VEB, false),
+			path_run<compactnode_t<int> >(depth, TREE_STORAGE_CONTIGUOUS, false),
+			path_run<compactnode_t<int> >(depth, TREE_STORAGE_VEB, false));
+		printf("    %u rings, batched: linked contiguous %.1f, linked van Emde Boas %.1f, compact contiguous %.1f, compact van Emde Boas %.1f\n", depth,
+			path_run<binarynode_t<int> >(depth, TREE_STORAGE_CONTIGUOUS, true),
+			path_run<binarynode_t<int> >(depth, TREE_STORAGE_VEB, true),
+			path_run<compactnode_t<int> >(depth, TREE_STORAGE_CONTIGUOUS, true),
+			path_run<compactnode_t<int> >(depth, TREE_STORAGE_VEB, true));
+	}
+	
+	printf("\n");
+}
+
+void alloc_run(const char* name, treeallocator_t* allocator)
+{
+	const uint32_t depth = 24;
+	const size_t nodes = tree_size(depth, 2);
+	std::vector<int> items(nodes);
+	for (size_t i = 0; i < nodes; i++)
+	{
+		items[i] = (int)i;
+	}
+	
+	binarytree_t<int, compactnode_t<int> > tree(depth, TREE_STORAGE_CONTIGUOUS, allocator);
+	double elapsed = bench_nanoseconds(nodes, [&]()
+	{
+		tree.assign(items.data(), nodes);
+	});
+	printf("    %s: assign %.2f ns per node", name, elapsed);
+	
+	const size_t count = 1000000;
+	size_t state = 1;
+	elapsed = bench_nanoseconds(count, [&]()
+	{
+		size_t sum = 0;
+		for (size_t i = 0; i < count; i++)
+		{
+			size_t bits = bench_random(state);
+			tree.path([&](compactnode_t<int>& node, int& item) -> int32_t { sum += item; bits >>= 1; return (bits & 1) != 0 ? 1 : -1; });
+		}
+		
+		bench_sink = sum;
+	});
+	printf(", random paths %.1f ns per path", elapsed);
+	tree.clear();
+	
+	// Many small trees that grow a ring at a time, where every tree buffer is a handful of small blocks.
+	const size_t trees = 10000;
+	std::vector<binarytree_t<int, compactnode_t<int> >*> small(trees);
+	elapsed = bench_nanoseconds(trees, [&]()
+	{
+		for (size_t i = 0; i < trees; i++)
+		{
+			small[i] = new binarytree_t<int, compactnode_t<int> >(1, TREE_STORAGE_SEGMENTED, allocator);
+			binaryiterator_t<int, compactnode_t<int> > node = small[i]->set_root(0);
+			for (int item = 1; item < 8; item++)
+			{
+				node = node.left(item);
+			}
+		}
+		
+		for (size_t i = 0; i < trees; i++)
+		{
+			delete small[i];
+		}
+	});
+	printf(", small trees %.0f ns per tree\n", elapsed);
+}
+
+void alloc_bench()
+{
+	printf("  tree buffers from each allocator policy, %zu nodes\n", tree_size(24, 2));
+	treealigned_t lines;
+	treehugepages_t huge;
+	treearena_t arena;
+	alloc_run("calloc", 0);
+	alloc_run("cache line aligned", &lines);
+	alloc_run("huge pages", &huge);
+	alloc_run("arena", &arena);
+	arena.reset();
+	printf("\n");
+}
+
+void spatial_run(const size_t count, const treestorage_t storage, const char* name)
+{
+	// Points are spread evenly over a 1000 by 1000 box, the queries are about the size of a city block on a map of a country.
+	std::vector<spatialpoint_t<int> > points(count);
+	size_t state = 1;
+	for (size_t i = 0; i < count; i++)
+	{
+		points[i]._x = (double)(bench_random(state) % 1000000) / 1000.0;
+		points[i]._y = (double)(bench_random(state) % 1000000) / 1000.0;
+		points[i]._data = (int)i;
+	}
+	
+	spatialtree_t<int> tree(0.0, 0.0, 1000.0, 1000.0, 32, 16, storage);
+	double elapsed = bench_nanoseconds(count, [&]()
+	{
+		for (size_t i = 0; i < count; i++)
+		{
+			tree.insert(points[i]._x, points[i]._y, points[i]._data);
+		}
+	});
+	printf("    %zu points, %s: insert %.0f ns per point, %u rings\n", count, name, elapsed, tree.rings());
+	
+	const size_t queries = 1000;
+	const size_t scans = 10;
+	std::vector<spatialpoint_t<int> > centers(queries);
+	for (size_t i = 0; i < queries; i++)
+	{
+		centers[i]._x = (double)(bench_random(state) % 1000000) / 1000.0;
+		centers[i]._y = (double)(bench_random(state) % 1000000) / 1000.0;
+	}
+	
+	size_t found = 0;
+	double tree_time = bench_nanoseconds(queries, [&]()
+	{
+		for (size_t i = 0; i < queries; i++)
+		{
+			found += tree.query_rect(centers[i]._x - 5.0, centers[i]._y - 5.0, centers[i]._x + 5.0, centers[i]._y + 5.0, [&](const spatialpoint_t<int>& point) { bench_sink += point._data; });
+		}
+	});
+	double scan_time = bench_nanoseconds(scans, [&]()
+	{
+		for (size_t i = 0; i < scans; i++)
+		{
+			for (size_t j = 0; j < count; j++)
+			{
+				if (points[j]._x >= centers[i]._x - 5.0 && points[j]._x <= centers[i]._x + 5.0 && points[j]._y >= centers[i]._y - 5.0 && points[j]._y <= centers[i]._y + 5.0)
+				{
+					bench_sink += points[j]._data;
+				}
+			}
+		}
+	});
+	printf("      10 by 10 rectangle, %.0f points: tree %.2f us, scan %.0f us\n", (double)found / queries, tree_time / 1000.0, scan_time / 1000.0);
+	
+	found = 0;
+	tree_time = bench_nanoseconds(queries, [&]()
+	{
+		for (size_t i = 0; i < queries; i++)
+		{
+			found += tree.query_radius(centers[i]._x, centers[i]._y, 5.0, [&](const spatialpoint_t<int>& point) { bench_sink += point._data; });
+		}
+	});
+	scan_time = bench_nanoseconds(scans, [&]()
+	{
+		for (size_t i = 0; i < scans; i++)
+		{
+			for (size_t j = 0; j < count; j++)
+			{
+				const double dx = points[j]._x - centers[i]._x;
+				const double dy = points[j]._y - centers[i]._y;
+				if (dx * dx + dy * dy <= 25.0)
+				{
+					bench_sink += points[j]._data;
+				}
+			}
+		}
+	});
+	printf("      radius 5, %.0f points: tree %.2f us, scan %.0f us\n", (double)found / queries, tree_time / 1000.0, scan_time / 1000.0);
+	
+	const size_t k = 8;
+	spatialpoint_t<int> nearest[k];
+	tree_time = bench_nanoseconds(queries, [&]()
+	{
+		for (size_t i = 0; i < queries; i++)
+		{
+			bench_sink += tree.nearest_k(centers[i]._x, centers[i]._y, k, nearest);
+		}
+	});
+	scan_time = bench_nanoseconds(scans, [&]()
+	{
+		// The scan keeps the k nearest distances sorted, which costs little as most points are farther than all of them.
+		for (size_t i = 0; i < scans; i++)
+		{
+			double best[k];
+			for (size_t j = 0; j < k; j++)
+			{
+				best[j] = 1e300;
+			}
+			
+			for (size_t j = 0; j < count; j++)
+			{
+				const double dx = points[j]._x - centers[i]._x;
+				const double dy = points[j]._y - centers[i]._y;
+				double distance = dx * dx + dy * dy;
+				if (distance < best[k - 1])
+				{
+					size_t slot = k - 1;
+					for (; slot > 0 && best[slot - 1] > distance; slot--)
+					{
+						best[slot] = best[slot - 1];
+					}
+					
+					best[slot] = distance;
+				}
+			}
+			
+			bench_sink += (size_t)best[0];
+		}
+	});
+	printf("      nearest %zu: tree %.2f us, scan %.0f us\n", k, tree_time / 1000.0, scan_time / 1000.0);
+	tree.clear();
+}
+
+void spatial_bench()
+{
+	printf("  point queries against scanning every point\n");
+	spatial_run(1000000, TREE_STORAGE_SPARSE, "sparse");
+	spatial_run(1000000, TREE_STORAGE_CONTIGUOUS, "contiguous");
+	spatial_run(10000000, TREE_STORAGE_SPARSE, "sparse");
+	spatial_run(10000000, TREE_STORAGE_CONTIGUOUS, "contiguous");
+	printf("\n");
+}
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+__attribute__((target("bmi2"))) static inline uint64_t morton_encode_bmi2(const uint32_t x, const uint32_t y)
+{
+	return _pdep_u64(x, 0x5555555555555555ull) | _pdep_u64(y, 0xaaaaaaaaaaaaaaaaull);
+}
+#endif
+
+void morton_run(const uint32_t rings)
+{
+	const size_t nodes = tree_size(rings, 4);
+	std::vector<int> items(nodes);
+	for (size_t i = 0; i < nodes; i++)
+	{
+		items[i] = (int)i;
+	}
+	
+	quadtree_t<int, compactnode_t<int> > tree;
+	tree.assign(items.data(), nodes);
+	
+	const size_t count = 1000000;
+	const uint32_t ring = rings - 1;
+	std::vector<uint32_t> xs(count);
+	std::vector<uint32_t> ys(count);
+	size_t state = 1;
+	for (size_t i = 0; i < count; i++)
+	{
+		xs[i] = (uint32_t)(bench_random(state) & (((size_t)1 << ring) - 1));
+		ys[i] = (uint32_t)(bench_random(state) & (((size_t)1 << ring) - 1));
+	}
+	
+	double walked = bench_nanoseconds(count, [&]()
+	{
+		size_t sum = 0;
+		for (size_t i = 0; i < count; i++)
+		{
+			quaditerator_t<int, compactnode_t<int> > node = tree.root();
+			for (uint32_t bit = ring; bit > 0; bit--)
+			{
+				node = node.child((int32_t)(((xs[i] >> (bit - 1)) & 1) | (((ys[i] >> (bit - 1)) & 1) << 1)));
+			}
+			
+			sum += *node;
+		}
+		
+		bench_sink = sum;
+	});
+	double addressed = bench_nanoseconds(count, [&]()
+	{
+		size_t sum = 0;
+		for (size_t i = 0; i < count; i++)
+		{
+			sum += *tree.cell(ring, xs[i], ys[i]);
+		}
+		
+		bench_sink = sum;
+	});
+	double neighbors = bench_nanoseconds(count, [&]()
+	{
+		size_t sum = 0;
+		for (size_t i = 0; i < count; i++)
+		{
+			quaditerator_t<int, compactnode_t<int> > node = tree.cell(ring, xs[i], ys[i]).neighbor(1, 0);
+			sum += node.empty() ? 0 : *node;
+		}
+		
+		bench_sink = sum;
+	});
+	printf("    %u rings, %zu nodes: walk from the root %.1f, cell %.1f, cell then neighbor %.1f\n", rings, nodes, walked, addressed, neighbors);
+	tree.clear();
+}
+
+void morton_bench()
+{
+	printf("  finding the node of a random cell in the last ring, ns per cell\n");
+	morton_run(8);
+	morton_run(11);
+	morton_run(13);
+	
+	const size_t count = 10000000;
+	std::vector<uint32_t> values(count);
+	size_t state = 1;
+	for (size_t i = 0; i < count; i++)
+	{
+		values[i] = (uint32_t)bench_random(state);
+	}
+	
+	double portable = bench_nanoseconds(count, [&]()
+	{
+		uint64_t sum = 0;
+		for (size_t i = 0; i + 1 < count; i++)
+		{
+			sum += tree_morton_spread(values[i]) | (tree_morton_spread(values[i + 1]) << 1);
+		}
+		
+		bench_sink = (size_t)sum;
+	});
+	printf("  morton codes, ns per code: shifts and masks %.2f", portable);
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+	if (__builtin_cpu_supports("bmi2"))
+	{
+		double deposited = bench_nanoseconds(count, [&]()
+		{
+			uint64_t sum = 0;
+			for (size_t i = 0; i + 1 < count; i++)
+			{
+				sum += morton_encode_bmi2(values[i], values[i + 1]);
+			}
+			
+			bench_sink = (size_t)sum;
+		});
+		printf(", pdep %.2f", deposited);
+	}
+#endif
+	printf("\n\n");
+}
+
+int main(int argc, char** argv)
+{
+	for (int i = 0; i < argc; i++)
+	{
+		std::string option = argv[i];
+		if (option.size() > 1 && option[0] == '-')
+		{
+			option = option.substr(1);
+			if (option == "index")
+			{
+				index_bench();
+			}
+			else if (option == "growth")
+			{
+				growth_bench();
+			}
+			else if (option == "scan")
+			{
+				scan_bench();
+			}
+			else if (option == "ordered")
+			{
+				ordered_bench();
+			}
+			else if (option == "traverse")
+			{
+				traverse_bench();
+			}
+			else if (option == "callback")
+			{
+				callback_bench();
+			}
+			else if (option == "parallel")
+			{
+				parallel_bench();
+			}
+			else if (option == "build")
+			{
+				build_bench();
+			}
+			else if (option == "load")
+			{
+				load_bench();
+			}
+			else if (option == "image")
+			{
+				image_bench();
+			}
+			else if (option == "path")
+			{
+				path_bench();
+			}
+			else if (option == "alloc")
+			{
+				alloc_bench();
+			}
+			else if (option == "spatial")
+			{
+				spatial_bench();
+			}
+			else if (option == "morton")
+			{
+				morton_bench();
+			}
+		}
+	}
+	
+	return 0;
+}
\ No newline at end of file
@@ -1,9 +1,10 @@
 
-#include "../include/tree.h"
-
 #include <stdio.h>
 
 #include <string>
+#include <vector>
+
+#include "../include/tree.h"
 
 int callback_binary_print(const treereference_t<binarynode_t<int> >& node, const int& item)
 {
@@ -11,12 +12,41 @@ int callback_binary_print(const treereference_t<binarynode_t<int> >& node, const
 	return item / abs(item);
 }
 
+int callback_compact_print(const treereference_t<compactnode_t<int>, 2>& node, const int& item)
+{
+	printf("    node (%u, %zu) = %d\n", node.ring(), node.branch(), item);
+	return 1;
+}
+
 int callback_quad_print(const treereference_t<quadnode_t<std::string> >& node, const std::string& item)
 {
 	printf("    node (%d, %d) = %s\n", node->_ring, node->_branch, item.c_str());
 	return 1;
 }
 
+class budgetallocator_t : public treealigned_t
+{
+public:
+	
+	inline budgetallocator_t(const size_t blocks) :
+		treealigned_t(64),
+		_blocks(blocks) {}
+		
+	inline void* allocate(const size_t size)
+	{
+		if (this->_blocks == 0)
+		{
+			return 0;
+		}
+		
+		this->_blocks--;
+		return treealigned_t::allocate(size);
+	}
+	
+	size_t _blocks;
+	
+};
+
 void binary_test()
 {
 	printf("  starting binary tree\n");
@@ -92,6 +122,597 @@ void binary_test()
 	bt0.clear();
 }
 
+void compact_sample(binarytree_t<int, compactnode_t<int> >& tree)
+{
+	binarytree_t<int, compactnode_t<int> >::iterator i = tree.set_root(2);
+	i = i.left(8);
+	i.left(2).left(5);
+	i.right(4);
+	tree.root().right(7).right(3);
+}
+
+void compact_test()
+{
+	printf("  starting compact binary tree\n");
+	
+	printf("  creating tree\n");
+	binarytree_t<int, compactnode_t<int> > bt0;
+	printf("    node size %zu, linked node size %zu\n", sizeof(compactnode_t<int>), sizeof(binarynode_t<int>));
+	
+	printf("  setting root\n");
+	binarytree_t<int, compactnode_t<int> >::iterator i = bt0.set_root(2);
+	
+	printf("  setting node\n");
+	i = i.left(8);
+	i.left(2).left(5);
+	i.right(4);
+	bt0.root().right(7).right(3);
+	
+	printf("\n");
+	
+	printf("    found 5? %s\n", bt0.search(5).empty() ? "false" : "true");
+	printf("    found -10? %s\n", bt0.search(-10).empty() ? "false" : "true");
+	printf("    parent of 5 is 2? %s\n", *(bt0.search(5).parent()) == 2 ? "true" : "false");
+	printf("    node count %zu\n", bt0.size());
+	
+	binarytree_t<int, compactnode_t<int> >::iterator found[4];
+	size_t count = bt0.search_all(2, found, 4);
+	printf("    found 2 %zu times\n", count);
+	for (size_t n = 0; n < count && n < 4; n++)
+	{
+		printf("    found 2 at (%u, %zu)\n", found[n]._node.ring(), found[n]._node.branch());
+	}
+	
+	printf("\n");
+	
+	printf("  printing tree\n");
+	bt0.each(&callback_compact_print);
+	
+	printf("\n");
+	
+	printf("  printing payloads by ring\n");
+	for (uint32_t ring = 0; ring < bt0.rings(); ring++)
+	{
+		const int* payloads = bt0.payloads(ring);
+		const uint64_t* used = bt0.occupancy(ring);
+		for (size_t branch = 0; branch < tree_ring_length(ring, 2); branch++)
+		{
+			if ((used[branch >> 6] & ((uint64_t)1 << (branch & 63))) != 0)
+			{
+				printf("    payload (%u, %zu) = %d\n", ring, branch, payloads[branch]);
+			}
+		}
+	}
+	
+	printf("\n");
+	
+	printf("  walking tree\n");
+	printf("    pre-order:");
+	for (int item : bt0.preorder())
+	{
+		printf(" %d", item);
+	}
+	
+	printf("\n    in-order:");
+	for (int item : bt0.inorder())
+	{
+		printf(" %d", item);
+	}
+	
+	printf("\n    post-order:");
+	for (int item : bt0.postorder())
+	{
+		printf(" %d", item);
+	}
+	
+	printf("\n    level-order:");
+	for (int item : bt0.levelorder())
+	{
+		printf(" %d", item);
+	}
+	
+	printf("\n");
+	
+	printf("  removing node (1, 1)\n");
+	bt0.root().left().remove();
+	
+	printf("\n");
+	
+	printf("    found 5? %s\n", bt0.search(5).empty() ? "false" : "true");
+	printf("    found 3? %s\n", bt0.search(3).empty() ? "false" : "true");
+	printf("    node count %zu\n", bt0.size());
+	
+	printf("  removing from a tree buffer that was never allocated\n");
+	treealloc_t<int, 2> unused;
+	unused.remove(0);
+	printf("    element count %zu\n", unused.count());
+	
+	printf("\n");
+	
+	bt0.clear();
+}
+
+void callback_test()
+{
+	printf("  starting callables\n");
+	
+	printf("  creating compact tree\n");
+	binarytree_t<int, compactnode_t<int> > bt0;
+	compact_sample(bt0);
+	
+	printf("  visiting every node\n");
+	int total = 0;
+	bt0.for_each_level_order([&](compactnode_t<int>& node, int& item) { total += item; });
+	printf("    sum of every node %d\n", total);
+	for (uint32_t ring = 0; ring < bt0.rings(); ring++)
+	{
+		int sum = 0;
+		bt0.for_each_ring(ring, [&](compactnode_t<int>& node, int& item) { sum += item; });
+		printf("    sum of ring %u is %d\n", ring, sum);
+	}
+	
+	total = 0;
+	bt0.each([&](compactnode_t<int>& node, int& item) -> int32_t { total += item; return 1; });
+	printf("    sum by callable %d\n", total);
+	size_t visited = 0;
+	bt0.each([&](compactnode_t<int>& node, int& item) -> int32_t { visited++; return item == 8 ? 0 : 1; });
+	printf("    nodes visited by a callable that exits at 8: %zu\n", visited);
+	
+	printf("\n");
+	
+	printf("  following paths\n");
+	printf("    leftmost path:");
+	bt0.path([](compactnode_t<int>& node, int& item) -> int32_t { printf(" %d", item); return 1; });
+	printf("\n");
+	printf("    path that exits at 8:");
+	bt0.path([](compactnode_t<int>& node, int& item) -> int32_t { printf(" %d", item); return item == 8 ? 0 : 1; });
+	printf("\n");
+	int sums[2] = { 0, 0 };
+	bt0.paths(2, [&](const size_t query, compactnode_t<int>& node, int& item) -> int32_t { sums[query] += item; return query == 0 ? 1 : -1; });
+	printf("    batched leftmost and rightmost path sums %d and %d\n", sums[0], sums[1]);
+	
+	printf("\n");
+	
+	printf("  visiting an empty tree\n");
+	binarytree_t<int, compactnode_t<int> > empty;
+	visited = 0;
+	empty.each([&](compactnode_t<int>& node, int& item) -> int32_t { visited++; return 1; });
+	empty.path([&](compactnode_t<int>& node, int& item) -> int32_t { visited++; return 1; });
+	empty.paths(2, [&](const size_t query, compactnode_t<int>& node, int& item) -> int32_t { visited++; return 1; });
+	empty.for_each_level_order([&](compactnode_t<int>& node, int& item) { visited++; });
+	printf("    nodes visited %zu\n", visited);
+	
+	printf("\n");
+	
+	bt0.clear();
+}
+
+void parallel_test()
+{
+	printf("  starting thread pool\n");
+	
+	printf("  creating compact tree\n");
+	binarytree_t<int, compactnode_t<int> > bt0;
+	compact_sample(bt0);
+	
+	printf("  visiting and searching on a pool\n");
+	treepool_t pool(4);
+	int total = bt0.parallel_each(0, [](int& sum, compactnode_t<int>& node, int& item) { sum += item; }, [](int& sum, const int& other) { sum += other; }, 1, &pool);
+	printf("    sum on %u workers %d\n", pool.workers(), total);
+	total = bt0.parallel_each(0, [](int& sum, compactnode_t<int>& node, int& item) { sum += item; }, [](int& sum, const int& other) { sum += other; }, 10, &pool);
+	printf("    sum split below the deepest ring %d\n", total);
+	std::atomic<int> count(0);
+	bt0.parallel_each([&](compactnode_t<int>& node, int& item) { count++; });
+	printf("    nodes visited on the shared pool %d\n", count.load());
+	printf("    found 2 on %u workers? %s, %zu nodes hold it\n", pool.workers(), bt0.parallel_search(2, &pool).empty() ? "false" : "true", bt0.parallel_search_all(2, 0, 0, &pool));
+	printf("    found -10 on %u workers? %s, %zu nodes hold it\n", pool.workers(), bt0.parallel_search(-10, &pool).empty() ? "false" : "true", bt0.parallel_search_all(-10, 0, 0, &pool));
+	
+	printf("\n");
+	
+	printf("  visiting and searching an empty tree on a pool\n");
+	binarytree_t<int, compactnode_t<int> > empty;
+	total = empty.parallel_each(0, [](int& sum, compactnode_t<int>& node, int& item) { sum += item; }, [](int& sum, const int& other) { sum += other; }, 0, &pool);
+	printf("    sum %d, found 2? %s, %zu nodes hold it\n", total, empty.parallel_search(2, &pool).empty() ? "false" : "true", empty.parallel_search_all(2, 0, 0, &pool));
+	
+	printf("\n");
+	
+	bt0.clear();
+}
+
+void shared_test()
+{
+	printf("  starting shared snapshots\n");
+	
+	printf("  publishing snapshots\n");
+	treeshared_t<binarytree_t<int, compactnode_t<int> > > shared(4, TREE_STORAGE_SEGMENTED);
+	shared.writer().set_root(1).left(2);
+	printf("    reader before anything is published sees %zu nodes\n", shared.read()->size());
+	{
+		treereader_t<binarytree_t<int, compactnode_t<int> > > before = shared.read();
+		shared.publish();
+		treereader_t<binarytree_t<int, compactnode_t<int> > > after = shared.read();
+		printf("    reader from before publishing sees %zu nodes, reader from after sees %zu, found 2? %s\n", before->size(), after->size(), after->search(2).empty() ? "false" : "true");
+		printf("    %zu snapshots waiting for readers\n", shared.reclaim());
+		shared.writer().root().left().remove();
+		printf("    after the writer removes 2 the reader still found 2? %s\n", after->search(2).empty() ? "false" : "true");
+	}
+	
+	printf("    %zu snapshots waiting once the readers are done\n", shared.reclaim());
+	shared.publish();
+	printf("    reader after publishing again found 2? %s\n", shared.read()->search(2).empty() ? "false" : "true");
+	
+	printf("\n");
+}
+
+void claim_test()
+{
+	printf("  starting concurrent inserts\n");
+	
+	printf("  claiming from several threads\n");
+	binarytree_t<int, compactnode_t<int> > claimed(4);
+	claimed.reserve(4);
+	binaryiterator_t<int, compactnode_t<int> > top = claimed.set_root(0);
+	std::atomic<int> winners(0);
+	std::thread first([&]() { winners += top.claim_left(1).empty() ? 0 : 1; });
+	std::thread second([&]() { winners += top.claim_left(2).empty() ? 0 : 1; });
+	first.join();
+	second.join();
+	printf("    %d of 2 threads claimed the left child, node count %zu\n", winners.load(), claimed.size());
+	
+	printf("  claiming past the reserved rings\n");
+	binaryiterator_t<int, compactnode_t<int> > step = top.claim_right(3);
+	step = step.claim_right(4);
+	step = step.claim_right(5);
+	bool past = !step.empty() && step.claim_right(6).empty();
+	printf("    ring 4 claim refused? %s, node count %zu, rings %u\n", past ? "true" : "false", claimed.size(), claimed.rings());
+	claimed.clear();
+	
+	printf("\n");
+}
+
+void load_test()
+{
+	printf("  starting level-order loads\n");
+	
+	printf("  loading level-order arrays\n");
+	const int levels[7] = { 1, 2, 3, 4, 5, 6, 7 };
+	const uint64_t used = 0x3b;
+	binarytree_t<int, compactnode_t<int> > loaded;
+	loaded.assign(levels, 7);
+	printf("    compact tree of 7, node count %zu, rings %u, parent of 7 is %d\n", loaded.size(), loaded.rings(), *(loaded.search(7).parent()));
+	binarytree_t<int> linked;
+	linked.assign(levels, 7, &used);
+	printf("    linked tree of 7 without indices 2 and 6, node count %zu, found 3? %s, left of 2 is %d\n", linked.size(), linked.search(3).empty() ? "false" : "true", *(linked.search(2).left()));
+	quadtree_t<std::string> area;
+	const std::string quadrants[5] = { "root", "q0", "q1", "q2", "q3" };
+	area.assign(quadrants, 5);
+	printf("    quad tree of 5, node count %zu, quadrant 2 is %s, its parent is root? %s\n", area.size(), (*area.root().child(2)).c_str(), area.root().child(2).parent().root() ? "true" : "false");
+	quadtree_t<std::string, compactnode_t<std::string> > named;
+	std::vector<std::string>* names = new std::vector<std::string>(quadrants, quadrants + 5);
+	named.assign(names->data(), 5);
+	delete names;
+	printf("    compact quad tree of 5 strings, after the array is gone quadrant 3 is %s\n", (*named.root().child(3)).c_str());
+	
+	printf("  loading over a tree that has nodes\n");
+	loaded.assign(levels, 3);
+	printf("    compact tree of 3, node count %zu, found 7? %s\n", loaded.size(), loaded.search(7).empty() ? "false" : "true");
+	bool assigned = loaded.assign(levels, 0);
+	printf("    assigned 0 items? %s, node count %zu, found 1? %s\n", assigned ? "true" : "false", loaded.size(), loaded.search(1).empty() ? "false" : "true");
+	loaded.clear();
+	linked.clear();
+	area.clear();
+	named.clear();
+	
+	printf("\n");
+}
+
+void image_test()
+{
+	printf("  starting images\n");
+	
+	printf("  creating compact tree\n");
+	binarytree_t<int, compactnode_t<int> > bt0;
+	compact_sample(bt0);
+	
+	printf("  saving and mapping an image\n");
+	binarytree_t<int, compactnode_t<int> > image;
+	bool saved = bt0.save("compact.tree");
+	bool opened = image.open("compact.tree");
+	printf("    saved? %s, opened? %s, node count %zu, found 5? %s, parent of 5 is 2? %s\n", saved ? "true" : "false", opened ? "true" : "false", image.size(),
+		image.search(5).empty() ? "false" : "true", *(image.search(5).parent()) == 2 ? "true" : "false");
+	image.search(5).left(6);
+	printf("    growing the mapped tree, node count %zu, found 6? %s\n", image.size(), image.search(6).empty() ? "false" : "true");
+	image.clear();
+	printf("    opened again? %s, found 6? %s\n", image.open("compact.tree") ? "true" : "false", image.search(6).empty() ? "false" : "true");
+	image.clear();
+	
+	printf("  mapping images that are not valid\n");
+	printf("    opened a file that does not exist? %s\n", image.open("missing.tree") ? "true" : "false");
+	FILE* file = fopen("compact.tree", "rb");
+	std::vector<unsigned char> bytes(4096);
+	bytes.resize(fread(bytes.data(), 1, bytes.size(), file));
+	fclose(file);
+	std::vector<unsigned char> corrupt = bytes;
+	((treeimage_t*)corrupt.data())->_count++;
+	file = fopen("compact.tree", "wb");
+	fwrite(corrupt.data(), 1, corrupt.size(), file);
+	fclose(file);
+	printf("    opened with a count that does not match? %s\n", image.open("compact.tree") ? "true" : "false");
+	corrupt = bytes;
+	((treeimage_t*)corrupt.data())->_rings = 64;
+	((treeimage_t*)corrupt.data())->_occupancy = 0xe000000000000058ull;
+	((treeimage_t*)corrupt.data())->_length = 128;
+	file = fopen("compact.tree", "wb");
+	fwrite(corrupt.data(), 1, corrupt.size(), file);
+	fclose(file);
+	printf("    opened with 64 rings and offsets that wrap around? %s\n", image.open("compact.tree") ? "true" : "false");
+	file = fopen("compact.tree", "wb");
+	fwrite(bytes.data(), 1, bytes.size() - 8, file);
+	fclose(file);
+	printf("    opened with the last word missing? %s\n", image.open("compact.tree") ? "true" : "false");
+	image.clear();
+	remove("compact.tree");
+	
+	printf("\n");
+	
+	bt0.clear();
+}
+
+void stream_test()
+{
+	printf("  starting streams\n");
+	
+	printf("  creating compact tree\n");
+	binarytree_t<int, compactnode_t<int> > bt0;
+	compact_sample(bt0);
+	
+	printf("  writing to a stream and reading it back\n");
+	std::vector<unsigned char> stream;
+	bool streamed = bt0.write([&](const void* data, size_t size) { stream.insert(stream.end(), (const unsigned char*)data, (const unsigned char*)data + size); return true; });
+	size_t position = 0;
+	binarytree_t<int, compactnode_t<int> > restored;
+	bool read = restored.read([&](void* data, size_t size) { if (position + size > stream.size()) { return false; } memcpy(data, stream.data() + position, size); position += size; return true; });
+	printf("    written? %s, %zu bytes, read? %s, node count %zu, found 5? %s\n", streamed ? "true" : "false", stream.size(), read ? "true" : "false", restored.size(), restored.search(5).empty() ? "false" : "true");
+	
+	printf("  writing to a sink that fails and reading streams that are not valid\n");
+	streamed = bt0.write([&](const void* data, size_t size) { return false; });
+	printf("    written to a sink that fails? %s\n", streamed ? "true" : "false");
+	stream.resize(stream.size() - 1);
+	position = 0;
+	read = restored.read([&](void* data, size_t size) { if (position + size > stream.size()) { return false; } memcpy(data, stream.data() + position, size); position += size; return true; });
+	printf("    read with the last byte missing? %s, node count %zu\n", read ? "true" : "false", restored.size());
+	stream.push_back(0);
+	((treestream_t*)stream.data())->_count++;
+	position = 0;
+	read = restored.read([&](void* data, size_t size) { if (position + size > stream.size()) { return false; } memcpy(data, stream.data() + position, size); position += size; return true; });
+	printf("    read with a count that does not match? %s, node count %zu\n", read ? "true" : "false", restored.size());
+	std::vector<unsigned char> crafted(stream.begin(), stream.begin() + sizeof(treestream_t));
+	((treestream_t*)crafted.data())->_rings = 65;
+	position = 0;
+	read = restored.read([&](void* data, size_t size) { if (position + size > crafted.size()) { return false; } memcpy(data, crafted.data() + position, size); position += size; return true; });
+	printf("    read with 65 rings? %s\n", read ? "true" : "false");
+	
+	// Two records at the start of ring 8, then a block distance that would wrap back around to its first block.
+	((treestream_t*)crafted.data())->_rings = 9;
+	((treestream_t*)crafted.data())->_count = 3;
+	crafted.resize(crafted.size() + 8, 0);
+	const unsigned char distances[3][10] = { { 1 }, { 1 }, { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x01 } };
+	const size_t lengths[3] = { 1, 1, 10 };
+	const uint64_t bits = 1;
+	for (int record = 0; record < 3; record++)
+	{
+		crafted.insert(crafted.end(), distances[record], distances[record] + lengths[record]);
+		crafted.insert(crafted.end(), (const unsigned char*)&bits, (const unsigned char*)&bits + sizeof(uint64_t));
+		crafted.insert(crafted.end(), (const unsigned char*)&record, (const unsigned char*)&record + sizeof(int));
+	}
+	
+	crafted.push_back(0);
+	position = 0;
+	read = restored.read([&](void* data, size_t size) { if (position + size > crafted.size()) { return false; } memcpy(data, crafted.data() + position, size); position += size; return true; });
+	printf("    read with a block distance that wraps around? %s, node count %zu\n", read ? "true" : "false", restored.size());
+	restored.clear();
+	
+	printf("\n");
+	
+	bt0.clear();
+}
+
+void alloc_test()
+{
+	printf("  starting allocation policies\n");
+	
+	printf("  allocating from a policy\n");
+	const int levels[7] = { 1, 2, 3, 4, 5, 6, 7 };
+	treearena_t arena;
+	binarytree_t<int, compactnode_t<int> > pooled(3, TREE_STORAGE_CONTIGUOUS, &arena);
+	pooled.assign(levels, 7);
+	pooled.search(7).left(8).right(9);
+	binarytree_t<int> deep(1, TREE_STORAGE_SPARSE, &arena);
+	binarytree_t<int>::iterator step = deep.set_root(0);
+	for (int item = 1; item < 20; item++)
+	{
+		step = (item % 2) != 0 ? step.left(item) : step.right(item);
+	}
+	
+	printf("    arena tree node count %zu, rings %u, parent of 9 is %d\n", pooled.size(), pooled.rings(), *(pooled.search(9).parent()));
+	printf("    sparse arena tree node count %zu, found 19? %s, arena in use? %s\n", deep.size(), deep.search(19).empty() ? "false" : "true", arena.used() > 0 ? "true" : "false");
+	treealigned_t paged(4096);
+	binarytree_t<int, compactnode_t<int> > aligned(4, TREE_STORAGE_VEB, &paged);
+	aligned.assign(levels, 7);
+	aligned.search(4).right(10);
+	printf("    page aligned tree node count %zu, left of 2 is %d, on a page boundary? %s\n", aligned.size(), *(aligned.search(2).left()), ((uintptr_t)(compactnode_t<int>*)aligned.search(1)._node & 4095) == 0 ? "true" : "false");
+	pooled.clear();
+	deep.clear();
+	aligned.clear();
+	arena.reset();
+	
+	printf("\n");
+	
+	printf("  allocating from a policy that runs out\n");
+	budgetallocator_t budget(2);
+	binarytree_t<int, compactnode_t<int> > starved(1, TREE_STORAGE_CONTIGUOUS, &budget);
+	binarytree_t<int, compactnode_t<int> >::iterator root = starved.set_root(1);
+	bool grown = !root.left(2).empty();
+	printf("    root set? %s, left child set? %s, reserved 4 rings? %s\n", root.empty() ? "false" : "true", grown ? "true" : "false", starved.reserve(4) ? "true" : "false");
+	printf("    node count %zu, rings %u, found 1? %s\n", starved.size(), starved.rings(), starved.search(1).empty() ? "false" : "true");
+	bool assigned = starved.assign(levels, 7);
+	printf("    assigned 7 items? %s, node count %zu\n", assigned ? "true" : "false", starved.size());
+	budget._blocks = 1;
+	binarytree_t<int, compactnode_t<int> > thin(1, TREE_STORAGE_SPARSE, &budget);
+	root = thin.set_root(1);
+	grown = !root.left(2).empty();
+	printf("    sparse root set? %s, left child set? %s, node count %zu\n", root.empty() ? "false" : "true", grown ? "true" : "false", thin.size());
+	budget._blocks = 3;
+	binarytree_t<int, compactnode_t<int> > blocked(1, TREE_STORAGE_VEB, &budget);
+	assigned = blocked.assign(levels, 7);
+	printf("    van Emde Boas assigned 7 items? %s, node count %zu\n", assigned ? "true" : "false", blocked.size());
+	budget._blocks = 4;
+	treealloc_t<int, 2> flat(1, 2, TREE_STORAGE_CONTIGUOUS, &budget);
+	bool ensured = flat.ensure(3, 2);
+	grown = flat.ensure(13, 2);
+	int* element = treereference_t<int, 2>(flat, 5000);
+	printf("    grown to 3 rings? %s, then to 13 rings? %s, capacity %zu, element 5000 found? %s\n", ensured ? "true" : "false", grown ? "true" : "false", flat.capacity(), element != 0 ? "true" : "false");
+	treealloc_t<int, 2> sparse(1, 2, TREE_STORAGE_SPARSE, &budget);
+	ensured = sparse.ensure(13, 2);
+	element = treereference_t<int, 2>(sparse, 5000);
+	printf("    sparse grown to 13 rings? %s, capacity %zu, element 5000 found without a page? %s\n", ensured ? "true" : "false", sparse.capacity(), element != 0 ? "true" : "false");
+	starved.clear();
+	thin.clear();
+	blocked.clear();
+	flat.clear();
+	sparse.clear();
+	
+	printf("\n");
+}
+
+void search_test()
+{
+	printf("  starting search tree\n");
+	
+	printf("  creating tree\n");
+	searchtree_t<int> st0;
+	
+	printf("  inserting even numbers from 0 to 198 in order\n");
+	for (int item = 0; item < 200; item += 2)
+	{
+		st0.insert(item);
+	}
+	
+	printf("    node count %zu, rings %u\n", st0.size(), st0.rings());
+	
+	printf("\n");
+	
+	printf("    found 42? %s\n", st0.find(42).empty() ? "false" : "true");
+	printf("    found 43? %s\n", st0.find(43).empty() ? "false" : "true");
+	printf("    lower bound of 42 is %d\n", *(st0.lower_bound(42)));
+	printf("    lower bound of 43 is %d\n", *(st0.lower_bound(43)));
+	printf("    upper bound of 42 is %d\n", *(st0.upper_bound(42)));
+	printf("    upper bound of 198 found? %s\n", st0.upper_bound(198).empty() ? "false" : "true");
+	
+	printf("\n");
+	
+	printf("  erasing numbers from 0 to 98\n");
+	for (int item = 0; item < 100; item++)
+	{
+		st0.erase(item);
+	}
+	
+	printf("    node count %zu, rings %u\n", st0.size(), st0.rings());
+	printf("    found 42? %s\n", st0.find(42).empty() ? "false" : "true");
+	printf("    found 100? %s\n", st0.find(100).empty() ? "false" : "true");
+	printf("    lower bound of 0 is %d\n", *(st0.lower_bound(0)));
+	
+	printf("\n");
+	
+	st0.clear();
+}
+
+void static_test()
+{
+	printf("  starting static search tree\n");
+	
+	printf("  building tree from the even numbers from 0 to 198\n");
+	int items[100];
+	for (int i = 0; i < 100; i++)
+	{
+		items[i] = i * 2;
+	}
+	
+	statictree_t<int> st0(items, 100);
+	printf("    node count %zu, rings %u, root %d\n", st0.size(), st0.rings(), *(st0.root()));
+	
+	printf("\n");
+	
+	printf("    found 42? %s\n", st0.find(42).empty() ? "false" : "true");
+	printf("    found 43? %s\n", st0.find(43).empty() ? "false" : "true");
+	printf("    lower bound of 0 is %d\n", *(st0.lower_bound(0)));
+	printf("    lower bound of 43 is %d\n", *(st0.lower_bound(43)));
+	printf("    upper bound of 42 is %d\n", *(st0.upper_bound(42)));
+	printf("    lower bound of 199 found? %s\n", st0.lower_bound(199).empty() ? "false" : "true");
+	printf("    in order:");
+	int shown = 0;
+	for (treerange_t<int, compactnode_t<int>, 2, TREE_ORDER_IN>::iterator i = st0.inorder().begin(); i != st0.inorder().end() && shown < 8; ++i, shown++)
+	{
+		printf(" %d", *i);
+	}
+	
+	printf(" ...\n");
+	
+	printf("\n");
+	
+	st0.clear();
+}
+
+void sparse_test()
+{
+	printf("  starting sparse binary tree\n");
+	
+	printf("  creating tree\n");
+	binarytree_t<int> bt0(1, TREE_STORAGE_SPARSE);
+	
+	printf("  setting a zig-zag path 40 nodes deep\n");
+	binarytree_t<int>::iterator i = bt0.set_root(0);
+	for (int item = 1; item < 40; item++)
+	{
+		i = (item % 2) != 0 ? i.left(item) : i.right(item);
+	}
+	
+	printf("    node count %zu, rings %u, capacity %zu\n", bt0.size(), bt0.rings(), bt0.search(0)._node.registry()->capacity());
+	
+	printf("\n");
+	
+	printf("    found 39? %s\n", bt0.search(39).empty() ? "false" : "true");
+	printf("    found 40? %s\n", bt0.search(40).empty() ? "false" : "true");
+	printf("    parent of 39 is 38? %s\n", *(bt0.search(39).parent()) == 38 ? "true" : "false");
+	
+	printf("\n");
+	
+	printf("  writing a compact copy of the path to a stream\n");
+	binarytree_t<int, compactnode_t<int> > bt1(1, TREE_STORAGE_SPARSE);
+	binarytree_t<int, compactnode_t<int> >::iterator j = bt1.set_root(0);
+	for (int item = 1; item < 40; item++)
+	{
+		j = (item % 2) != 0 ? j.left(item) : j.right(item);
+	}
+	
+	size_t bytes = 0;
+	bt1.write([&](const void* data, size_t size) { bytes += size; return true; });
+	printf("    %zu nodes, capacity %zu, %zu bytes\n", bt1.size(), bt1.search(0)._node.registry()->capacity(), bytes);
+	bt1.clear();
+	
+	printf("\n");
+	
+	printf("  removing node 20\n");
+	bt0.search(20).remove();
+	printf("    node count %zu\n", bt0.size());
+	printf("    found 19? %s\n", bt0.search(19).empty() ? "false" : "true");
+	printf("    found 30? %s\n", bt0.search(30).empty() ? "false" : "true");
+	
+	printf("\n");
+	
+	bt0.clear();
+}
+
 void quad_test()
 {
 	printf("  starting binary tree\n");
@@ -102,8 +723,192 @@ void quad_test()
 	printf("  setting root\n");
 	quadtree_t<std::string>::iterator i = bt0.set_root("I am a root");
 	
+	printf("  setting node\n");
+	i.child(0, "I am quadrant 0").child(3, "I am quadrant 3");
+	i.child(2, "I am quadrant 2");
+	
+	printf("\n");
+	
+	printf("    quadrant 0? %s\n", bt0.root().child(0).empty() ? "false" : (*bt0.root().child(0)).c_str());
+	printf("    quadrant 1? %s\n", bt0.root().child(1).empty() ? "false" : (*bt0.root().child(1)).c_str());
+	printf("    quadrant 0, 3? %s\n", bt0.root()[0][3].empty() ? "false" : (*bt0.root()[0][3]).c_str());
+	printf("    parent of quadrant 0, 3 is root? %s\n", bt0.root()[0][3].parent().parent().root() ? "true" : "false");
+	
+	printf("\n");
+	
 	printf("  printing tree\n");
 	bt0.each(&callback_quad_print);
+	
+	printf("\n");
+	
+	printf("  finding cells by their coordinates\n");
+	printf("    cell (1, 1) of ring 2? %s, at column %u row %u\n", bt0.cell(2, 1, 1).empty() ? "false" : (*bt0.cell(2, 1, 1)).c_str(), bt0.cell(2, 1, 1).x(), bt0.cell(2, 1, 1).y());
+	printf("    cell (0, 1) of ring 1? %s\n", bt0.cell(1, 0, 1).empty() ? "false" : (*bt0.cell(1, 0, 1)).c_str());
+	printf("    cell below quadrant 0? %s\n", bt0.cell(1, 0, 0).neighbor(0, 1).empty() ? "false" : (*bt0.cell(1, 0, 0).neighbor(0, 1)).c_str());
+	printf("    cell left of quadrant 0? %s\n", bt0.cell(1, 0, 0).neighbor(-1, 0).empty() ? "false" : "true");
+	printf("    deepest node over cell (3, 2) of ring 3? %s\n", (*bt0.locate(3, 2, 3)).c_str());
+	printf("    deepest node over cell (3, 3) of ring 2? %s\n", (*bt0.locate(3, 3, 2)).c_str());
+	
+	printf("\n");
+	
+	printf("  laying out a full compact tree of 3 rings in Z-order\n");
+	int cells[21];
+	for (int index = 0; index < 21; index++)
+	{
+		cells[index] = index;
+	}
+	
+	quadtree_t<int, compactnode_t<int> > grid;
+	grid.assign(cells, 21);
+	printf("    ring 2 by row:");
+	for (uint32_t y = 0; y < 4; y++)
+	{
+		printf(" ");
+		for (uint32_t x = 0; x < 4; x++)
+		{
+			printf(" %d", *grid.cell(2, x, y));
+		}
+	}
+	
+	printf("\n");
+	printf("    neighbors of cell (1, 2): left %d, right %d, up %d, down %d\n", *grid.cell(2, 1, 2).neighbor(-1, 0), *grid.cell(2, 1, 2).neighbor(1, 0), *grid.cell(2, 1, 2).neighbor(0, -1), *grid.cell(2, 1, 2).neighbor(0, 1));
+	grid.clear();
+}
+
+void spatial_test()
+{
+	printf("  starting spatial tree\n");
+	
+	printf("  inserting a 10 by 10 grid of points into a box from 0 to 10, 4 points per cell\n");
+	spatialtree_t<int> sp0(0.0, 0.0, 10.0, 10.0, 4);
+	for (int y = 0; y < 10; y++)
+	{
+		for (int x = 0; x < 10; x++)
+		{
+			sp0.insert(x + 0.5, y + 0.5, y * 10 + x);
+		}
+	}
+	
+	printf("    point count %zu, rings %u\n", sp0.size(), sp0.rings());
+	printf("    inserted a point outside of the box? %s\n", sp0.insert(11.0, 5.0, -1) ? "true" : "false");
+	
+	printf("\n");
+	
+	printf("  querying\n");
+	int sum = 0;
+	size_t found = sp0.query_rect(2.0, 3.0, 4.0, 5.0, [&](const spatialpoint_t<int>& point) { sum += point._data; });
+	printf("    %zu points from (2, 3) to (4, 5), items add up to %d\n", found, sum);
+	found = sp0.query_rect(0.0, 0.0, 10.0, 10.0, [&](const spatialpoint_t<int>& point) {});
+	printf("    %zu points in the whole box\n", found);
+	sum = 0;
+	found = sp0.query_radius(5.0, 5.0, 1.0, [&](const spatialpoint_t<int>& point) { sum += point._data; });
+	printf("    %zu points within 1 of (5, 5), items add up to %d\n", found, sum);
+	spatialpoint_t<int> nearest[5];
+	found = sp0.nearest_k(0.2, 9.9, 5, nearest);
+	printf("    %zu nearest points to (0.2, 9.9):", found);
+	for (size_t i = 0; i < found; i++)
+	{
+		printf(" %d", nearest[i]._data);
+	}
+	
+	printf("\n");
+	
+	printf("\n");
+	
+	printf("  inserting 20 points at the same place\n");
+	for (int i = 0; i < 20; i++)
+	{
+		sp0.insert(7.25, 7.25, 100 + i);
+	}
+	
+	printf("    point count %zu, rings %u\n", sp0.size(), sp0.rings());
+	printf("    %zu points within 0.1 of (7.25, 7.25)\n", sp0.query_radius(7.25, 7.25, 0.1, [&](const spatialpoint_t<int>& point) {}));
+	
+	printf("\n");
+	
+	printf("  inserting 10 points at the same place, 1 point per cell and 40 rings asked for\n");
+	spatialtree_t<int> sp1(0.0, 0.0, 1.0, 1.0, 1, 40);
+	for (int item = 0; item < 10; item++)
+	{
+		sp1.insert(0.25, 0.25, item);
+	}
+	
+	printf("    point count %zu, rings %u, %zu points within 0.01 of (0.25, 0.25)\n", sp1.size(), sp1.rings(), sp1.query_radius(0.25, 0.25, 0.01, [&](const spatialpoint_t<int>& point) {}));
+	
+	printf("\n");
+	
+	sp0.clear();
+	sp1.clear();
+}
+
+void veb_test()
+{
+	printf("  starting van Emde Boas binary tree\n");
+	
+	printf("  creating tree\n");
+	binarytree_t<int> bt0(1, TREE_STORAGE_VEB);
+	
+	printf("  setting a zig-zag path 12 nodes deep, with a right child on each node\n");
+	binarytree_t<int>::iterator i = bt0.set_root(0);
+	for (int item = 1; item < 12; item++)
+	{
+		i.right(item + 100);
+		i = (item % 2) != 0 ? i.left(item) : i.right(item);
+	}
+	
+	printf("    node count %zu, rings %u, capacity %zu\n", bt0.size(), bt0.rings(), bt0.search(0)._node.registry()->capacity());
+	
+	printf("\n");
+	
+	printf("    found 11? %s\n", bt0.search(11).empty() ? "false" : "true");
+	printf("    found 105? %s\n", bt0.search(105).empty() ? "false" : "true");
+	printf("    parent of 11 is 10? %s\n", *(bt0.search(11).parent()) == 10 ? "true" : "false");
+	printf("    path:");
+	bt0.path([](binarynode_t<int>& node, int& item) -> int32_t { printf(" %d", item); return (item % 2) == 0 ? 1 : -1; });
+	printf("\n");
+	int total = 0;
+	bt0.for_each_level_order([&](binarynode_t<int>& node, int& item) { total += item; });
+	printf("    sum of every node %d\n", total);
+	
+	printf("\n");
+	
+	printf("  removing node 6\n");
+	bt0.search(6).remove();
+	printf("    node count %zu\n", bt0.size());
+	printf("    found 5? %s\n", bt0.search(5).empty() ? "false" : "true");
+	printf("    found 7? %s\n", bt0.search(7).empty() ? "false" : "true");
+	
+	printf("\n");
+	
+	bt0.clear();
+}
+
+void index_test()
+{
+	printf("  starting index math\n");
+	
+	printf("  finding the deepest ring each stride can address\n");
+	for (uint32_t stride = 2; stride <= 8; stride++)
+	{
+		const uint32_t rings = tree_max_rings(stride);
+		printf("    stride %u: %u rings, size %zu, next size saturates? %s\n", stride, rings, tree_size(rings, stride), tree_size(rings + 1, stride) == SIZE_MAX ? "true" : "false");
+	}
+	
+	printf("    2^64 saturates? %s\n", tree_pow(64, 2) == SIZE_MAX ? "true" : "false");
+	printf("    4^40 saturates? %s\n", tree_pow(40, 4) == SIZE_MAX ? "true" : "false");
+	printf("    3^41 saturates? %s\n", tree_pow(41, 3) == SIZE_MAX ? "true" : "false");
+	printf("    3^40 = %zu\n", tree_pow(40, 3));
+	
+	printf("\n");
+	
+	printf("  reserving 40 rings in a sparse quad tree\n");
+	quadtree_t<int> qt0(1, TREE_STORAGE_SPARSE);
+	qt0.reserve(40);
+	printf("    rings %u\n", qt0.rings());
+	
+	printf("\n");
+	
+	qt0.clear();
 }
 
 int main(int argc, char** argv)
@@ -118,10 +923,70 @@ int main(int argc, char** argv)
 			{
 				binary_test();
 			}
+			else if (option == "compact")
+			{
+				compact_test();
+			}
 			else if (option == "quad")
 			{
 				quad_test();
 			}
+			else if (option == "search")
+			{
+				search_test();
+			}
+			else if (option == "static")
+			{
+				static_test();
+			}
+			else if (option == "sparse")
+			{
+				sparse_test();
+			}
+			else if (option == "spatial")
+			{
+				spatial_test();
+			}
+			else if (option == "veb")
+			{
+				veb_test();
+			}
+			else if (option == "index")
+			{
+				index_test();
+			}
+			else if (option == "callback")
+			{
+				callback_test();
+			}
+			else if (option == "parallel")
+			{
+				parallel_test();
+			}
+			else if (option == "shared")
+			{
+				shared_test();
+			}
+			else if (option == "claim")
+			{
+				claim_test();
+			}
+			else if (option == "load")
+			{
+				load_test();
+			}
+			else if (option == "image")
+			{
+				image_test();
+			}
+			else if (option == "stream")
+			{
+				stream_test();
+			}
+			else if (option == "alloc")
+			{
+				alloc_test();
+			}
 		}
 	}
 	